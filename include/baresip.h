@@ -94,6 +94,29 @@ const char *account_mediaenc(const struct account *acc);
 
 double aulevel_calc_dbov(const int16_t *sampv, size_t sampc);
 
+/** Audio level kernel implementation */
+enum aulevel_impl {
+	AULEVEL_IMPL_AUTO = 0,
+	AULEVEL_IMPL_SCALAR,
+	AULEVEL_IMPL_SSE2,
+	AULEVEL_IMPL_AVX2,
+	AULEVEL_IMPL_NEON,
+};
+
+int  aulevel_impl_set(enum aulevel_impl impl);
+enum aulevel_impl aulevel_impl_get(void);
+const char *aulevel_impl_name(enum aulevel_impl impl);
+
+
+/*
+ * Audio time-scale modification
+ */
+
+int austretch_accel(int16_t *sampv, size_t *sampc, uint32_t srate,
+		    uint8_t ch);
+int austretch_expand(int16_t *sampv, size_t *sampc, size_t maxc,
+		     uint32_t srate, uint8_t ch);
+
 
 /*
  * Call
@@ -191,6 +214,16 @@ static inline bool in_range(const struct range *rng, uint32_t val)
 enum audio_mode {
 	AUDIO_MODE_POLL = 0,         /**< Polling mode                  */
 	AUDIO_MODE_THREAD,           /**< Use dedicated thread          */
+	AUDIO_MODE_TIMER,            /**< Thread with absolute deadlines */
+	AUDIO_MODE_POOL,             /**< Shared pool of TX workers     */
+};
+
+
+/** Real-time scheduling policy for media threads */
+enum realtime_policy {
+	REALTIME_POLICY_OTHER = 0,   /**< Default time-sharing policy   */
+	REALTIME_POLICY_FIFO,        /**< First-in first-out (SCHED_FIFO) */
+	REALTIME_POLICY_RR,          /**< Round-robin (SCHED_RR)        */
 };
 
 
@@ -225,6 +258,8 @@ struct config_audio {
 	uint32_t channels_src;  /**< Opt. channels for source       */
 	bool src_first;         /**< Audio source opened first      */
 	enum audio_mode txmode; /**< Audio transmit mode            */
+	uint32_t tx_workers;    /**< TX pool workers (0 = one/CPU)  */
+	bool ring;              /**< Lock-free ring for device I/O  */
 	bool level;             /**< Enable audio level indication  */
 	int src_fmt;            /**< Audio source sample format     */
 	int play_fmt;           /**< Audio playback sample format   */
@@ -244,6 +279,9 @@ struct config_video {
 	double fps;             /**< Video framerate                */
 	bool fullscreen;        /**< Enable fullscreen display      */
 	int enc_fmt;            /**< Encoder pixelfmt (enum vidfmt) */
+	double pacing;          /**< Pacing rate x bitrate (0=off)  */
+	uint32_t pacing_budget; /**< Max pacing delay in [ms]       */
+	bool decode_thread;     /**< Decode in a worker thread      */
 };
 #endif
 
@@ -257,6 +295,8 @@ struct config_avt {
 	struct range jbuf_del;  /**< Delay, number of frames        */
 	bool rtp_stats;         /**< Enable RTP statistics          */
 	uint32_t rtp_timeout;   /**< RTP Timeout in seconds (0=off) */
+	bool rtp_rx_batch;      /**< Batched RTP receive (Linux)    */
+	bool jbuf_adaptive;     /**< Adaptive audio jitter buffer   */
 };
 
 /* Network */
@@ -280,6 +320,15 @@ struct config_sdp {
 	bool ebuacip;           /**< Enable EBU-ACIP parameters     */
 };
 
+/** Real-time scheduling */
+struct config_realtime {
+	enum realtime_policy policy; /**< Policy for media threads  */
+	uint32_t prio;          /**< Scheduling priority (1-99)     */
+	bool mlockall;          /**< Lock all memory in RAM         */
+	int audio_cpu;          /**< CPU for audio threads (-1=any) */
+	int video_cpu;          /**< CPU for video threads (-1=any) */
+};
+
 
 /** Core configuration */
 struct config {
@@ -302,6 +351,8 @@ struct config {
 #endif
 
 	struct config_sdp sdp;
+
+	struct config_realtime realtime;
 };
 
 int config_parse_conf(struct config *cfg, const struct conf *conf);
@@ -545,12 +596,17 @@ typedef int  (menc_media_h)(struct menc_media **mp, struct menc_sess *sess,
 			    void *rtpsock, void *rtcpsock,
 			    struct sdp_media *sdpm);
 
+/* Decrypt a batch of incoming packets, dropv[i] is set to drop one */
+typedef void (menc_unprotect_h)(struct menc_media *m, struct mbuf **mbv,
+				size_t n, bool *dropv);
+
 struct menc {
 	struct le le;
 	const char *id;
 	const char *sdp_proto;
 	menc_sess_h *sessh;
 	menc_media_h *mediah;
+	menc_unprotect_h *unprotecth;
 };
 
 void menc_register(struct list *mencl, struct menc *menc);
@@ -620,6 +676,7 @@ enum ua_event {
 	UA_EVENT_CALL_DTMF_END,
 	UA_EVENT_CALL_RTCP,
 	UA_EVENT_CALL_MENC,
+	UA_EVENT_CALL_LATENCY,
 	UA_EVENT_VU_TX,
 	UA_EVENT_VU_RX,
 
@@ -1043,6 +1100,19 @@ int vidfilt_dec_append(struct list *filtl, void **ctx,
 		       const struct vidfilt *vf);
 
 
+/*
+ * Video frame pool
+ */
+
+struct vidpool;
+
+int  vidpool_alloc(struct vidpool **poolp);
+int  vidpool_get(struct vidpool *pool, struct vidframe **framep, int fmt,
+		 const struct vidsz *size);
+void vidpool_flush(struct vidpool *pool);
+int  vidpool_debug(struct re_printf *pf, const struct vidpool *pool);
+
+
 /*
  * Audio stream
  */
@@ -1086,11 +1156,53 @@ struct stream *video_strm(const struct video *v);
 double video_timestamp_to_seconds(uint64_t timestamp);
 
 
+/*
+ * Media latency
+ */
+
+/** Stages of the media pipeline, from capture to playout */
+enum lat_stage {
+	LAT_CAPTURE = 0,  /**< Capture to encoder input            */
+	LAT_FILTER,       /**< Pixel conversion and encode filters */
+	LAT_ENCODE,       /**< Encoding                            */
+	LAT_SEND,         /**< Encoder output to RTP send          */
+	LAT_JBUF,         /**< RTP receive to jitter-buffer exit   */
+	LAT_DECODE,       /**< Decoding                            */
+	LAT_PLAYOUT,      /**< Decoder output to playout           */
+
+	LAT_STAGES
+};
+
+enum {LATHIST_BUCKETS = 368};
+
+/** Log-linear latency histogram, values in [us] */
+struct lathist {
+	uint32_t bucketv[LATHIST_BUCKETS]; /**< Counters per bucket     */
+	uint64_t count;                    /**< Number of values        */
+	uint64_t sum;                      /**< Sum of values in [us]   */
+	uint64_t max;                      /**< Largest value in [us]   */
+};
+
+/** Latency histograms for all stages of a media stream */
+struct latency {
+	struct lathist histv[LAT_STAGES];
+};
+
+void     lathist_add(struct lathist *h, uint64_t usec);
+void     lathist_reset(struct lathist *h);
+uint64_t lathist_percentile(const struct lathist *h, double pct);
+uint64_t lathist_mean(const struct lathist *h);
+const char *latency_stage_name(enum lat_stage stage);
+int      latency_debug(struct re_printf *pf, const struct latency *lat);
+int      latency_encode_odict(struct odict *od, const struct latency *lat);
+
+
 /*
  * Generic stream
  */
 
 const struct rtcp_stats *stream_rtcp_stats(const struct stream *strm);
+const struct latency *stream_latency(const struct stream *strm);
 struct call *stream_call(const struct stream *strm);
 
 
@@ -1126,7 +1238,15 @@ int mnat_register(struct mnat **mnatp, struct list *mnatl,
 /*
  * Real-time
  */
+
+/** Type of media thread */
+enum realtime_thread {
+	REALTIME_THREAD_AUDIO = 0,
+	REALTIME_THREAD_VIDEO,
+};
+
 int realtime_enable(bool enable, int fps);
+int realtime_thread_setup(enum realtime_thread type, const char *name);
 
 
 /*
@@ -1220,6 +1340,33 @@ int h264_nal_send(bool first, bool last,
 		  bool marker, uint32_t ihdr, uint64_t rtp_ts,
 		  const uint8_t *buf, size_t size, size_t maxsz,
 		  videnc_packet_h *pkth, void *arg);
+
+/** H.264 RTP packet, with the payload pointing into the input buffer */
+struct h264_pkt {
+	uint8_t hdr[2];          /**< NAL header, or FU indicator+header */
+	size_t hdr_len;          /**< Header length, 1 or 2              */
+	const uint8_t *pld;      /**< Payload, a slice of the input      */
+	size_t pld_len;          /**< Payload length                     */
+	bool marker;             /**< Last packet of the access unit     */
+};
+
+/** H.264 packetizer state, splits a byte stream into RTP packets */
+struct h264_packetizer {
+	const uint8_t *r;        /**< Next start code                    */
+	const uint8_t *end;      /**< End of the byte stream             */
+	const uint8_t *pld;      /**< Remaining payload of current NAL   */
+	size_t pld_len;          /**< Remaining payload length           */
+	size_t maxsz;            /**< Maximum packet size                */
+	uint8_t nal_hdr;         /**< Header of current NAL unit         */
+	bool busy;               /**< A NAL unit is being packetized     */
+	bool frag;               /**< Current NAL unit is fragmented     */
+	bool start;              /**< Next fragment is the first         */
+	bool last;               /**< Current NAL unit is the last       */
+};
+
+int h264_packetizer_init(struct h264_packetizer *pz, const uint8_t *buf,
+			 size_t len, size_t pktsize);
+int h264_packetizer_next(struct h264_packetizer *pz, struct h264_pkt *pkt);
 const char *h264_nalunit_name(int type);
 static inline bool h264_is_keyframe(int type)
 {
@@ -1287,6 +1434,7 @@ struct list   *baresip_vidcodecl(void);
 struct list   *baresip_vidsrcl(void);
 struct list   *baresip_vidispl(void);
 struct list   *baresip_vidfiltl(void);
+struct vidpool *baresip_vidpool(void);
 struct ui_sub *baresip_uis(void);
 
 
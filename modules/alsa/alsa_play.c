@@ -58,6 +58,8 @@ static void *write_thread(void *arg)
 
 	num_frames = st->prm.srate * st->prm.ptime / 1000;
 
+	(void)realtime_thread_setup(REALTIME_THREAD_AUDIO, "alsa_play");
+
 	while (st->run) {
 		const int samples = num_frames;
 		void *sampv;
@@ -58,6 +58,8 @@ static void *read_thread(void *arg)
 
 	num_frames = st->prm.srate * st->prm.ptime / 1000;
 
+	(void)realtime_thread_setup(REALTIME_THREAD_AUDIO, "alsa_src");
+
 	/* Start */
 	err = snd_pcm_start(st->read);
 	if (err) {
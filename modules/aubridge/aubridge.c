@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 - 2015 Creytiv.com
  */
+#include <stdlib.h>
 #include <re.h>
 #include <baresip.h>
 #include "aubridge.h"
@@ -23,6 +24,24 @@
   audio_player            aubridge,pseudo0
   audio_source            aubridge,pseudo0
  \endverbatim
+ *
+ * A device name of the form "room:leg" joins a conference room instead.
+ * All legs of a room are mixed together, and each leg gets the mix of
+ * all the other legs (N-1). Every room is mixed by its own thread at
+ * 48000 Hz mono, and each leg is resampled once in each direction.
+ *
+ \verbatim
+  audio_player            aubridge,conf1:alice
+  audio_source            aubridge,conf1:alice
+ \endverbatim
+ *
+ * Commands:
+ *
+ \verbatim
+  aubridge_rooms                  List rooms with leg levels and mix load
+  aubridge_gain <room:leg> <dB>   Set the gain of a leg
+  aubridge_bench [legs]           Measure the mixing cost per leg
+ \endverbatim
  */
 
 
@@ -32,6 +51,50 @@ static struct auplay *auplay;
 struct hash *ht_device;
 
 
+static int cmd_gain(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	struct pl dev, db;
+	char device[128];
+	int err;
+
+	if (re_regex(carg->prm, str_len(carg->prm), "[^ ]+ [^ ]+",
+		     &dev, &db))
+		return re_hprintf(pf, "usage: aubridge_gain"
+				  " <room:leg> <dB>\n");
+
+	pl_strcpy(&dev, device, sizeof(device));
+
+	err = room_set_gain(device, pl_float(&db));
+	if (err)
+		return re_hprintf(pf, "aubridge: %s: could not set gain"
+				  " (%m)\n", device, err);
+
+	return 0;
+}
+
+
+static int cmd_bench(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	unsigned legc = 50;
+
+	if (str_isset(carg->prm))
+		legc = atoi(carg->prm);
+
+	return room_bench(pf, legc);
+}
+
+
+static const struct cmd cmdv[] = {
+	{"aubridge_rooms", 0, 0, "List audio bridge rooms", room_debug},
+	{"aubridge_gain", 0, CMD_PRM, "Set room leg gain <room:leg> <dB>",
+		cmd_gain},
+	{"aubridge_bench", 0, CMD_PRM, "Benchmark room mixer [legs]",
+		cmd_bench},
+};
+
+
 static int module_init(void)
 {
 	int err;
@@ -40,9 +103,14 @@ static int module_init(void)
 	if (err)
 		return err;
 
+	err = room_init();
+	if (err)
+		return err;
+
 	err  = ausrc_register(&ausrc, baresip_ausrcl(), "aubridge", src_alloc);
 	err |= auplay_register(&auplay, baresip_auplayl(),
 			       "aubridge", play_alloc);
+	err |= cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
 
 	return err;
 }
@@ -50,10 +118,13 @@ static int module_init(void)
 
 static int module_close(void)
 {
+	cmd_unregister(baresip_commands(), cmdv);
+
 	ausrc  = mem_deref(ausrc);
 	auplay = mem_deref(auplay);
 
 	ht_device = mem_deref(ht_device);
+	room_close();
 
 	return 0;
 }
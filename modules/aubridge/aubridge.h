@@ -6,10 +6,12 @@
 
 
 struct device;
+struct leg;
 
 struct ausrc_st {
 	const struct ausrc *as;      /* inheritance */
 	struct device *dev;
+	struct leg *leg;
 	struct ausrc_prm prm;
 	ausrc_read_h *rh;
 	void *arg;
@@ -18,6 +20,7 @@ struct ausrc_st {
 struct auplay_st {
 	const struct auplay *ap;      /* inheritance */
 	struct device *dev;
+	struct leg *leg;
 	struct auplay_prm prm;
 	auplay_write_h *wh;
 	void *arg;
@@ -39,3 +42,25 @@ int src_alloc(struct ausrc_st **stp, const struct ausrc *as,
 int  device_connect(struct device **devp, const char *device,
 		    struct auplay_st *auplay, struct ausrc_st *ausrc);
 void device_stop(struct device *dev);
+
+
+/* conference rooms */
+bool room_isroom(const char *device);
+int  room_join(struct leg **legp, const char *device,
+	       struct auplay_st *auplay, struct ausrc_st *ausrc);
+void room_leave(struct leg *leg, const struct auplay_st *auplay,
+		const struct ausrc_st *ausrc);
+int  room_set_gain(const char *device, double db);
+int  room_debug(struct re_printf *pf, void *unused);
+int  room_bench(struct re_printf *pf, unsigned legc);
+int  room_init(void);
+void room_close(void);
+
+
+/* mixing kernels */
+enum {MIX_UNITY = 4096};  /* gain 0 dB in Q12 */
+
+void mix_acc(int32_t *acc, const int16_t *v, size_t n);
+void mix_out(int16_t *out, const int32_t *acc, const int16_t *self,
+	     size_t n);
+void mix_gain(int16_t *v, size_t n, int16_t gain);
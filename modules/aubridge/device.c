@@ -62,6 +62,8 @@ static void *device_thread(void *arg)
 	sampc_in = dev->auplay->prm.srate * dev->auplay->prm.ch * PTIME/1000;
 	sampc_out = dev->ausrc->prm.srate * dev->ausrc->prm.ch * PTIME/1000;
 
+	(void)realtime_thread_setup(REALTIME_THREAD_AUDIO, "aubridge");
+
 	auresamp_init(&rs);
 
 	sampv_in  = mem_alloc(2 * sampc_in, NULL);
@@ -0,0 +1,190 @@
+/**
+ * @file aubridge/mix.c Audio bridge -- mixing kernels
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define MIX_NEON 1
+#endif
+#include "aubridge.h"
+
+
+/*
+ * The room sum is accumulated in 32-bit, so that each participant can
+ * get the sum minus its own signal with a single saturation at the end.
+ * The vector paths handle 8 samples per step and the scalar loop does
+ * the tail.
+ */
+
+
+static inline int16_t saturate(int32_t v)
+{
+	if (v > 32767)
+		return 32767;
+	if (v < -32768)
+		return -32768;
+
+	return (int16_t)v;
+}
+
+
+/**
+ * Add a signal to the room sum
+ *
+ * @param acc  Room sum
+ * @param v    Signal to add
+ * @param n    Number of samples
+ */
+void mix_acc(int32_t *acc, const int16_t *v, size_t n)
+{
+	size_t i = 0;
+
+#if defined (__SSE2__)
+	for (; i + 8 <= n; i += 8) {
+		__m128i x  = _mm_loadu_si128((const __m128i *)&v[i]);
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+		__m128i a0 = _mm_loadu_si128((__m128i *)&acc[i]);
+		__m128i a1 = _mm_loadu_si128((__m128i *)&acc[i + 4]);
+
+		_mm_storeu_si128((__m128i *)&acc[i], _mm_add_epi32(a0, lo));
+		_mm_storeu_si128((__m128i *)&acc[i+4], _mm_add_epi32(a1, hi));
+	}
+#elif defined (MIX_NEON)
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t x = vld1q_s16(&v[i]);
+
+		vst1q_s32(&acc[i], vaddw_s16(vld1q_s32(&acc[i]),
+					     vget_low_s16(x)));
+		vst1q_s32(&acc[i + 4], vaddw_s16(vld1q_s32(&acc[i + 4]),
+						 vget_high_s16(x)));
+	}
+#endif
+
+	for (; i < n; i++)
+		acc[i] += v[i];
+}
+
+
+/**
+ * Get the room sum minus one participant (N-1 mix), saturated to 16-bit
+ *
+ * @param out  Output signal
+ * @param acc  Room sum
+ * @param self Signal of the participant, or NULL
+ * @param n    Number of samples
+ */
+void mix_out(int16_t *out, const int32_t *acc, const int16_t *self, size_t n)
+{
+	size_t i = 0;
+
+	if (!self) {
+#if defined (__SSE2__)
+		for (; i + 8 <= n; i += 8) {
+			__m128i a0 = _mm_loadu_si128((const __m128i *)&acc[i]);
+			__m128i a1 = _mm_loadu_si128((const __m128i *)
+						     &acc[i + 4]);
+
+			_mm_storeu_si128((__m128i *)&out[i],
+					 _mm_packs_epi32(a0, a1));
+		}
+#elif defined (MIX_NEON)
+		for (; i + 8 <= n; i += 8) {
+			int32x4_t a0 = vld1q_s32(&acc[i]);
+			int32x4_t a1 = vld1q_s32(&acc[i + 4]);
+
+			vst1q_s16(&out[i], vcombine_s16(vqmovn_s32(a0),
+							vqmovn_s32(a1)));
+		}
+#endif
+		for (; i < n; i++)
+			out[i] = saturate(acc[i]);
+
+		return;
+	}
+
+#if defined (__SSE2__)
+	for (; i + 8 <= n; i += 8) {
+		__m128i x  = _mm_loadu_si128((const __m128i *)&self[i]);
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+		__m128i a0 = _mm_loadu_si128((const __m128i *)&acc[i]);
+		__m128i a1 = _mm_loadu_si128((const __m128i *)&acc[i + 4]);
+
+		_mm_storeu_si128((__m128i *)&out[i],
+				 _mm_packs_epi32(_mm_sub_epi32(a0, lo),
+						 _mm_sub_epi32(a1, hi)));
+	}
+#elif defined (MIX_NEON)
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t x  = vld1q_s16(&self[i]);
+		int32x4_t lo = vsubw_s16(vld1q_s32(&acc[i]), vget_low_s16(x));
+		int32x4_t hi = vsubw_s16(vld1q_s32(&acc[i + 4]),
+					 vget_high_s16(x));
+
+		vst1q_s16(&out[i], vcombine_s16(vqmovn_s32(lo),
+						vqmovn_s32(hi)));
+	}
+#endif
+
+	for (; i < n; i++)
+		out[i] = saturate(acc[i] - self[i]);
+}
+
+
+/**
+ * Scale a signal in place, with saturation
+ *
+ * @param v    Signal
+ * @param n    Number of samples
+ * @param gain Gain in Q12 format (4096 = 0 dB)
+ */
+void mix_gain(int16_t *v, size_t n, int16_t gain)
+{
+	size_t i = 0;
+
+	if (gain == MIX_UNITY)
+		return;
+
+#if defined (__SSE2__)
+	{
+		const __m128i g = _mm_set1_epi16(gain);
+
+		for (; i + 8 <= n; i += 8) {
+			__m128i x  = _mm_loadu_si128((__m128i *)&v[i]);
+			__m128i pl = _mm_mullo_epi16(x, g);
+			__m128i ph = _mm_mulhi_epi16(x, g);
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(pl, ph),
+						    12);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(pl, ph),
+						    12);
+
+			_mm_storeu_si128((__m128i *)&v[i],
+					 _mm_packs_epi32(lo, hi));
+		}
+	}
+#elif defined (MIX_NEON)
+	{
+		const int16x4_t g = vdup_n_s16(gain);
+
+		for (; i + 8 <= n; i += 8) {
+			int16x8_t x  = vld1q_s16(&v[i]);
+			int32x4_t lo = vmull_s16(vget_low_s16(x), g);
+			int32x4_t hi = vmull_s16(vget_high_s16(x), g);
+
+			vst1q_s16(&v[i],
+				  vcombine_s16(vqshrn_n_s32(lo, 12),
+					       vqshrn_n_s32(hi, 12)));
+		}
+	}
+#endif
+
+	for (; i < n; i++)
+		v[i] = saturate(((int32_t)v[i] * gain) >> 12);
+}
@@ -5,7 +5,7 @@
 #
 
 MOD		:= aubridge
-$(MOD)_SRCS	+= aubridge.c device.c src.c play.c
+$(MOD)_SRCS	+= aubridge.c device.c src.c play.c mix.c room.c
 $(MOD)_LFLAGS	+=
 
 include mk/mod.mk
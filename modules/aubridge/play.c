@@ -13,6 +13,8 @@ static void auplay_destructor(void *arg)
 {
 	struct auplay_st *st = arg;
 
+	room_leave(st->leg, st, NULL);
+
 	device_stop(st->dev);
 
 	mem_deref(st->dev);
@@ -44,7 +46,10 @@ int play_alloc(struct auplay_st **stp, const struct auplay *ap,
 	st->wh  = wh;
 	st->arg = arg;
 
-	err = device_connect(&st->dev, device, st, NULL);
+	if (room_isroom(device))
+		err = room_join(&st->leg, device, st, NULL);
+	else
+		err = device_connect(&st->dev, device, st, NULL);
 	if (err)
 		goto out;
 
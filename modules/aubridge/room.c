@@ -0,0 +1,608 @@
+/**
+ * @file aubridge/room.c Audio bridge -- conference rooms
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "aubridge.h"
+
+
+/*
+ * A room is a device named "room:leg". All legs of a room are mixed by
+ * one thread per room, at a fixed internal rate. For each leg, the audio
+ * written to its player is resampled once to the room rate, and the mix
+ * of all other legs is resampled once to the rate of its source.
+ */
+
+
+enum {
+	PTIME       = 20,
+	ROOM_SRATE  = 48000,
+	ROOM_SAMPC  = ROOM_SRATE * PTIME / 1000,
+	LEG_SAMPC   = 48000 * 2 * PTIME / 1000,   /* max leg frame */
+};
+
+
+struct leg {
+	struct le le;
+	struct room *room;
+	char name[32];
+	const struct auplay_st *auplay;  /**< Audio from the call       */
+	const struct ausrc_st *ausrc;    /**< Audio to the call         */
+	struct auresamp rs_in;           /**< Leg rate -> room rate     */
+	struct auresamp rs_out;          /**< Room rate -> leg rate     */
+	int16_t in[ROOM_SAMPC];          /**< Input at room rate        */
+	int16_t buf[LEG_SAMPC];          /**< Scratch at leg rate       */
+	int16_t gain;                    /**< Gain in Q12               */
+	double level;                    /**< Input level in [dBov]     */
+	bool has_in;                     /**< in[] is valid this tick   */
+};
+
+struct room {
+	struct le le;
+	struct list legl;
+	char name[64];
+	pthread_mutex_t mutex;
+	pthread_t thread;
+	volatile bool run;
+	int32_t acc[ROOM_SAMPC];         /**< Sum of all legs           */
+	int16_t out[ROOM_SAMPC];         /**< N-1 mix at room rate      */
+
+	struct {
+		uint64_t ticks;
+		uint64_t busy_ns;
+		uint64_t leg_ticks;      /**< Sum of legs over ticks    */
+	} stats;
+};
+
+
+static struct hash *ht_room;
+
+
+static uint64_t now_ns(void)
+{
+	return tmr_jiffies_usec() * 1000;
+}
+
+
+static bool room_cmp_handler(struct le *le, void *arg)
+{
+	struct room *room = le->data;
+
+	return 0 == str_cmp(room->name, arg);
+}
+
+
+static struct room *room_find(const char *name)
+{
+	return list_ledata(hash_lookup(ht_room, hash_joaat_str(name),
+				       room_cmp_handler, (void *)name));
+}
+
+
+static void leg_input(struct leg *leg)
+{
+	const struct auplay_st *ap = leg->auplay;
+	size_t sampc = ap->prm.srate * ap->prm.ch * PTIME / 1000;
+	size_t sampc_rs = ROOM_SAMPC;
+	int err;
+
+	sampc = min(sampc, ARRAY_SIZE(leg->buf));
+
+	ap->wh(leg->buf, sampc, ap->arg);
+
+	if (leg->rs_in.resample) {
+		err = auresamp(&leg->rs_in, leg->in, &sampc_rs,
+			       leg->buf, sampc);
+		if (err || sampc_rs != ROOM_SAMPC)
+			return;
+	}
+	else if (sampc == ROOM_SAMPC) {
+		memcpy(leg->in, leg->buf, sizeof(leg->in));
+	}
+	else {
+		return;
+	}
+
+	mix_gain(leg->in, ROOM_SAMPC, leg->gain);
+
+	leg->level  = aulevel_calc_dbov(leg->in, ROOM_SAMPC);
+	leg->has_in = true;
+}
+
+
+static void leg_output(struct leg *leg, const int16_t *mix)
+{
+	const struct ausrc_st *as = leg->ausrc;
+	size_t sampc = ARRAY_SIZE(leg->buf);
+	int err;
+
+	if (leg->rs_out.resample) {
+		err = auresamp(&leg->rs_out, leg->buf, &sampc,
+			       mix, ROOM_SAMPC);
+		if (err)
+			return;
+
+		as->rh(leg->buf, sampc, as->arg);
+	}
+	else {
+		as->rh(mix, ROOM_SAMPC, as->arg);
+	}
+}
+
+
+/**
+ * Mix one packet-time of audio for all legs of a room
+ *
+ * @param room Conference room
+ *
+ * @note Must be called with the room mutex held
+ */
+static void room_mix(struct room *room)
+{
+	struct le *le;
+	unsigned legc = 0;
+
+	memset(room->acc, 0, sizeof(room->acc));
+
+	for (le = room->legl.head; le; le = le->next) {
+		struct leg *leg = le->data;
+
+		leg->has_in = false;
+
+		if (leg->auplay && leg->auplay->wh)
+			leg_input(leg);
+
+		if (leg->has_in)
+			mix_acc(room->acc, leg->in, ROOM_SAMPC);
+
+		++legc;
+	}
+
+	for (le = room->legl.head; le; le = le->next) {
+		struct leg *leg = le->data;
+
+		if (!leg->ausrc || !leg->ausrc->rh)
+			continue;
+
+		mix_out(room->out, room->acc,
+			leg->has_in ? leg->in : NULL, ROOM_SAMPC);
+
+		leg_output(leg, room->out);
+	}
+
+	room->stats.leg_ticks += legc;
+}
+
+
+static void *room_thread(void *arg)
+{
+	uint64_t now, ts = tmr_jiffies();
+	struct room *room = arg;
+
+	(void)realtime_thread_setup(REALTIME_THREAD_AUDIO, "aubridge-room");
+
+	while (room->run) {
+
+		uint64_t t0;
+
+		(void)sys_msleep(4);
+
+		if (!room->run)
+			break;
+
+		now = tmr_jiffies();
+
+		if (ts > now)
+			continue;
+
+		pthread_mutex_lock(&room->mutex);
+
+		t0 = now_ns();
+		room_mix(room);
+		room->stats.busy_ns += now_ns() - t0;
+		++room->stats.ticks;
+
+		pthread_mutex_unlock(&room->mutex);
+
+		ts += PTIME;
+	}
+
+	return NULL;
+}
+
+
+static void room_destructor(void *arg)
+{
+	struct room *room = arg;
+
+	if (room->run) {
+		room->run = false;
+		pthread_join(room->thread, NULL);
+	}
+
+	list_unlink(&room->le);
+	pthread_mutex_destroy(&room->mutex);
+
+	info("aubridge: room '%s' closed\n", room->name);
+}
+
+
+static int room_alloc(struct room **roomp, const struct pl *name)
+{
+	struct room *room;
+	int err;
+
+	room = mem_zalloc(sizeof(*room), room_destructor);
+	if (!room)
+		return ENOMEM;
+
+	pl_strcpy(name, room->name, sizeof(room->name));
+
+	err = pthread_mutex_init(&room->mutex, NULL);
+	if (err) {
+		mem_deref(room);
+		return err;
+	}
+
+	hash_append(ht_room, hash_joaat_str(room->name), &room->le, room);
+
+	room->run = true;
+	err = pthread_create(&room->thread, NULL, room_thread, room);
+	if (err) {
+		room->run = false;
+		mem_deref(room);
+		return err;
+	}
+
+	info("aubridge: room '%s' created\n", room->name);
+
+	*roomp = room;
+
+	return 0;
+}
+
+
+static void leg_destructor(void *arg)
+{
+	struct leg *leg = arg;
+	struct room *room = leg->room;
+
+	pthread_mutex_lock(&room->mutex);
+	list_unlink(&leg->le);
+	pthread_mutex_unlock(&room->mutex);
+
+	mem_deref(room);
+}
+
+
+static struct leg *leg_find(const struct room *room, const struct pl *name)
+{
+	struct le *le;
+
+	for (le = room->legl.head; le; le = le->next) {
+		struct leg *leg = le->data;
+
+		if (0 == pl_strcmp(name, leg->name))
+			return leg;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Check if a device name refers to a conference room
+ *
+ * @param device Device name
+ *
+ * @return True for "room:leg", otherwise false
+ */
+bool room_isroom(const char *device)
+{
+	return device && NULL != strchr(device, ':');
+}
+
+
+/**
+ * Join a conference room with an audio player and/or source
+ *
+ * @param legp   Pointer to referenced leg
+ * @param device Device name, "room:leg"
+ * @param auplay Audio player of the call, the input to the room
+ * @param ausrc  Audio source of the call, gets the mix of the others
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int room_join(struct leg **legp, const char *device,
+	      struct auplay_st *auplay, struct ausrc_st *ausrc)
+{
+	struct pl pl_room, pl_leg;
+	struct room *room, *unref = NULL;
+	struct leg *leg;
+	char name[64];
+	int err = 0;
+
+	if (!legp || !ht_room)
+		return EINVAL;
+
+	if (re_regex(device, str_len(device), "[^:]+:[^]+",
+		     &pl_room, &pl_leg))
+		return ENODEV;
+
+	pl_strcpy(&pl_room, name, sizeof(name));
+
+	room = room_find(name);
+	if (room) {
+		mem_ref(room);
+	}
+	else {
+		err = room_alloc(&room, &pl_room);
+		if (err)
+			return err;
+	}
+
+	pthread_mutex_lock(&room->mutex);
+
+	/* each leg holds one reference to the room */
+	leg = leg_find(room, &pl_leg);
+	if (leg) {
+		mem_ref(leg);
+		unref = room;
+	}
+	else {
+		leg = mem_zalloc(sizeof(*leg), leg_destructor);
+		if (!leg) {
+			err = ENOMEM;
+			unref = room;
+			goto out;
+		}
+
+		leg->room  = room;
+		leg->gain  = MIX_UNITY;
+		leg->level = -96.0;
+		auresamp_init(&leg->rs_in);
+		auresamp_init(&leg->rs_out);
+		pl_strcpy(&pl_leg, leg->name, sizeof(leg->name));
+
+		list_append(&room->legl, &leg->le, leg);
+	}
+
+	if (auplay) {
+		err = auresamp_setup(&leg->rs_in,
+				     auplay->prm.srate, auplay->prm.ch,
+				     ROOM_SRATE, 1);
+		if (err)
+			goto out;
+
+		leg->auplay = auplay;
+	}
+	if (ausrc) {
+		err = auresamp_setup(&leg->rs_out,
+				     ROOM_SRATE, 1,
+				     ausrc->prm.srate, ausrc->prm.ch);
+		if (err)
+			goto out;
+
+		leg->ausrc = ausrc;
+	}
+
+ out:
+	pthread_mutex_unlock(&room->mutex);
+
+	mem_deref(unref);
+
+	if (err) {
+		warning("aubridge: %s: could not join room (%m)\n",
+			device, err);
+		mem_deref(leg);
+	}
+	else {
+		*legp = leg;
+	}
+
+	return err;
+}
+
+
+/**
+ * Leave a conference room
+ *
+ * @param leg    Conference leg
+ * @param auplay Audio player to detach (optional)
+ * @param ausrc  Audio source to detach (optional)
+ */
+void room_leave(struct leg *leg, const struct auplay_st *auplay,
+		const struct ausrc_st *ausrc)
+{
+	struct room *room;
+
+	if (!leg)
+		return;
+
+	room = leg->room;
+
+	pthread_mutex_lock(&room->mutex);
+
+	if (auplay && leg->auplay == auplay)
+		leg->auplay = NULL;
+	if (ausrc && leg->ausrc == ausrc)
+		leg->ausrc = NULL;
+
+	pthread_mutex_unlock(&room->mutex);
+
+	mem_deref(leg);
+}
+
+
+/**
+ * Set the gain of a conference leg
+ *
+ * @param device Device name, "room:leg"
+ * @param db     Gain in [dB], -inf to +12 dB
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int room_set_gain(const char *device, double db)
+{
+	struct pl pl_room, pl_leg;
+	struct room *room;
+	struct leg *leg;
+	char name[64];
+	double g;
+
+	if (re_regex(device, str_len(device), "[^:]+:[^]+",
+		     &pl_room, &pl_leg))
+		return EINVAL;
+
+	pl_strcpy(&pl_room, name, sizeof(name));
+
+	room = room_find(name);
+	if (!room)
+		return ENOENT;
+
+	g = pow(10.0, db / 20.0) * MIX_UNITY;
+	if (g > 32767)
+		return ERANGE;
+
+	pthread_mutex_lock(&room->mutex);
+
+	leg = leg_find(room, &pl_leg);
+	if (leg)
+		leg->gain = (int16_t)(g + 0.5);
+
+	pthread_mutex_unlock(&room->mutex);
+
+	return leg ? 0 : ENOENT;
+}
+
+
+static bool room_debug_handler(struct le *le, void *arg)
+{
+	struct room *room = le->data;
+	struct re_printf *pf = arg;
+	struct le *lle;
+
+	pthread_mutex_lock(&room->mutex);
+
+	(void)re_hprintf(pf, "room '%s': %u legs, mix %.1f us/tick"
+			 " (%.1f us/leg)\n",
+			 room->name, list_count(&room->legl),
+			 room->stats.ticks ?
+			 room->stats.busy_ns / 1000.0 / room->stats.ticks : 0,
+			 room->stats.leg_ticks ?
+			 room->stats.busy_ns / 1000.0 / room->stats.leg_ticks
+			 : 0);
+
+	for (lle = room->legl.head; lle; lle = lle->next) {
+		const struct leg *leg = lle->data;
+
+		(void)re_hprintf(pf, "  %-16s %s%s level %6.1f dBov,"
+				 " gain %+.1f dB\n",
+				 leg->name,
+				 leg->auplay ? "in " : "   ",
+				 leg->ausrc ? "out" : "   ",
+				 leg->level,
+				 20 * log10((double)leg->gain / MIX_UNITY));
+	}
+
+	pthread_mutex_unlock(&room->mutex);
+
+	return false;
+}
+
+
+int room_debug(struct re_printf *pf, void *unused)
+{
+	(void)unused;
+
+	if (!ht_room)
+		return 0;
+
+	hash_apply(ht_room, room_debug_handler, pf);
+
+	return 0;
+}
+
+
+/**
+ * Measure the mixing cost per participant, without audio devices
+ *
+ * @param pf   Print function for the result
+ * @param legc Number of participants
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int room_bench(struct re_printf *pf, unsigned legc)
+{
+	const unsigned iter = 1000;
+	int16_t *inv, *out;
+	int32_t *acc;
+	uint64_t t0, t1;
+	unsigned i, j;
+	int err = 0;
+
+	if (!legc)
+		return EINVAL;
+
+	inv = mem_alloc(legc * ROOM_SAMPC * sizeof(*inv), NULL);
+	out = mem_alloc(ROOM_SAMPC * sizeof(*out), NULL);
+	acc = mem_alloc(ROOM_SAMPC * sizeof(*acc), NULL);
+	if (!inv || !out || !acc) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i=0; i<legc * ROOM_SAMPC; i++)
+		inv[i] = (int16_t)rand_u16() / 4;
+
+	t0 = tmr_jiffies_usec();
+
+	for (i=0; i<iter; i++) {
+
+		memset(acc, 0, ROOM_SAMPC * sizeof(*acc));
+
+		for (j=0; j<legc; j++) {
+			int16_t *v = &inv[j * ROOM_SAMPC];
+
+			mix_gain(v, ROOM_SAMPC, MIX_UNITY - 1);
+			mix_acc(acc, v, ROOM_SAMPC);
+		}
+
+		for (j=0; j<legc; j++)
+			mix_out(out, acc, &inv[j * ROOM_SAMPC], ROOM_SAMPC);
+	}
+
+	t1 = tmr_jiffies_usec();
+
+	err = re_hprintf(pf, "aubridge: %u legs, %u Hz, %u ms:"
+			 " %.3f us/tick, %.1f ns/leg (%.2f%% of one core)\n",
+			 legc, ROOM_SRATE, PTIME,
+			 (double)(t1 - t0) / iter,
+			 (t1 - t0) * 1000.0 / iter / legc,
+			 (t1 - t0) / 10.0 / iter / PTIME);
+
+ out:
+	mem_deref(acc);
+	mem_deref(out);
+	mem_deref(inv);
+
+	return err;
+}
+
+
+int room_init(void)
+{
+	return hash_alloc(&ht_room, 16);
+}
+
+
+void room_close(void)
+{
+	ht_room = mem_deref(ht_room);
+}
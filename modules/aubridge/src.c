@@ -13,6 +13,8 @@ static void ausrc_destructor(void *arg)
 {
 	struct ausrc_st *st = arg;
 
+	room_leave(st->leg, NULL, st);
+
 	device_stop(st->dev);
 
 	mem_deref(st->dev);
@@ -47,7 +49,10 @@ int src_alloc(struct ausrc_st **stp, const struct ausrc *as,
 	st->rh   = rh;
 	st->arg  = arg;
 
-	err = device_connect(&st->dev, device, NULL, st);
+	if (room_isroom(device))
+		err = room_join(&st->leg, device, NULL, st);
+	else
+		err = device_connect(&st->dev, device, NULL, st);
 	if (err)
 		goto out;
 
@@ -15,16 +15,29 @@
  * @defgroup aufile aufile
  *
  * Audio module for using a WAV-file as audio input
+ *
+ * The file is decoded incrementally from the main loop, about one
+ * second ahead of the playback thread.
  */
 
 
+enum {
+	READ_AHEAD = 1000,  /**< Audio decoded ahead in [ms]   */
+	REFILL     = 100,   /**< Refill interval in [ms]       */
+	CHUNK      = 4096,  /**< Bytes per aufile_read()       */
+};
+
+
 struct ausrc_st {
 	const struct ausrc *as;  /* base class */
 	struct tmr tmr;
+	struct tmr tmr_fill;
 	struct aufile *aufile;
 	struct aubuf *aubuf;
+	size_t ahead;            /**< Wanted aubuf level [bytes] */
 	uint32_t ptime;
 	size_t sampc;
+	bool eof;
 	bool run;
 	pthread_t thread;
 	ausrc_read_h *rh;
@@ -46,6 +59,7 @@ static void destructor(void *arg)
 	}
 
 	tmr_cancel(&st->tmr);
+	tmr_cancel(&st->tmr_fill);
 
 	mem_deref(st->aufile);
 	mem_deref(st->aubuf);
@@ -62,6 +76,8 @@ static void *play_thread(void *arg)
 	if (!sampv)
 		return NULL;
 
+	(void)realtime_thread_setup(REALTIME_THREAD_AUDIO, "aufile");
+
 	while (st->run) {
 
 		sys_msleep(4);
@@ -100,7 +116,7 @@ static void timeout(void *arg)
 	tmr_start(&st->tmr, 1000, timeout, st);
 
 	/* check if audio buffer is empty */
-	if (aubuf_cur_size(st->aubuf) < (2 * st->sampc)) {
+	if (st->eof && aubuf_cur_size(st->aubuf) < (2 * st->sampc)) {
 
 		info("aufile: end of file\n");
 
@@ -113,14 +129,14 @@ static void timeout(void *arg)
 
 static int read_file(struct ausrc_st *st)
 {
-	struct mbuf *mb;
-	int err;
+	struct mbuf *mb = NULL;
+	int err = 0;
 
-	for (;;) {
+	while (!st->eof && aubuf_cur_size(st->aubuf) < st->ahead) {
 		uint16_t *sampv;
 		size_t i;
 
-		mb = mbuf_alloc(4096);
+		mb = mbuf_alloc(CHUNK);
 		if (!mb)
 			return ENOMEM;
 
@@ -132,6 +148,7 @@ static int read_file(struct ausrc_st *st)
 
 		if (mb->end == 0) {
 			info("aufile: end of file\n");
+			st->eof = true;
 			break;
 		}
 
@@ -146,13 +163,28 @@ static int read_file(struct ausrc_st *st)
 		mb = mem_deref(mb);
 	}
 
-	info("aufile: loaded %zu bytes\n", aubuf_cur_size(st->aubuf));
-
 	mem_deref(mb);
 	return err;
 }
 
 
+static void refill(void *arg)
+{
+	struct ausrc_st *st = arg;
+	int err;
+
+	err = read_file(st);
+	if (err) {
+		warning("aufile: read error (%m)\n", err);
+		st->eof = true;
+		return;
+	}
+
+	if (!st->eof)
+		tmr_start(&st->tmr_fill, REFILL, refill, st);
+}
+
+
 static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 			 struct media_ctx **ctx,
 			 struct ausrc_prm *prm, const char *dev,
@@ -214,15 +246,12 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 
 	st->ptime = prm->ptime;
 
-	info("aufile: audio ptime=%u sampc=%zu aubuf=[%u:%u]\n",
-	     st->ptime, st->sampc,
-	     prm->srate * prm->ch * 2,
-	     prm->srate * prm->ch * 40);
+	st->ahead = prm->srate * prm->ch * 2 * READ_AHEAD / 1000;
+
+	info("aufile: audio ptime=%u sampc=%zu read-ahead=%zu bytes\n",
+	     st->ptime, st->sampc, st->ahead);
 
-	/* 1 - inf seconds of audio */
-	err = aubuf_alloc(&st->aubuf,
-			  prm->srate * prm->ch * 2,
-			  0);
+	err = aubuf_alloc(&st->aubuf, 0, 0);
 	if (err)
 		goto out;
 
@@ -231,6 +260,8 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 		goto out;
 
 	tmr_start(&st->tmr, 1000, timeout, st);
+	if (!st->eof)
+		tmr_start(&st->tmr_fill, REFILL, refill, st);
 
 	st->run = true;
 	err = pthread_create(&st->thread, NULL, play_thread, st);
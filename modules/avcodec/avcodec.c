@@ -34,8 +34,17 @@
  \verbatim
       avcodec_h264enc  <NAME>  ; e.g. h264_nvenc, h264_videotoolbox
       avcodec_h264dec  <NAME>  ; e.g. h264_cuvid, h264_vda, h264_qsv
+      avcodec_threads  <N>     ; encoder threads, 0 is one per core
+      avcodec_thread_type  slice|frame  ; encoder threading (slice)
+      avcodec_latency  <MS>    ; max delay added by frame threads (100)
  \endverbatim
  *
+ * Slice threads split every frame and do not delay the output. Frame
+ * threads have better throughput, but each extra thread delays the
+ * encoded output by one frame. Their number is limited so that the
+ * delay stays within avcodec_latency. If the budget is shorter than
+ * one frame interval, slice threads are used instead.
+ *
  * References:
  *
  *     http://ffmpeg.org
@@ -50,6 +59,9 @@
 const uint8_t h264_level_idc = 0x1f;
 AVCodec *avcodec_h264enc;             /* optional; specified H.264 encoder */
 AVCodec *avcodec_h264dec;             /* optional; specified H.264 decoder */
+uint32_t avcodec_threads;             /* encoder threads, 0 = auto       */
+bool avcodec_frame_threads;           /* frame- instead of slice-threads */
+uint32_t avcodec_latency = 100;       /* frame-thread delay budget [ms]  */
 
 
 int avcodec_resolve_codecid(const char *s)
@@ -186,6 +198,7 @@ static int module_init(void)
 	struct list *vidcodecl = baresip_vidcodecl();
 	char h264enc[64];
 	char h264dec[64];
+	char thread_type[16];
 
 #ifdef USE_X264
 	debug("avcodec: x264 build %d\n", X264_BUILD);
@@ -238,6 +251,24 @@ static int module_init(void)
 		}
 	}
 
+	(void)conf_get_u32(conf_cur(), "avcodec_threads", &avcodec_threads);
+	(void)conf_get_u32(conf_cur(), "avcodec_latency", &avcodec_latency);
+
+	if (0 == conf_get_str(conf_cur(), "avcodec_thread_type",
+			      thread_type, sizeof(thread_type))) {
+
+		if (0 == str_casecmp(thread_type, "frame"))
+			avcodec_frame_threads = true;
+		else if (0 == str_casecmp(thread_type, "slice"))
+			avcodec_frame_threads = false;
+		else {
+			/* the codecs are registered already */
+			warning("avcodec: unknown thread type '%s',"
+				" using slice\n", thread_type);
+			avcodec_frame_threads = false;
+		}
+	}
+
 	return 0;
 }
 
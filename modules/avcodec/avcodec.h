@@ -27,6 +27,9 @@
 extern const uint8_t h264_level_idc;
 extern AVCodec *avcodec_h264enc;
 extern AVCodec *avcodec_h264dec;
+extern uint32_t avcodec_threads;
+extern bool avcodec_frame_threads;
+extern uint32_t avcodec_latency;
 
 
 /*
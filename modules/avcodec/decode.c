@@ -16,6 +16,11 @@
 #include "avcodec.h"
 
 
+#ifndef AV_CODEC_CAP_DR1
+#define AV_CODEC_CAP_DR1 CODEC_CAP_DR1
+#endif
+
+
 enum {
 	DECODE_MAXSZ = 524288,
 };
@@ -73,6 +78,78 @@ static void destructor(void *arg)
 }
 
 
+#if LIBAVCODEC_VERSION_INT >= ((55<<16)+(0<<8)+100)
+static void buffer_free(void *opaque, uint8_t *data)
+{
+	(void)data;
+
+	mem_deref(opaque);
+}
+
+
+/*
+ * Decode into frames from the core video frame pool, so that pictures
+ * are not allocated while decoding, once the pool has enough frames.
+ */
+static int get_buffer2(AVCodecContext *ctx, AVFrame *pic, int flags)
+{
+	int linesize_align[AV_NUM_DATA_POINTERS];
+	int w = pic->width, h = pic->height;
+	struct vidframe *vf = NULL;
+	struct vidsz size;
+	enum vidfmt fmt;
+	int i, err;
+
+	if (!(ctx->codec->capabilities & AV_CODEC_CAP_DR1))
+		return avcodec_default_get_buffer2(ctx, pic, flags);
+
+	switch (pic->format) {
+
+	case AV_PIX_FMT_YUV420P:
+	case AV_PIX_FMT_YUVJ420P:
+		fmt = VID_FMT_YUV420P;
+		break;
+
+	case AV_PIX_FMT_NV12:
+		fmt = VID_FMT_NV12;
+		break;
+
+	case AV_PIX_FMT_YUV444P:
+		fmt = VID_FMT_YUV444P;
+		break;
+
+	default:
+		return avcodec_default_get_buffer2(ctx, pic, flags);
+	}
+
+	avcodec_align_dimensions2(ctx, &w, &h, linesize_align);
+
+	/* keep the lines of the chroma planes aligned as well */
+	size.w = (w + 127) & ~127;
+	size.h = (h + 1) & ~1;
+
+	err = vidpool_get(baresip_vidpool(), &vf, fmt, &size);
+	if (err)
+		return AVERROR(err);
+
+	for (i=0; i<4; i++) {
+		pic->data[i]     = vf->data[i];
+		pic->linesize[i] = vf->linesize[i];
+	}
+	pic->extended_data = pic->data;
+
+	pic->buf[0] = av_buffer_create(vf->data[0], vidframe_size(fmt, &size),
+				       buffer_free, vf, 0);
+	if (!pic->buf[0]) {
+		mem_deref(vf);
+		return AVERROR(ENOMEM);
+	}
+
+	return 0;
+}
+#endif
+
+
 static int init_decoder(struct viddec_state *st, const char *name)
 {
 	enum AVCodecID codec_id;
@@ -109,6 +186,12 @@ static int init_decoder(struct viddec_state *st, const char *name)
 	if (!st->ctx || !st->pict)
 		return ENOMEM;
 
+#if LIBAVCODEC_VERSION_INT >= ((55<<16)+(0<<8)+100)
+	/* without the pool the frames would not be aligned */
+	if (baresip_vidpool())
+		st->ctx->get_buffer2 = get_buffer2;
+#endif
+
 #if LIBAVCODEC_VERSION_INT >= ((53<<16)+(8<<8)+0)
 	if (avcodec_open2(st->ctx, st->codec, NULL) < 0)
 		return ENOENT;
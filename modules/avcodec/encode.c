@@ -8,6 +8,7 @@
 #include <baresip.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/mem.h>
+#include <libavutil/cpu.h>
 #if LIBAVUTIL_VERSION_INT >= ((50<<16)+(29<<8)+0)
 #include <libavutil/opt.h>
 #else
@@ -27,6 +28,7 @@
 
 enum {
 	DEFAULT_GOP_SIZE =   25,//by aphero
+	MAX_THREADS      =   16,
 };
 
 
@@ -165,11 +167,43 @@ static int init_encoder(struct videnc_state *st)
 }
 
 
+/*
+ * Get the number of encoder threads. Each extra frame thread delays
+ * the output by one frame, so they are limited by the latency budget.
+ */
+static int encoder_threads(const struct videnc_param *prm, bool *frame)
+{
+	int n, nmax;
+
+	n = avcodec_threads ? (int)avcodec_threads : av_cpu_count();
+	n = min(max(n, 1), MAX_THREADS);
+
+	*frame = false;
+
+	if (!avcodec_frame_threads || n < 2)
+		return n;
+
+	nmax = 1 + (int)(avcodec_latency * prm->fps / 1000.0);
+	if (nmax < 2) {
+		warning("avcodec: latency budget of %u ms is less than"
+			" one frame at %.1f fps, using slice threads\n",
+			avcodec_latency, prm->fps);
+		return n;
+	}
+
+	*frame = true;
+
+	return min(n, nmax);
+}
+
+
 static int open_encoder(struct videnc_state *st,
 			const struct videnc_param *prm,
 			const struct vidsz *size,
 			int pix_fmt)
 {
+	bool frame_threads;
+	int threads;
 	int err = 0;
 
 	if (st->ctx) {
@@ -217,9 +251,12 @@ static int open_encoder(struct videnc_state *st,
 	st->ctx->time_base.num = 1;
 	st->ctx->time_base.den = prm->fps;
 
+	threads = encoder_threads(prm, &frame_threads);
+
+	st->ctx->thread_count = threads;
+	st->ctx->thread_type  = frame_threads ? FF_THREAD_FRAME
+					      : FF_THREAD_SLICE;
 
-	st->ctx->thread_count = 1;//by aphero
-	
 	/* params to avoid libavcodec/x264 default preset error */
 	if (st->codec_id == AV_CODEC_ID_H264) {
 
@@ -307,9 +344,15 @@ st->ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;//by aphero,添加后ffmpeg会将s
 			st->pict = NULL;
 		}
 	}
-	else
+	else {
 		st->encsize = *size;
 
+		info("avcodec: %s encoder %u x %u: %d %s thread%s\n",
+		     st->codec->name, size->w, size->h, threads,
+		     frame_threads ? "frame" : "slice",
+		     threads == 1 ? "" : "s");
+	}
+
 	return err;
 }
 
@@ -437,6 +480,8 @@ static int open_encoder_x264(struct videnc_state *st, struct videnc_param *prm,
 			     const struct vidsz *size, int csp)
 {
 	x264_param_t xprm;
+	bool frame_threads;
+	int threads;
 
 	if (x264_param_default_preset(&xprm, "ultrafast", "zerolatency"))
 		return ENOSYS;
@@ -470,11 +515,16 @@ static int open_encoder_x264(struct videnc_state *st, struct videnc_param *prm,
 	xprm.i_bframe_adaptive = X264_B_ADAPT_NONE;
 	xprm.rc.b_mb_tree = 0;
 
-	/* slice-based threading (--tune=zerolatency) */
+	/* no lookahead (--tune=zerolatency) */
 	xprm.rc.i_lookahead = 0;
 	xprm.i_sync_lookahead = 0;
 	xprm.i_bframe = 0;
 
+	threads = encoder_threads(prm, &frame_threads);
+
+	xprm.i_threads = threads;
+	xprm.b_sliced_threads = !frame_threads;
+
 	/* put SPS/PPS before each keyframe */
 	xprm.b_repeat_headers = 1;
 
@@ -492,6 +542,10 @@ static int open_encoder_x264(struct videnc_state *st, struct videnc_param *prm,
 
 	st->encsize = *size;
 
+	info("avcodec: x264 encoder %u x %u: %d %s thread%s\n",
+	     size->w, size->h, threads, frame_threads ? "frame" : "slice",
+	     threads == 1 ? "" : "s");
+
 	return 0;
 }
 #endif
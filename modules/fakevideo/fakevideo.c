@@ -65,6 +65,8 @@ static void *read_thread(void *arg)
 {
 	struct vidsrc_st *st = arg;
 
+	(void)realtime_thread_setup(REALTIME_THREAD_VIDEO, "fakevideo");
+
 	st->ts = tmr_jiffies_usec();
 
 	while (st->run) {
@@ -4,18 +4,40 @@
  * Copyright (C) 2010 - 2015 Creytiv.com
  */
 
+#include <stdlib.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
+#include "g711.h"
 
 
 /**
  * @defgroup g711 g711
  *
  * The G.711 audio codec
+ *
+ * Samples are converted in blocks by a vectorized kernel (SSE2, AVX2
+ * or NEON) when available. At load time every kernel is checked to be
+ * bit-exact against the scalar reference for all input values, and the
+ * fastest one that passes is used.
+ *
+ * Configuration options:
+ *
+ \verbatim
+  g711_kernel {auto,scalar,sse2,avx2,neon}  ; Block kernel, default auto
+ \endverbatim
+ *
+ * Commands:
+ *
+ \verbatim
+  g711_bench [samples]   Compare the kernels on blocks of samples
+ \endverbatim
  */
 
 
+static const struct g711_kernel *kern;
+
+
 static int pcmu_encode(struct auenc_state *aes, uint8_t *buf,
 		       size_t *len, int fmt, const void *sampv, size_t sampc)
 {
@@ -34,8 +56,7 @@ static int pcmu_encode(struct auenc_state *aes, uint8_t *buf,
 
 	*len = sampc;
 
-	while (sampc--)
-		*buf++ = g711_pcm2ulaw(*p++);
+	kern->enc_ulaw(buf, p, sampc);
 
 	return 0;
 }
@@ -59,8 +80,7 @@ static int pcmu_decode(struct audec_state *ads, int fmt, void *sampv,
 
 	*sampc = len;
 
-	while (len--)
-		*p++ = g711_ulaw2pcm(*buf++);
+	kern->dec_ulaw(p, buf, len);
 
 	return 0;
 }
@@ -84,8 +104,7 @@ static int pcma_encode(struct auenc_state *aes, uint8_t *buf,
 
 	*len = sampc;
 
-	while (sampc--)
-		*buf++ = g711_pcm2alaw(*p++);
+	kern->enc_alaw(buf, p, sampc);
 
 	return 0;
 }
@@ -109,8 +128,7 @@ static int pcma_decode(struct audec_state *ads, int fmt, void *sampv,
 
 	*sampc = len;
 
-	while (len--)
-		*p++ = g711_alaw2pcm(*buf++);
+	kern->dec_alaw(p, buf, len);
 
 	return 0;
 }
@@ -127,17 +145,135 @@ static struct aucodec pcma = {
 };
 
 
+static void kernel_select(const char *name)
+{
+	const struct g711_kernel *k;
+	unsigned i;
+
+	kern = g711_kernel_get(0);
+
+	/* the kernels are in order of preference */
+	for (i = g711_kernel_count(); i-- > 1;) {
+
+		k = g711_kernel_get(i);
+		if (!k)
+			continue;
+
+		if (str_isset(name) && str_casecmp(name, "auto") &&
+		    str_casecmp(name, k->name))
+			continue;
+
+		if (g711_kernel_check(k)) {
+			warning("g711: %s kernel is not bit-exact,"
+				" disabled\n", k->name);
+			continue;
+		}
+
+		kern = k;
+		break;
+	}
+
+	if (str_isset(name) && str_casecmp(name, "auto") &&
+	    str_casecmp(name, kern->name)) {
+		warning("g711: kernel '%s' not available\n", name);
+	}
+
+	info("g711: using %s kernel\n", kern->name);
+}
+
+
+static int cmd_bench(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	const unsigned iter = 2000;
+	size_t sampc = 160;
+	int16_t *pcm = NULL;
+	uint8_t *law = NULL;
+	unsigned i, j;
+	int err = 0;
+
+	if (str_isset(carg->prm))
+		sampc = atoi(carg->prm);
+	if (!sampc)
+		return re_hprintf(pf, "usage: g711_bench [samples]\n");
+
+	pcm = mem_alloc(sampc * sizeof(*pcm), NULL);
+	law = mem_alloc(sampc, NULL);
+	if (!pcm || !law) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < sampc; i++)
+		pcm[i] = rand_u16();
+
+	err = re_hprintf(pf, "g711: %zu samples per block, ns/sample:\n",
+			 sampc);
+
+	for (i = 0; i < g711_kernel_count(); i++) {
+
+		const struct g711_kernel *k = g711_kernel_get(i);
+		uint64_t t0, t1, t2, t3, t4;
+
+		if (!k)
+			continue;
+
+		t0 = tmr_jiffies_usec();
+		for (j = 0; j < iter; j++)
+			k->enc_ulaw(law, pcm, sampc);
+		t1 = tmr_jiffies_usec();
+		for (j = 0; j < iter; j++)
+			k->dec_ulaw(pcm, law, sampc);
+		t2 = tmr_jiffies_usec();
+		for (j = 0; j < iter; j++)
+			k->enc_alaw(law, pcm, sampc);
+		t3 = tmr_jiffies_usec();
+		for (j = 0; j < iter; j++)
+			k->dec_alaw(pcm, law, sampc);
+		t4 = tmr_jiffies_usec();
+
+		err |= re_hprintf(pf, "  %-8s%s pcmu enc %6.2f dec %6.2f,"
+				  " pcma enc %6.2f dec %6.2f\n",
+				  k->name, k == kern ? "*" : " ",
+				  (t1 - t0) * 1000.0 / iter / sampc,
+				  (t2 - t1) * 1000.0 / iter / sampc,
+				  (t3 - t2) * 1000.0 / iter / sampc,
+				  (t4 - t3) * 1000.0 / iter / sampc);
+	}
+
+ out:
+	mem_deref(law);
+	mem_deref(pcm);
+
+	return err;
+}
+
+
+static const struct cmd cmdv[] = {
+	{"g711_bench", 0, CMD_PRM, "Benchmark G.711 kernels [samples]",
+		cmd_bench},
+};
+
+
 static int module_init(void)
 {
+	char name[16] = "";
+
+	(void)conf_get_str(conf_cur(), "g711_kernel", name, sizeof(name));
+
+	kernel_select(name);
+
 	aucodec_register(baresip_aucodecl(), &pcmu);
 	aucodec_register(baresip_aucodecl(), &pcma);
 
-	return 0;
+	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
 }
 
 
 static int module_close(void)
 {
+	cmd_unregister(baresip_commands(), cmdv);
+
 	aucodec_unregister(&pcma);
 	aucodec_unregister(&pcmu);
 
@@ -0,0 +1,20 @@
+/**
+ * @file g711.h G.711 Audio Codec -- internal interface
+ *
+ * Copyright (C) 2010 - 2015 Creytiv.com
+ */
+
+
+/** G.711 block kernel, converts n samples */
+struct g711_kernel {
+	const char *name;
+	void (*enc_ulaw)(uint8_t *dst, const int16_t *src, size_t n);
+	void (*enc_alaw)(uint8_t *dst, const int16_t *src, size_t n);
+	void (*dec_ulaw)(int16_t *dst, const uint8_t *src, size_t n);
+	void (*dec_alaw)(int16_t *dst, const uint8_t *src, size_t n);
+};
+
+
+const struct g711_kernel *g711_kernel_get(unsigned i);
+unsigned g711_kernel_count(void);
+int g711_kernel_check(const struct g711_kernel *k);
@@ -0,0 +1,680 @@
+/**
+ * @file g711/kernel.c G.711 block kernels
+ *
+ * Copyright (C) 2010 - 2015 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_TARGET 1
+#endif
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#endif
+#include "g711.h"
+
+
+/*
+ * The vector kernels compute the companding laws arithmetically
+ * instead of through tables:
+ *
+ * Encoding needs the segment, which is the position of the highest
+ * set bit, and the 4 bits below it. Both are read from the exponent
+ * and the top of the mantissa of the value converted to float. NEON
+ * uses a count-leading-zeros instead.
+ *
+ * Decoding needs a shift by the segment, which is done as a multiply
+ * with a power of two.
+ */
+
+
+enum {
+	ULAW_BIAS = 0x84,
+	ULAW_CLIP = 8159,
+};
+
+
+static void enc_ulaw_scalar(uint8_t *dst, const int16_t *src, size_t n)
+{
+	while (n--)
+		*dst++ = g711_pcm2ulaw(*src++);
+}
+
+
+static void enc_alaw_scalar(uint8_t *dst, const int16_t *src, size_t n)
+{
+	while (n--)
+		*dst++ = g711_pcm2alaw(*src++);
+}
+
+
+static void dec_ulaw_scalar(int16_t *dst, const uint8_t *src, size_t n)
+{
+	while (n--)
+		*dst++ = g711_ulaw2pcm(*src++);
+}
+
+
+static void dec_alaw_scalar(int16_t *dst, const uint8_t *src, size_t n)
+{
+	while (n--)
+		*dst++ = g711_alaw2pcm(*src++);
+}
+
+
+#if defined (__SSE2__)
+/* floor(log2(v)) << 4 | next 4 bits, for 0 < v < 2^24 */
+static inline __m128i seg_mant_sse2(__m128i v)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo, hi;
+
+	lo = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)));
+	hi = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)));
+
+	return _mm_packs_epi32(_mm_srli_epi32(lo, 19), _mm_srli_epi32(hi, 19));
+}
+
+
+static inline __m128i ulaw_enc_sse2(__m128i x)
+{
+	__m128i s, m, v, c;
+
+	s = _mm_srai_epi16(x, 2);
+	m = _mm_cmplt_epi16(s, _mm_setzero_si128());
+	v = _mm_sub_epi16(_mm_xor_si128(s, m), m);
+	v = _mm_min_epi16(v, _mm_set1_epi16(ULAW_CLIP));
+	v = _mm_add_epi16(v, _mm_set1_epi16(ULAW_BIAS >> 2));
+
+	c = _mm_sub_epi16(seg_mant_sse2(v), _mm_set1_epi16((127 + 5) << 4));
+	c = _mm_min_epi16(c, _mm_set1_epi16(0x7f));
+
+	return _mm_xor_si128(c, _mm_xor_si128(_mm_set1_epi16(0xff),
+					      _mm_and_si128(m,
+						  _mm_set1_epi16(0x80))));
+}
+
+
+static inline __m128i alaw_enc_sse2(__m128i x)
+{
+	__m128i s, m, v, c, low, sel;
+
+	s = _mm_srai_epi16(x, 3);
+	m = _mm_cmplt_epi16(s, _mm_setzero_si128());
+	v = _mm_xor_si128(s, m);
+
+	c   = _mm_sub_epi16(seg_mant_sse2(v), _mm_set1_epi16((127 + 4) << 4));
+	low = _mm_srli_epi16(v, 1);
+	sel = _mm_cmplt_epi16(v, _mm_set1_epi16(0x20));
+	c   = _mm_or_si128(_mm_and_si128(sel, low), _mm_andnot_si128(sel, c));
+
+	return _mm_xor_si128(c, _mm_xor_si128(_mm_set1_epi16(0xd5),
+					      _mm_and_si128(m,
+						  _mm_set1_epi16(0x80))));
+}
+
+
+static void enc_ulaw_sse2(uint8_t *dst, const int16_t *src, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&src[i + 8]);
+
+		_mm_storeu_si128((__m128i *)&dst[i],
+				 _mm_packus_epi16(ulaw_enc_sse2(a),
+						  ulaw_enc_sse2(b)));
+	}
+
+	enc_ulaw_scalar(&dst[i], &src[i], n - i);
+}
+
+
+static void enc_alaw_sse2(uint8_t *dst, const int16_t *src, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&src[i + 8]);
+
+		_mm_storeu_si128((__m128i *)&dst[i],
+				 _mm_packus_epi16(alaw_enc_sse2(a),
+						  alaw_enc_sse2(b)));
+	}
+
+	enc_alaw_scalar(&dst[i], &src[i], n - i);
+}
+
+
+/* 2^e for 0 <= e < 16, via the float exponent */
+static inline __m128i pow2_sse2(__m128i e)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi32(127);
+	__m128i lo, hi;
+
+	lo = _mm_slli_epi32(_mm_add_epi32(_mm_unpacklo_epi16(e, zero), bias),
+			    23);
+	hi = _mm_slli_epi32(_mm_add_epi32(_mm_unpackhi_epi16(e, zero), bias),
+			    23);
+
+	return _mm_packs_epi32(_mm_cvttps_epi32(_mm_castsi128_ps(lo)),
+			       _mm_cvttps_epi32(_mm_castsi128_ps(hi)));
+}
+
+
+static inline __m128i ulaw_dec_sse2(__m128i u)
+{
+	__m128i e, t, neg;
+
+	u = _mm_xor_si128(u, _mm_set1_epi16(0xff));
+	e = _mm_and_si128(_mm_srli_epi16(u, 4), _mm_set1_epi16(7));
+	t = _mm_slli_epi16(_mm_and_si128(u, _mm_set1_epi16(0xf)), 3);
+	t = _mm_add_epi16(t, _mm_set1_epi16(ULAW_BIAS));
+	t = _mm_mullo_epi16(t, pow2_sse2(e));
+	t = _mm_sub_epi16(t, _mm_set1_epi16(ULAW_BIAS));
+
+	neg = _mm_cmpgt_epi16(u, _mm_set1_epi16(0x7f));
+
+	return _mm_sub_epi16(_mm_xor_si128(t, neg), neg);
+}
+
+
+static inline __m128i alaw_dec_sse2(__m128i a)
+{
+	__m128i e, t, one, pos;
+
+	a   = _mm_xor_si128(a, _mm_set1_epi16(0x55));
+	e   = _mm_and_si128(_mm_srli_epi16(a, 4), _mm_set1_epi16(7));
+	t   = _mm_slli_epi16(_mm_and_si128(a, _mm_set1_epi16(0xf)), 4);
+	one = _mm_cmpgt_epi16(e, _mm_setzero_si128());
+
+	/* segment 0: t + 8, otherwise (t + 0x108) << (seg - 1) */
+	t = _mm_add_epi16(t, _mm_set1_epi16(8));
+	t = _mm_add_epi16(t, _mm_and_si128(one, _mm_set1_epi16(0x100)));
+	t = _mm_mullo_epi16(t, pow2_sse2(_mm_add_epi16(e, one)));
+
+	pos = _mm_cmpgt_epi16(a, _mm_set1_epi16(0x7f));
+
+	/* negate when the sign bit is clear */
+	pos = _mm_xor_si128(pos, _mm_set1_epi16(-1));
+
+	return _mm_sub_epi16(_mm_xor_si128(t, pos), pos);
+}
+
+
+static void dec_ulaw_sse2(int16_t *dst, const uint8_t *src, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&src[i]);
+
+		_mm_storeu_si128((__m128i *)&dst[i],
+				 ulaw_dec_sse2(_mm_unpacklo_epi8(x, zero)));
+		_mm_storeu_si128((__m128i *)&dst[i + 8],
+				 ulaw_dec_sse2(_mm_unpackhi_epi8(x, zero)));
+	}
+
+	dec_ulaw_scalar(&dst[i], &src[i], n - i);
+}
+
+
+static void dec_alaw_sse2(int16_t *dst, const uint8_t *src, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&src[i]);
+
+		_mm_storeu_si128((__m128i *)&dst[i],
+				 alaw_dec_sse2(_mm_unpacklo_epi8(x, zero)));
+		_mm_storeu_si128((__m128i *)&dst[i + 8],
+				 alaw_dec_sse2(_mm_unpackhi_epi8(x, zero)));
+	}
+
+	dec_alaw_scalar(&dst[i], &src[i], n - i);
+}
+#endif
+
+
+#ifdef HAVE_AVX2_TARGET
+__attribute__((target("avx2")))
+static inline __m256i seg_mant_avx2(__m256i v)
+{
+	__m256i lo, hi;
+
+	lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+	hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+
+	lo = _mm256_castps_si256(_mm256_cvtepi32_ps(lo));
+	hi = _mm256_castps_si256(_mm256_cvtepi32_ps(hi));
+	lo = _mm256_srli_epi32(lo, 19);
+	hi = _mm256_srli_epi32(hi, 19);
+
+	/* packs works per 128-bit lane, restore the order */
+	return _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8);
+}
+
+
+__attribute__((target("avx2")))
+static inline __m128i pack_u8_avx2(__m256i c)
+{
+	c = _mm256_permute4x64_epi64(_mm256_packus_epi16(c, c), 0xd8);
+
+	return _mm256_castsi256_si128(c);
+}
+
+
+__attribute__((target("avx2")))
+static void enc_ulaw_avx2(uint8_t *dst, const int16_t *src, size_t n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)&src[i]);
+		__m256i s, m, v, c;
+
+		s = _mm256_srai_epi16(x, 2);
+		m = _mm256_cmpgt_epi16(zero, s);
+		v = _mm256_abs_epi16(s);
+		v = _mm256_min_epi16(v, _mm256_set1_epi16(ULAW_CLIP));
+		v = _mm256_add_epi16(v, _mm256_set1_epi16(ULAW_BIAS >> 2));
+
+		c = _mm256_sub_epi16(seg_mant_avx2(v),
+				     _mm256_set1_epi16((127 + 5) << 4));
+		c = _mm256_min_epi16(c, _mm256_set1_epi16(0x7f));
+		c = _mm256_xor_si256(c, _mm256_set1_epi16(0xff));
+		c = _mm256_xor_si256(c, _mm256_and_si256(m,
+					     _mm256_set1_epi16(0x80)));
+
+		_mm_storeu_si128((__m128i *)&dst[i], pack_u8_avx2(c));
+	}
+
+	enc_ulaw_scalar(&dst[i], &src[i], n - i);
+}
+
+
+__attribute__((target("avx2")))
+static void enc_alaw_avx2(uint8_t *dst, const int16_t *src, size_t n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)&src[i]);
+		__m256i s, m, v, c, sel;
+
+		s = _mm256_srai_epi16(x, 3);
+		m = _mm256_cmpgt_epi16(zero, s);
+		v = _mm256_xor_si256(s, m);
+
+		c = _mm256_sub_epi16(seg_mant_avx2(v),
+				     _mm256_set1_epi16((127 + 4) << 4));
+		sel = _mm256_cmpgt_epi16(_mm256_set1_epi16(0x20), v);
+		c = _mm256_blendv_epi8(c, _mm256_srli_epi16(v, 1), sel);
+		c = _mm256_xor_si256(c, _mm256_set1_epi16(0xd5));
+		c = _mm256_xor_si256(c, _mm256_and_si256(m,
+					     _mm256_set1_epi16(0x80)));
+
+		_mm_storeu_si128((__m128i *)&dst[i], pack_u8_avx2(c));
+	}
+
+	enc_alaw_scalar(&dst[i], &src[i], n - i);
+}
+
+
+/* 2^e for 0 <= e < 8, as a byte table lookup in each 16-bit lane */
+__attribute__((target("avx2")))
+static inline __m256i pow2_avx2(__m256i e)
+{
+	const __m256i tab = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+					     0, 0, 0, 0, 0, 0, 0, 0,
+					     1, 2, 4, 8, 16, 32, 64, -128,
+					     0, 0, 0, 0, 0, 0, 0, 0);
+
+	/* the high byte gets index 0x80, which gives zero */
+	e = _mm256_or_si256(e, _mm256_set1_epi16((short)0x8000));
+
+	return _mm256_shuffle_epi8(tab, e);
+}
+
+
+__attribute__((target("avx2")))
+static void dec_ulaw_avx2(int16_t *dst, const uint8_t *src, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m256i u, e, t, neg;
+
+		u = _mm256_cvtepu8_epi16(x);
+		u = _mm256_xor_si256(u, _mm256_set1_epi16(0xff));
+		e = _mm256_and_si256(_mm256_srli_epi16(u, 4),
+				     _mm256_set1_epi16(7));
+		t = _mm256_slli_epi16(_mm256_and_si256(u,
+					  _mm256_set1_epi16(0xf)), 3);
+		t = _mm256_add_epi16(t, _mm256_set1_epi16(ULAW_BIAS));
+		t = _mm256_mullo_epi16(t, pow2_avx2(e));
+		t = _mm256_sub_epi16(t, _mm256_set1_epi16(ULAW_BIAS));
+
+		neg = _mm256_cmpgt_epi16(u, _mm256_set1_epi16(0x7f));
+		t   = _mm256_sign_epi16(t, _mm256_or_si256(neg,
+					    _mm256_set1_epi16(1)));
+
+		_mm256_storeu_si256((__m256i *)&dst[i], t);
+	}
+
+	dec_ulaw_scalar(&dst[i], &src[i], n - i);
+}
+
+
+__attribute__((target("avx2")))
+static void dec_alaw_avx2(int16_t *dst, const uint8_t *src, size_t n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&src[i]);
+		__m256i a, e, t, one, pos;
+
+		a   = _mm256_cvtepu8_epi16(x);
+		a   = _mm256_xor_si256(a, _mm256_set1_epi16(0x55));
+		e   = _mm256_and_si256(_mm256_srli_epi16(a, 4),
+				       _mm256_set1_epi16(7));
+		t   = _mm256_slli_epi16(_mm256_and_si256(a,
+					    _mm256_set1_epi16(0xf)), 4);
+		one = _mm256_cmpgt_epi16(e, zero);
+
+		t = _mm256_add_epi16(t, _mm256_set1_epi16(8));
+		t = _mm256_add_epi16(t, _mm256_and_si256(one,
+					 _mm256_set1_epi16(0x100)));
+		t = _mm256_mullo_epi16(t, pow2_avx2(_mm256_add_epi16(e, one)));
+
+		pos = _mm256_cmpgt_epi16(a, _mm256_set1_epi16(0x7f));
+		t   = _mm256_sign_epi16(t, _mm256_or_si256(
+					    _mm256_andnot_si256(pos,
+						_mm256_set1_epi16(-1)),
+					    _mm256_set1_epi16(1)));
+
+		_mm256_storeu_si256((__m256i *)&dst[i], t);
+	}
+
+	dec_alaw_scalar(&dst[i], &src[i], n - i);
+}
+#endif
+
+
+#ifdef HAVE_NEON
+/* floor(log2(v)), for v > 0 */
+static inline int16x8_t log2_neon(uint16x8_t v)
+{
+	return vsubq_s16(vdupq_n_s16(15), vreinterpretq_s16_u16(vclzq_u16(v)));
+}
+
+
+static void enc_ulaw_neon(uint8_t *dst, const int16_t *src, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t s = vshrq_n_s16(vld1q_s16(&src[i]), 2);
+		uint16x8_t neg = vcltq_s16(s, vdupq_n_s16(0));
+		int16x8_t v, e, c;
+
+		v = vminq_s16(vabsq_s16(s), vdupq_n_s16(ULAW_CLIP));
+		v = vaddq_s16(v, vdupq_n_s16(ULAW_BIAS >> 2));
+
+		/* segment = log2(v) - 5, mantissa = v >> (segment + 1) */
+		e = log2_neon(vreinterpretq_u16_s16(v));
+		c = vshlq_s16(v, vsubq_s16(vdupq_n_s16(4), e));
+		c = vandq_s16(c, vdupq_n_s16(0xf));
+		c = vorrq_s16(c, vshlq_n_s16(vsubq_s16(e, vdupq_n_s16(5)), 4));
+		c = vminq_s16(c, vdupq_n_s16(0x7f));
+
+		c = veorq_s16(c, vdupq_n_s16(0xff));
+		c = veorq_s16(c, vandq_s16(vreinterpretq_s16_u16(neg),
+					   vdupq_n_s16(0x80)));
+
+		vst1_u8(&dst[i], vmovn_u16(vreinterpretq_u16_s16(c)));
+	}
+
+	enc_ulaw_scalar(&dst[i], &src[i], n - i);
+}
+
+
+static void enc_alaw_neon(uint8_t *dst, const int16_t *src, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t s = vshrq_n_s16(vld1q_s16(&src[i]), 3);
+		uint16x8_t neg = vcltq_s16(s, vdupq_n_s16(0));
+		int16x8_t v, seg, c;
+
+		v = veorq_s16(s, vreinterpretq_s16_u16(neg));
+
+		/* segment = log2(v) - 4 for v >= 32, else 0 */
+		seg = log2_neon(vreinterpretq_u16_s16(vorrq_s16(v,
+							  vdupq_n_s16(0x10))));
+		seg = vsubq_s16(seg, vdupq_n_s16(4));
+
+		/* mantissa = v >> max(segment, 1) */
+		c = vshlq_s16(v, vnegq_s16(vmaxq_s16(seg, vdupq_n_s16(1))));
+		c = vandq_s16(c, vdupq_n_s16(0xf));
+		c = vorrq_s16(c, vshlq_n_s16(seg, 4));
+
+		c = veorq_s16(c, vdupq_n_s16(0xd5));
+		c = veorq_s16(c, vandq_s16(vreinterpretq_s16_u16(neg),
+					   vdupq_n_s16(0x80)));
+
+		vst1_u8(&dst[i], vmovn_u16(vreinterpretq_u16_s16(c)));
+	}
+
+	enc_alaw_scalar(&dst[i], &src[i], n - i);
+}
+
+
+static void dec_ulaw_neon(int16_t *dst, const uint8_t *src, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t u = vreinterpretq_s16_u16(vmovl_u8(vmvn_u8(
+						  vld1_u8(&src[i]))));
+		int16x8_t e, t;
+		uint16x8_t neg;
+
+		e = vandq_s16(vshrq_n_s16(u, 4), vdupq_n_s16(7));
+		t = vshlq_n_s16(vandq_s16(u, vdupq_n_s16(0xf)), 3);
+		t = vaddq_s16(t, vdupq_n_s16(ULAW_BIAS));
+		t = vshlq_s16(t, e);
+		t = vsubq_s16(t, vdupq_n_s16(ULAW_BIAS));
+
+		neg = vcgtq_s16(u, vdupq_n_s16(0x7f));
+
+		vst1q_s16(&dst[i], vbslq_s16(neg, vnegq_s16(t), t));
+	}
+
+	dec_ulaw_scalar(&dst[i], &src[i], n - i);
+}
+
+
+static void dec_alaw_neon(int16_t *dst, const uint8_t *src, size_t n)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t a = vreinterpretq_s16_u16(vmovl_u8(veor_u8(
+						  vld1_u8(&src[i]),
+						  vdup_n_u8(0x55))));
+		int16x8_t e, t, one;
+		uint16x8_t pos;
+
+		e   = vandq_s16(vshrq_n_s16(a, 4), vdupq_n_s16(7));
+		t   = vshlq_n_s16(vandq_s16(a, vdupq_n_s16(0xf)), 4);
+		one = vreinterpretq_s16_u16(vcgtq_s16(e, vdupq_n_s16(0)));
+
+		/* segment 0: t + 8, otherwise (t + 0x108) << (seg - 1) */
+		t = vaddq_s16(t, vdupq_n_s16(8));
+		t = vaddq_s16(t, vandq_s16(one, vdupq_n_s16(0x100)));
+		t = vshlq_s16(t, vaddq_s16(e, one));
+
+		pos = vcgtq_s16(a, vdupq_n_s16(0x7f));
+
+		vst1q_s16(&dst[i], vbslq_s16(pos, t, vnegq_s16(t)));
+	}
+
+	dec_alaw_scalar(&dst[i], &src[i], n - i);
+}
+#endif
+
+
+static const struct g711_kernel kernelv[] = {
+	{"scalar", enc_ulaw_scalar, enc_alaw_scalar,
+		   dec_ulaw_scalar, dec_alaw_scalar},
+#if defined (__SSE2__)
+	{"sse2",   enc_ulaw_sse2, enc_alaw_sse2,
+		   dec_ulaw_sse2, dec_alaw_sse2},
+#endif
+#ifdef HAVE_AVX2_TARGET
+	{"avx2",   enc_ulaw_avx2, enc_alaw_avx2,
+		   dec_ulaw_avx2, dec_alaw_avx2},
+#endif
+#ifdef HAVE_NEON
+	{"neon",   enc_ulaw_neon, enc_alaw_neon,
+		   dec_ulaw_neon, dec_alaw_neon},
+#endif
+};
+
+
+static bool kernel_supported(const struct g711_kernel *k)
+{
+#ifdef HAVE_AVX2_TARGET
+	if (k->enc_ulaw == enc_ulaw_avx2) {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+	}
+#else
+	(void)k;
+#endif
+
+	return true;
+}
+
+
+/**
+ * Get a G.711 block kernel
+ *
+ * @param i Index of the kernel, 0 is the scalar reference
+ *
+ * @return Kernel, or NULL if the index is out of range or the kernel is
+ *         not supported by this CPU
+ */
+const struct g711_kernel *g711_kernel_get(unsigned i)
+{
+	if (i >= ARRAY_SIZE(kernelv))
+		return NULL;
+
+	return kernel_supported(&kernelv[i]) ? &kernelv[i] : NULL;
+}
+
+
+/** Number of compiled-in kernels, including unsupported ones */
+unsigned g711_kernel_count(void)
+{
+	return ARRAY_SIZE(kernelv);
+}
+
+
+/**
+ * Check a kernel against the scalar reference, for all possible input
+ * values and a range of block lengths
+ *
+ * @param k Kernel to check
+ *
+ * @return 0 if bit-exact, otherwise EPROTO
+ */
+int g711_kernel_check(const struct g711_kernel *k)
+{
+	const struct g711_kernel *ref = &kernelv[0];
+	int16_t pcm[1024], pcm_ref[256], pcm_out[256];
+	uint8_t law[1024], law_ref[256];
+	unsigned i, off, len;
+
+	if (!k)
+		return EINVAL;
+
+	/* encoders: all 65536 values, in blocks of 1024 */
+	for (off = 0; off < 65536; off += ARRAY_SIZE(pcm)) {
+
+		for (i = 0; i < ARRAY_SIZE(pcm); i++)
+			pcm[i] = (int16_t)(uint16_t)(off + i);
+
+		k->enc_ulaw(law, pcm, ARRAY_SIZE(pcm));
+		for (i = 0; i < ARRAY_SIZE(pcm); i++) {
+			if (law[i] != g711_pcm2ulaw(pcm[i]))
+				return EPROTO;
+		}
+
+		k->enc_alaw(law, pcm, ARRAY_SIZE(pcm));
+		for (i = 0; i < ARRAY_SIZE(pcm); i++) {
+			if (law[i] != g711_pcm2alaw(pcm[i]))
+				return EPROTO;
+		}
+	}
+
+	/* decoders: all 256 values */
+	for (i = 0; i < 256; i++)
+		law_ref[i] = (uint8_t)i;
+
+	ref->dec_ulaw(pcm_ref, law_ref, 256);
+	k->dec_ulaw(pcm_out, law_ref, 256);
+	if (memcmp(pcm_out, pcm_ref, sizeof(pcm_ref)))
+		return EPROTO;
+
+	ref->dec_alaw(pcm_ref, law_ref, 256);
+	k->dec_alaw(pcm_out, law_ref, 256);
+	if (memcmp(pcm_out, pcm_ref, sizeof(pcm_ref)))
+		return EPROTO;
+
+	/* odd lengths exercise the scalar tails */
+	for (len = 1; len < 40; len++) {
+
+		k->enc_ulaw(law, &pcm[3], len);
+		ref->enc_ulaw(law_ref, &pcm[3], len);
+		if (memcmp(law, law_ref, len))
+			return EPROTO;
+
+		k->enc_alaw(law, &pcm[3], len);
+		ref->enc_alaw(law_ref, &pcm[3], len);
+		if (memcmp(law, law_ref, len))
+			return EPROTO;
+
+		k->dec_ulaw(pcm_out, &law_ref[1], len);
+		ref->dec_ulaw(pcm_ref, &law_ref[1], len);
+		if (memcmp(pcm_out, pcm_ref, len * sizeof(int16_t)))
+			return EPROTO;
+
+		k->dec_alaw(pcm_out, &law_ref[1], len);
+		ref->dec_alaw(pcm_ref, &law_ref[1], len);
+		if (memcmp(pcm_out, pcm_ref, len * sizeof(int16_t)))
+			return EPROTO;
+	}
+
+	return 0;
+}
@@ -5,6 +5,6 @@
 #
 
 MOD		:= g711
-$(MOD)_SRCS	+= g711.c
+$(MOD)_SRCS	+= g711.c kernel.c
 
 include mk/mod.mk
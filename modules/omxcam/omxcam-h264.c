@@ -76,7 +76,9 @@ static struct vidsrc *mod_avf;
 static void *read_thread(void *arg)
 {
 	struct vidsrc_st *st = arg;
-	
+
+	(void)realtime_thread_setup(REALTIME_THREAD_VIDEO, "omxcam_h264");
+
 	if (st->run) {
 			info("omxcam: read_frame staring\n");
 			omxcam_yuv_planes (videoset.camera.width, videoset.camera.height,  &planes);
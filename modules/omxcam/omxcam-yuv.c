@@ -73,7 +73,9 @@ uint32_t current = 0;
 static void *read_thread(void *arg)
 {
 	struct vidsrc_st *st = arg;
-	
+
+	(void)realtime_thread_setup(REALTIME_THREAD_VIDEO, "omxcam_yuv");
+
 	if (st->run) {
 			info("omxcam: read_frame staring\n");
 			 omxcam_yuv_planes (videoset.camera.width, videoset.camera.height,  &planes);
@@ -21,7 +21,6 @@
 #include <sys/time.h>
 
 #include <omxcam.h>
-#include <sys/prctl.h>
 
 
 /**
@@ -78,7 +77,7 @@ struct vidframe frame;
 static void *read_thread(void *arg)
 {	
 	(void)arg;
-	prctl(PR_SET_NAME,"omxcam_read");
+	(void)realtime_thread_setup(REALTIME_THREAD_VIDEO, "omxcam_read");
 	if (st->run) {
 			info("omxcam: read_frame staring\n");
 			omxcam_yuv_planes (videoset.camera.width, videoset.camera.height,  &planes);
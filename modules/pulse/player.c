@@ -50,6 +50,8 @@ static void *write_thread(void *arg)
 	const size_t num_bytes = st->sampc * st->sampsz;
 	int ret, pa_error = 0;
 
+	(void)realtime_thread_setup(REALTIME_THREAD_AUDIO, "pulse_play");
+
 	while (st->run) {
 
 		st->wh(st->sampv, st->sampc, st->arg);
@@ -54,6 +54,8 @@ static void *read_thread(void *arg)
 	unsigned dropped = 0;
 	bool init = true;
 
+	(void)realtime_thread_setup(REALTIME_THREAD_AUDIO, "pulse_rec");
+
 	if (pa_simple_flush(st->s, &pa_error)) {
 		warning("pulse: pa_simple_flush error (%s)\n",
 		        pa_strerror(pa_error));
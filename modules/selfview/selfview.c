@@ -176,25 +176,28 @@ static int encode_pip(struct vidfilt_enc_st *st, struct vidframe *frame)
 {
 	struct selfview_enc *enc = (struct selfview_enc *)st;
 	struct selfview *selfview = enc->selfview;
+	struct vidsz sz;
 	int err = 0;
 
 	if (!frame)
 		return 0;
 
+	/* Use size if configured, or else 20% of main window */
+	if (selfview_size.w && selfview_size.h) {
+		sz = selfview_size;
+	}
+	else {
+		sz.w = frame->size.w / 5;
+		sz.h = frame->size.h / 5;
+	}
+
 	lock_write_get(selfview->lock);
-	if (!selfview->frame) {
-		struct vidsz sz;
-
-		/* Use size if configured, or else 20% of main window */
-		if (selfview_size.w && selfview_size.h) {
-			sz = selfview_size;
-		}
-		else {
-			sz.w = frame->size.w / 5;
-			sz.h = frame->size.h / 5;
-		}
-
-		err = vidframe_alloc(&selfview->frame, VID_FMT_YUV420P, &sz);
+	if (!selfview->frame || !vidsz_cmp(&selfview->frame->size, &sz)) {
+
+		selfview->frame = mem_deref(selfview->frame);
+
+		err = vidpool_get(baresip_vidpool(), &selfview->frame,
+				  VID_FMT_YUV420P, &sz);
 	}
 	if (!err)
 		vidconv(selfview->frame, frame, NULL);
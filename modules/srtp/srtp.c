@@ -3,6 +3,8 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <stdlib.h>
+#include <string.h>
 #include <re.h>
 #include <baresip.h>
 #include "sdes.h"
@@ -22,11 +24,23 @@
   <sip:user@domain.com>;mediaenc=srtp-mand
  \endverbatim
  *
+ * Incoming packets which are read in batches are decrypted with one
+ * call per batch.
+ *
+ * Commands:
+ *
+ \verbatim
+  srtp_bench [packets]   Measure protect/unprotect throughput per suite
+ \endverbatim
  */
 
 
 #define SRTP_MASTER_KEY_LEN  30
 
+enum {
+	BENCH_PLDSZ = 1200,
+};
+
 
 struct menc_st {
 	/* one SRTP session per media line */
@@ -220,6 +234,20 @@ static bool recv_handler(struct sa *src, struct mbuf *mb, void *arg)
 }
 
 
+static void unprotect_handler(struct menc_media *m, struct mbuf **mbv,
+			      size_t n, bool *dropv)
+{
+	struct menc_st *st = (struct menc_st *)m;
+	size_t i;
+
+	for (i=0; i<n; i++) {
+
+		if (!dropv[i])
+			dropv[i] = recv_handler(NULL, mbv[i], st);
+	}
+}
+
+
 /* a=crypto:<tag> <crypto-suite> <key-params> [<session-params>] */
 static int sdp_enc(struct menc_st *st, struct sdp_media *m,
 		   uint32_t tag, const char *suite)
@@ -377,16 +405,146 @@ static int alloc(struct menc_media **stp, struct menc_sess *sess,
 }
 
 
+static int bench_packets(struct mbuf **mbv, unsigned n)
+{
+	struct rtp_header hdr;
+	unsigned i;
+	int err = 0;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.ver  = RTP_VERSION;
+	hdr.pt   = 96;
+	hdr.ssrc = 0x42;
+
+	for (i=0; i<n && !err; i++) {
+
+		struct mbuf *mb = mbv[i];
+
+		hdr.seq = i;
+		hdr.ts  = i * 3000;
+
+		mbuf_rewind(mb);
+		err  = rtp_hdr_encode(mb, &hdr);
+		err |= mbuf_fill(mb, 0xa5, BENCH_PLDSZ);
+		mb->pos = 0;
+	}
+
+	return err;
+}
+
+
+static int bench_suite(struct re_printf *pf, const char *name,
+		       struct mbuf **mbv, unsigned n)
+{
+	struct srtp *tx = NULL, *rx = NULL;
+	uint8_t key[SRTP_MASTER_KEY_LEN];
+	uint64_t t0, t1, t2;
+	unsigned i;
+	int err;
+
+	rand_bytes(key, sizeof(key));
+
+	err  = srtp_alloc(&tx, resolve_suite(name), key, sizeof(key), 0);
+	err |= srtp_alloc(&rx, resolve_suite(name), key, sizeof(key), 0);
+	err |= bench_packets(mbv, n);
+	if (err)
+		goto out;
+
+	t0 = tmr_jiffies_usec();
+	for (i=0; i<n && !err; i++) {
+		err = srtp_encrypt(tx, mbv[i]);
+		mbv[i]->pos = 0;
+	}
+	t1 = tmr_jiffies_usec();
+	for (i=0; i<n && !err; i++) {
+		err = srtp_decrypt(rx, mbv[i]);
+		mbv[i]->pos = 0;
+	}
+	t2 = tmr_jiffies_usec();
+
+	if (err)
+		goto out;
+
+	t1 = max(t1, t0 + 1);
+	t2 = max(t2, t1 + 1);
+
+	err = re_hprintf(pf, "  %-24s protect %7.1f Mbit/s %5.2f us/pkt,"
+			 " unprotect %7.1f Mbit/s %5.2f us/pkt\n", name,
+			 8.0 * n * BENCH_PLDSZ / (t1 - t0),
+			 (double)(t1 - t0) / n,
+			 8.0 * n * BENCH_PLDSZ / (t2 - t1),
+			 (double)(t2 - t1) / n);
+
+ out:
+	mem_deref(rx);
+	mem_deref(tx);
+
+	return err;
+}
+
+
+static int cmd_bench(struct re_printf *pf, void *arg)
+{
+	static const char *suitev[] = {
+		aes_cm_128_hmac_sha1_32,
+		aes_cm_128_hmac_sha1_80,
+	};
+	const struct cmd_arg *carg = arg;
+	struct mbuf **mbv = NULL;
+	unsigned i, n = 10000;
+	int err = 0;
+
+	if (str_isset(carg->prm))
+		n = atoi(carg->prm);
+	if (!n || n > 65536)
+		return re_hprintf(pf, "usage: srtp_bench [packets]\n");
+
+	mbv = mem_zalloc(n * sizeof(*mbv), NULL);
+	if (!mbv)
+		return ENOMEM;
+
+	for (i=0; i<n; i++) {
+		mbv[i] = mbuf_alloc(RTP_HEADER_SIZE + BENCH_PLDSZ + 16);
+		if (!mbv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+
+	err = re_hprintf(pf, "srtp: %u packets of %u bytes payload:\n",
+			 n, BENCH_PLDSZ);
+
+	for (i=0; i<ARRAY_SIZE(suitev) && !err; i++)
+		err = bench_suite(pf, suitev[i], mbv, n);
+
+ out:
+	for (i=0; i<n; i++)
+		mem_deref(mbv[i]);
+	mem_deref(mbv);
+
+	return err;
+}
+
+
+static const struct cmd cmdv[] = {
+	{"srtp_bench", 0, CMD_PRM, "Benchmark SRTP suites [packets]",
+		cmd_bench},
+};
+
+
 static struct menc menc_srtp_opt = {
-	LE_INIT, "srtp", "RTP/AVP", NULL, alloc
+	LE_INIT, "srtp", "RTP/AVP", NULL, alloc,
+	unprotect_handler
 };
 
 static struct menc menc_srtp_mand = {
-	LE_INIT, "srtp-mand", "RTP/SAVP", NULL, alloc
+	LE_INIT, "srtp-mand", "RTP/SAVP", NULL, alloc,
+	unprotect_handler
 };
 
 static struct menc menc_srtp_mandf = {
-	LE_INIT, "srtp-mandf", "RTP/SAVPF", NULL, alloc
+	LE_INIT, "srtp-mandf", "RTP/SAVPF", NULL, alloc,
+	unprotect_handler
 };
 
 
@@ -398,12 +556,14 @@ static int mod_srtp_init(void)
 	menc_register(mencl, &menc_srtp_mand);
 	menc_register(mencl, &menc_srtp_mandf);
 
-	return 0;
+	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
 }
 
 
 static int mod_srtp_close(void)
 {
+	cmd_unregister(baresip_commands(), cmdv);
+
 	menc_unregister(&menc_srtp_mandf);
 	menc_unregister(&menc_srtp_mand);
 	menc_unregister(&menc_srtp_opt);
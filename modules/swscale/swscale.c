@@ -3,22 +3,131 @@
  *
  * Copyright (C) 2010 - 2016 Creytiv.com
  */
+#define _DEFAULT_SOURCE 1
+#define _BSD_SOURCE 1
+#include <unistd.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
 #include <libswscale/swscale.h>
 
 
+/**
+ * @defgroup swscale swscale
+ *
+ * Video filter for scaling and pixel conversion using libswscale
+ *
+ * The encoded frames are scaled to the configured video size and
+ * converted to the configured pixel format. Scaling contexts are cached
+ * per source format and size, so that a source which changes its
+ * resolution during a call gets a matching context, and switching back
+ * does not create a new one.
+ *
+ * Large frames are split into horizontal bands that are scaled in
+ * parallel by a pool of worker threads. Each band has a context of its
+ * own and is scaled as a picture of its own. The vertical filter would
+ * not reach across a band boundary and leave a seam, so a frame is only
+ * split when its height is not scaled, e.g. for a pixel conversion or a
+ * change of width. Other frames are scaled on the caller's thread.
+ *
+ * Config options:
+ *
+ \verbatim
+      swscale_format     {yuv420p,yuv444p,nv12,nv21}
+      swscale_algorithm  {fast_bilinear,bilinear,bicubic,point,area,lanczos}
+      swscale_threads    <N>  ; 0 is one per core, 1 disables threading
+ \endverbatim
+ *
+ * The command "swscale_bench" compares the throughput with one thread
+ * and with the configured number of threads at 720p and 1080p.
+ */
+
+
+enum {
+	MAX_BANDS     = 16,
+	CACHE_SIZE    = 4,           /**< Cached contexts per filter     */
+	BAND_MIN_ROWS = 64,          /**< Min destination rows per band  */
+	SPLIT_PIXELS  = 640 * 480,   /**< Min frame size for threading   */
+	BENCH_FRAMES  = 50,
+};
+
+
+/** One horizontal band of a frame, scaled as a picture of its own */
+struct band {
+	struct SwsContext *sws;
+	unsigned src_y;              /**< First source row               */
+	unsigned src_h;              /**< Number of source rows          */
+	unsigned dst_y;              /**< First destination row          */
+	unsigned dst_h;              /**< Number of destination rows     */
+};
+
+/** Scaling contexts for one source and destination format and size */
+struct swscale_ctx {
+	struct le le;
+	enum vidfmt src_fmt;
+	enum vidfmt dst_fmt;
+	struct vidsz src_size;
+	struct vidsz dst_size;
+	struct band bandv[MAX_BANDS];
+	unsigned bandc;
+};
+
 struct swscale_enc {
 	struct vidfilt_enc_st vf;   /**< Inheritance           */
 
-	struct SwsContext *sws;
+	struct list ctxl;           /**< Cached contexts, most recent first */
 	struct vidframe *frame;
 	struct vidsz dst_size;
+	enum vidfmt dst_fmt;
+	unsigned threads;
+
+#ifdef HAVE_PTHREAD
+	struct {
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;        /**< New job or stop          */
+		pthread_cond_t cond_done;   /**< All bands of job done    */
+		pthread_t tidv[MAX_BANDS - 1];
+		unsigned tidc;
+		uint64_t gen;               /**< Job generation           */
+		const struct swscale_ctx *ctx;
+		const struct vidframe *src;
+		struct vidframe *dst;
+		unsigned next;              /**< Next band to scale       */
+		unsigned pending;           /**< Bands not yet scaled     */
+		int err;
+		bool init;
+		bool run;
+	} pool;
+#endif
 };
 
 
-static enum vidfmt swscale_format = VID_FMT_YUV420P;  /* XXX: configurable */
+static enum vidfmt swscale_format = VID_FMT_YUV420P;
+static int swscale_flags = SWS_BICUBIC;
+static uint32_t swscale_threads;
+
+
+static const enum vidfmt fmtv[] = {
+	VID_FMT_YUV420P,
+	VID_FMT_YUV444P,
+	VID_FMT_NV12,
+	VID_FMT_NV21,
+};
+
+static const struct {
+	const char *name;
+	int flags;
+} algov[] = {
+	{"fast_bilinear", SWS_FAST_BILINEAR},
+	{"bilinear",      SWS_BILINEAR},
+	{"bicubic",       SWS_BICUBIC},
+	{"point",         SWS_POINT},
+	{"area",          SWS_AREA},
+	{"lanczos",       SWS_LANCZOS},
+};
 
 
 static enum AVPixelFormat vidfmt_to_avpixfmt(enum vidfmt fmt)
@@ -34,23 +143,435 @@ static enum AVPixelFormat vidfmt_to_avpixfmt(enum vidfmt fmt)
 }
 
 
-static void encode_destructor(void *arg)
+/* vertical subsampling of the chroma planes, as a shift */
+static unsigned vidfmt_vshift(enum vidfmt fmt)
+{
+	switch (fmt) {
+
+	case VID_FMT_YUV420P: return 1;
+	case VID_FMT_NV12:    return 1;
+	case VID_FMT_NV21:    return 1;
+	default:              return 0;
+	}
+}
+
+
+static void ctx_destructor(void *arg)
+{
+	struct swscale_ctx *ctx = arg;
+	unsigned i;
+
+	list_unlink(&ctx->le);
+
+	for (i=0; i<ctx->bandc; i++)
+		sws_freeContext(ctx->bandv[i].sws);
+}
+
+
+/*
+ * Split a frame into at most n bands of whole row pairs, so that the
+ * bands also fall on whole chroma rows. Only frames which are not
+ * scaled vertically, in luma or chroma, are split.
+ */
+static unsigned band_layout(struct band *bandv, unsigned n,
+			    const struct swscale_ctx *ctx)
+{
+	const unsigned h = ctx->src_size.h;
+	const unsigned w = max(ctx->src_size.w, ctx->dst_size.w);
+	unsigned units, i;
+
+	if (h != ctx->dst_size.h || w * h < SPLIT_PIXELS ||
+	    vidfmt_vshift(ctx->src_fmt) != vidfmt_vshift(ctx->dst_fmt))
+		n = 1;
+
+	if (n > 1) {
+		units = h / 2;
+
+		n = min(n, units);
+		n = min(n, h / BAND_MIN_ROWS);
+	}
+
+	if (n <= 1) {
+		bandv[0].src_y = 0;
+		bandv[0].src_h = h;
+		bandv[0].dst_y = 0;
+		bandv[0].dst_h = ctx->dst_size.h;
+		return 1;
+	}
+
+	for (i=0; i<n; i++) {
+
+		const unsigned y0 = i * units / n * 2;
+		const unsigned y1 = (i + 1 < n) ? (i + 1) * units / n * 2 : h;
+
+		bandv[i].src_y = y0;
+		bandv[i].src_h = y1 - y0;
+		bandv[i].dst_y = y0;
+		bandv[i].dst_h = y1 - y0;
+	}
+
+	return n;
+}
+
+
+static int ctx_alloc(struct swscale_ctx **ctxp, const struct vidframe *src,
+		     enum vidfmt dst_fmt, const struct vidsz *dst_size,
+		     unsigned bandc)
+{
+	struct swscale_ctx *ctx;
+	enum AVPixelFormat avpixfmt, avpixfmt_dst;
+	unsigned i;
+	int err = 0;
+
+	avpixfmt = vidfmt_to_avpixfmt(src->fmt);
+	if (avpixfmt == AV_PIX_FMT_NONE) {
+		warning("swscale: unknown pixel-format (%s)\n",
+			vidfmt_name(src->fmt));
+		return EINVAL;
+	}
+
+	avpixfmt_dst = vidfmt_to_avpixfmt(dst_fmt);
+	if (avpixfmt_dst == AV_PIX_FMT_NONE) {
+		warning("swscale: unknown pixel-format (%s)\n",
+			vidfmt_name(dst_fmt));
+		return EINVAL;
+	}
+
+	ctx = mem_zalloc(sizeof(*ctx), ctx_destructor);
+	if (!ctx)
+		return ENOMEM;
+
+	ctx->src_fmt  = src->fmt;
+	ctx->dst_fmt  = dst_fmt;
+	ctx->src_size = src->size;
+	ctx->dst_size = *dst_size;
+
+	bandc = band_layout(ctx->bandv, bandc, ctx);
+
+	for (i=0; i<bandc; i++) {
+
+		struct band *b = &ctx->bandv[i];
+
+		b->sws = sws_getContext(src->size.w, b->src_h, avpixfmt,
+					dst_size->w, b->dst_h, avpixfmt_dst,
+					swscale_flags, NULL, NULL, NULL);
+		if (!b->sws) {
+			warning("swscale: sws_getContext error\n");
+			err = ENOMEM;
+			goto out;
+		}
+
+		++ctx->bandc;
+	}
+
+	info("swscale: created SwsContext:"
+	     " `%s' %u x %u --> `%s' %u x %u (%u band%s)\n",
+	     vidfmt_name(src->fmt), src->size.w, src->size.h,
+	     vidfmt_name(dst_fmt), dst_size->w, dst_size->h,
+	     ctx->bandc, ctx->bandc == 1 ? "" : "s");
+
+ out:
+	if (err)
+		mem_deref(ctx);
+	else
+		*ctxp = ctx;
+
+	return err;
+}
+
+
+static struct swscale_ctx *ctx_lookup(struct swscale_enc *enc,
+				      const struct vidframe *frame)
+{
+	struct le *le;
+
+	for (le = list_head(&enc->ctxl); le; le = le->next) {
+
+		struct swscale_ctx *ctx = le->data;
+
+		if (ctx->src_fmt != frame->fmt ||
+		    ctx->dst_fmt != enc->dst_fmt ||
+		    !vidsz_cmp(&ctx->src_size, &frame->size) ||
+		    !vidsz_cmp(&ctx->dst_size, &enc->dst_size))
+			continue;
+
+		/* keep the most recently used first */
+		if (le != list_head(&enc->ctxl)) {
+			list_unlink(le);
+			list_prepend(&enc->ctxl, le, ctx);
+		}
+
+		return ctx;
+	}
+
+	return NULL;
+}
+
+
+static void plane_offset(uint8_t *datav[4], int linesizev[4],
+			 const struct vidframe *frame, unsigned y)
+{
+	const unsigned vshift = vidfmt_vshift(frame->fmt);
+	unsigned i;
+
+	for (i=0; i<4; i++) {
+
+		const unsigned row = i ? y >> vshift : y;
+
+		datav[i]     = frame->data[i];
+		linesizev[i] = frame->linesize[i];
+
+		if (datav[i])
+			datav[i] += (size_t)row * frame->linesize[i];
+	}
+}
+
+
+static int band_scale(const struct band *b, const struct vidframe *src,
+		      struct vidframe *dst)
+{
+	uint8_t *srcv[4], *dstv[4];
+	int src_stride[4], dst_stride[4];
+	int h;
+
+	plane_offset(srcv, src_stride, src, b->src_y);
+	plane_offset(dstv, dst_stride, dst, b->dst_y);
+
+	h = sws_scale(b->sws, (const uint8_t * const *)srcv, src_stride,
+		      0, b->src_h, dstv, dst_stride);
+	if (h <= 0) {
+		warning("swscale: sws_scale error (%d)\n", h);
+		return EPROTO;
+	}
+
+	return 0;
+}
+
+
+#ifdef HAVE_PTHREAD
+/* scale the remaining bands of the current job, with the mutex held */
+static void job_run(struct swscale_enc *enc)
+{
+	while (enc->pool.ctx && enc->pool.next < enc->pool.ctx->bandc) {
+
+		const struct band *b = &enc->pool.ctx->bandv[enc->pool.next++];
+		int err;
+
+		pthread_mutex_unlock(&enc->pool.mutex);
+
+		err = band_scale(b, enc->pool.src, enc->pool.dst);
+
+		pthread_mutex_lock(&enc->pool.mutex);
+
+		if (err)
+			enc->pool.err = err;
+
+		if (--enc->pool.pending == 0)
+			pthread_cond_signal(&enc->pool.cond_done);
+	}
+}
+
+
+static void *worker_thread(void *arg)
+{
+	struct swscale_enc *enc = arg;
+	uint64_t gen = 0;
+
+	(void)realtime_thread_setup(REALTIME_THREAD_VIDEO, "swscale");
+
+	pthread_mutex_lock(&enc->pool.mutex);
+
+	for (;;) {
+
+		while (enc->pool.run && enc->pool.gen == gen)
+			pthread_cond_wait(&enc->pool.cond, &enc->pool.mutex);
+
+		if (!enc->pool.run)
+			break;
+
+		gen = enc->pool.gen;
+
+		job_run(enc);
+	}
+
+	pthread_mutex_unlock(&enc->pool.mutex);
+
+	return NULL;
+}
+
+
+static void pool_stop(struct swscale_enc *enc)
+{
+	unsigned i;
+
+	pthread_mutex_lock(&enc->pool.mutex);
+	enc->pool.run = false;
+	pthread_cond_broadcast(&enc->pool.cond);
+	pthread_mutex_unlock(&enc->pool.mutex);
+
+	for (i=0; i<enc->pool.tidc; i++)
+		pthread_join(enc->pool.tidv[i], NULL);
+
+	enc->pool.tidc = 0;
+}
+
+
+static void pool_start(struct swscale_enc *enc, unsigned n)
+{
+	enc->pool.run = true;
+
+	while (enc->pool.tidc < n) {
+
+		int err;
+
+		err = pthread_create(&enc->pool.tidv[enc->pool.tidc], NULL,
+				     worker_thread, enc);
+		if (err) {
+			warning("swscale: could not start thread (%m)\n",
+				err);
+			break;
+		}
+
+		++enc->pool.tidc;
+	}
+
+	debug("swscale: started %u worker thread%s\n",
+	      enc->pool.tidc, enc->pool.tidc == 1 ? "" : "s");
+}
+#endif
+
+
+/* the calling thread scales bands alongside the workers */
+static int frame_scale(struct swscale_enc *enc, const struct swscale_ctx *ctx,
+		       const struct vidframe *src, struct vidframe *dst)
+{
+	unsigned i;
+	int err = 0;
+
+#ifdef HAVE_PTHREAD
+	if (ctx->bandc > 1) {
+
+		if (!enc->pool.run)
+			pool_start(enc, enc->threads - 1);
+
+		if (enc->pool.tidc) {
+
+			pthread_mutex_lock(&enc->pool.mutex);
+
+			enc->pool.ctx     = ctx;
+			enc->pool.src     = src;
+			enc->pool.dst     = dst;
+			enc->pool.next    = 0;
+			enc->pool.pending = ctx->bandc;
+			enc->pool.err     = 0;
+			++enc->pool.gen;
+
+			pthread_cond_broadcast(&enc->pool.cond);
+
+			job_run(enc);
+
+			while (enc->pool.pending)
+				pthread_cond_wait(&enc->pool.cond_done,
+						  &enc->pool.mutex);
+
+			err = enc->pool.err;
+			enc->pool.ctx = NULL;
+
+			pthread_mutex_unlock(&enc->pool.mutex);
+
+			return err;
+		}
+	}
+#else
+	(void)enc;
+#endif
+
+	for (i=0; i<ctx->bandc && !err; i++)
+		err = band_scale(&ctx->bandv[i], src, dst);
+
+	return err;
+}
+
+
+static void enc_destructor(void *arg)
 {
 	struct swscale_enc *st = arg;
 
 	list_unlink(&st->vf.le);
 
+#ifdef HAVE_PTHREAD
+	if (st->pool.init) {
+		pool_stop(st);
+		pthread_cond_destroy(&st->pool.cond_done);
+		pthread_cond_destroy(&st->pool.cond);
+		pthread_mutex_destroy(&st->pool.mutex);
+	}
+#endif
+
+	list_flush(&st->ctxl);
 	mem_deref(st->frame);
-	sws_freeContext(st->sws);
+}
+
+
+static int enc_alloc(struct swscale_enc **encp, enum vidfmt fmt,
+		     const struct vidsz *size, unsigned threads)
+{
+	struct swscale_enc *enc;
+	int err = 0;
+
+	enc = mem_zalloc(sizeof(*enc), enc_destructor);
+	if (!enc)
+		return ENOMEM;
+
+	if (!threads) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = n > 0 ? (unsigned)n : 1;
+	}
+
+	enc->dst_fmt  = fmt;
+	enc->dst_size = *size;
+	enc->threads  = min(threads, (unsigned)MAX_BANDS);
+
+#ifndef HAVE_PTHREAD
+	enc->threads  = 1;
+#else
+	err = pthread_mutex_init(&enc->pool.mutex, NULL);
+	if (err)
+		goto out;
+
+	err = pthread_cond_init(&enc->pool.cond, NULL);
+	if (err) {
+		pthread_mutex_destroy(&enc->pool.mutex);
+		goto out;
+	}
+
+	err = pthread_cond_init(&enc->pool.cond_done, NULL);
+	if (err) {
+		pthread_cond_destroy(&enc->pool.cond);
+		pthread_mutex_destroy(&enc->pool.mutex);
+		goto out;
+	}
+
+	enc->pool.init = true;
+
+ out:
+#endif
+	if (err)
+		mem_deref(enc);
+	else
+		*encp = enc;
+
+	return err;
 }
 
 
 static int encode_update(struct vidfilt_enc_st **stp, void **ctx,
 			 const struct vidfilt *vf)
 {
-	struct swscale_enc *st;
+	struct swscale_enc *st = NULL;
 	struct config *config = conf_config();
-	int err = 0;
+	struct vidsz size;
+	int err;
 
 	if (!config) {
 		warning("swscale: no config\n");
@@ -63,31 +584,24 @@ static int encode_update(struct vidfilt_enc_st **stp, void **ctx,
 	if (*stp)
 		return 0;
 
-	st = mem_zalloc(sizeof(*st), encode_destructor);
-	if (!st)
-		return ENOMEM;
-
-	st->dst_size.w = config->video.width;
-	st->dst_size.h = config->video.height;
+	size.w = config->video.width;
+	size.h = config->video.height;
 
+	err = enc_alloc(&st, swscale_format, &size, swscale_threads);
 	if (err)
-		mem_deref(st);
-	else
-		*stp = (struct vidfilt_enc_st *)st;
+		return err;
 
-	return err;
+	*stp = (struct vidfilt_enc_st *)st;
+
+	return 0;
 }
 
 
 static int encode_process(struct vidfilt_enc_st *st, struct vidframe *frame)
 {
 	struct swscale_enc *enc = (struct swscale_enc *)st;
-	enum AVPixelFormat avpixfmt, avpixfmt_dst;
-	const uint8_t *srcSlice[4];
-	uint8_t *dst[4];
-	int srcStride[4], dstStride[4];
-	int width, height, i, h;
-	int err = 0;
+	struct swscale_ctx *ctx;
+	int i, err = 0;
 
 	if (!st)
 		return EINVAL;
@@ -95,69 +609,38 @@ static int encode_process(struct vidfilt_enc_st *st, struct vidframe *frame)
 	if (!frame)
 		return 0;
 
-	width = frame->size.w;
-	height = frame->size.h;
-
-	avpixfmt = vidfmt_to_avpixfmt(frame->fmt);
-	if (avpixfmt == AV_PIX_FMT_NONE) {
-		warning("swscale: unknown pixel-format (%s)\n",
-			vidfmt_name(frame->fmt));
-		return EINVAL;
-	}
-
-	avpixfmt_dst = vidfmt_to_avpixfmt(swscale_format);
-	if (avpixfmt_dst == AV_PIX_FMT_NONE) {
-		warning("swscale: unknown pixel-format (%s)\n",
-			vidfmt_name(swscale_format));
-		return EINVAL;
-	}
-
-	if (!enc->sws) {
+	/* nothing to do */
+	if (frame->fmt == enc->dst_fmt &&
+	    vidsz_cmp(&frame->size, &enc->dst_size))
+		return 0;
 
-		struct SwsContext *sws;
-		int flags = 0;
+	ctx = ctx_lookup(enc, frame);
+	if (!ctx) {
 
-		sws = sws_getContext(width, height, avpixfmt,
-				     enc->dst_size.w, enc->dst_size.h,
-				     avpixfmt_dst,
-				     flags, NULL, NULL, NULL);
-		if (!sws) {
-			warning("swscale: sws_getContext error\n");
-			return ENOMEM;
-		}
+		err = ctx_alloc(&ctx, frame, enc->dst_fmt, &enc->dst_size,
+				enc->threads);
+		if (err)
+			return err;
 
-		enc->sws = sws;
+		list_prepend(&enc->ctxl, &ctx->le, ctx);
 
-		info("swscale: created SwsContext:"
-		     " `%s' %d x %d --> `%s' %u x %u\n",
-		     vidfmt_name(frame->fmt), width, height,
-		     vidfmt_name(swscale_format),
-		     enc->dst_size.w, enc->dst_size.h);
+		if (list_count(&enc->ctxl) > CACHE_SIZE)
+			mem_deref(list_ledata(list_tail(&enc->ctxl)));
 	}
 
-	if (!enc->frame) {
+	/* the previous output frame has been consumed by now */
+	enc->frame = mem_deref(enc->frame);
 
-		err = vidframe_alloc(&enc->frame, swscale_format,
-				     &enc->dst_size);
-		if (err) {
-			warning("swscale: vidframe_alloc error (%m)\n", err);
-			return err;
-		}
-	}
-
-	for (i=0; i<4; i++) {
-		srcSlice[i]  = frame->data[i];
-		srcStride[i] = frame->linesize[i];
-		dst[i]       = enc->frame->data[i];
-		dstStride[i] = enc->frame->linesize[i];
+	err = vidpool_get(baresip_vidpool(), &enc->frame, enc->dst_fmt,
+			  &enc->dst_size);
+	if (err) {
+		warning("swscale: could not get frame (%m)\n", err);
+		return err;
 	}
 
-	h = sws_scale(enc->sws, srcSlice, srcStride,
-		      0, height, dst, dstStride);
-	if (h <= 0) {
-		warning("swscale: sws_scale error (%d)\n", h);
-		return EPROTO;
-	}
+	err = frame_scale(enc, ctx, frame, enc->frame);
+	if (err)
+		return err;
 
 	/* Copy the converted frame back to the input frame */
 	for (i=0; i<4; i++) {
@@ -176,15 +659,148 @@ static struct vidfilt vf_swscale = {
 };
 
 
+static int bench_run(struct re_printf *pf, enum vidfmt src_fmt,
+		     const struct vidsz *src_size,
+		     const struct vidsz *dst_size, unsigned threads)
+{
+	struct swscale_enc *enc = NULL;
+	struct vidframe *src = NULL, frame;
+	uint64_t t0, t1, dur;
+	unsigned i;
+	int err;
+
+	err  = enc_alloc(&enc, swscale_format, dst_size, threads);
+	err |= vidframe_alloc(&src, src_fmt, src_size);
+	if (err)
+		goto out;
+
+	vidframe_fill(src, 0x40, 0x80, 0xc0);
+
+	/* create the contexts and threads before timing */
+	frame = *src;
+	err = encode_process(&enc->vf, &frame);
+	if (err)
+		goto out;
+
+	t0 = tmr_jiffies_usec();
+
+	for (i=0; i<BENCH_FRAMES && !err; i++) {
+		frame = *src;
+		err = encode_process(&enc->vf, &frame);
+	}
+
+	t1 = tmr_jiffies_usec();
+
+	if (err)
+		goto out;
+
+	dur = max(t1 - t0, 1ULL);
+
+	err = re_hprintf(pf, "  %s %4u x %4u --> %s %4u x %4u"
+			 "  %2u thread%s  %7.2f ms/frame  %7.1f fps\n",
+			 vidfmt_name(src_fmt), src_size->w, src_size->h,
+			 vidfmt_name(swscale_format), dst_size->w, dst_size->h,
+			 enc->threads, enc->threads == 1 ? " " : "s",
+			 (double)dur / BENCH_FRAMES / 1000.0,
+			 BENCH_FRAMES * 1000000.0 / (double)dur);
+
+ out:
+	if (err)
+		(void)re_hprintf(pf, "swscale: bench failed (%m)\n", err);
+
+	mem_deref(src);
+	mem_deref(enc);
+
+	return err;
+}
+
+
+/* note: blocks the main thread while it runs */
+static int cmd_bench(struct re_printf *pf, void *arg)
+{
+	static const struct vidsz sizev[][2] = {
+		{{1280,  720}, {1280,  720}},
+		{{1920, 1080}, {1280,  720}},
+		{{1920, 1080}, {1920, 1080}},
+	};
+	const enum vidfmt src_fmt = swscale_format == VID_FMT_NV12
+		? VID_FMT_YUV420P : VID_FMT_NV12;
+	unsigned i;
+	int err = 0;
+	(void)arg;
+
+	err |= re_hprintf(pf, "swscale benchmark (%u frames each):\n",
+			  BENCH_FRAMES);
+
+	for (i=0; i<ARRAY_SIZE(sizev) && !err; i++) {
+
+		err = bench_run(pf, src_fmt, &sizev[i][0], &sizev[i][1], 1);
+		if (err)
+			break;
+
+		if (swscale_threads != 1) {
+			err = bench_run(pf, src_fmt, &sizev[i][0],
+					&sizev[i][1], swscale_threads);
+		}
+	}
+
+	return err;
+}
+
+
+static const struct cmd cmdv[] = {
+	{"swscale_bench", 0, 0, "Benchmark video scaling", cmd_bench},
+};
+
+
 static int module_init(void)
 {
+	char buf[32];
+	size_t i;
+
+	if (0 == conf_get_str(conf_cur(), "swscale_format",
+			      buf, sizeof(buf))) {
+
+		for (i=0; i<ARRAY_SIZE(fmtv); i++) {
+			if (0 == str_casecmp(buf, vidfmt_name(fmtv[i])))
+				break;
+		}
+
+		if (i == ARRAY_SIZE(fmtv)) {
+			warning("swscale: unsupported format '%s'\n", buf);
+			return EINVAL;
+		}
+
+		swscale_format = fmtv[i];
+	}
+
+	if (0 == conf_get_str(conf_cur(), "swscale_algorithm",
+			      buf, sizeof(buf))) {
+
+		for (i=0; i<ARRAY_SIZE(algov); i++) {
+			if (0 == str_casecmp(buf, algov[i].name))
+				break;
+		}
+
+		if (i == ARRAY_SIZE(algov)) {
+			warning("swscale: unknown algorithm '%s'\n", buf);
+			return EINVAL;
+		}
+
+		swscale_flags = algov[i].flags;
+	}
+
+	(void)conf_get_u32(conf_cur(), "swscale_threads", &swscale_threads);
+
 	vidfilt_register(baresip_vidfiltl(), &vf_swscale);
-	return 0;
+
+	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
 }
 
 
 static int module_close(void)
 {
+	cmd_unregister(baresip_commands(), cmdv);
 	vidfilt_unregister(&vf_swscale);
 	return 0;
 }
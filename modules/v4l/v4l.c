@@ -132,6 +132,8 @@ static void *read_thread(void *arg)
 {
 	struct vidsrc_st *st = arg;
 
+	(void)realtime_thread_setup(REALTIME_THREAD_VIDEO, "v4l");
+
 	while (st->run) {
 		ssize_t n;
 		uint64_t timestamp;
@@ -447,6 +447,8 @@ static void *read_thread(void *arg)
 	struct vidsrc_st *st = arg;
 	int err;
 
+	(void)realtime_thread_setup(REALTIME_THREAD_VIDEO, "v4l2");
+
 	while (st->run) {
 		err = read_frame(st);
 		if (err) {
@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -13,10 +14,8 @@ static void destructor(void *arg)
 {
 	struct vidisp_st *st = arg;
 
-	if (st->vidsrc)
-		st->vidsrc->vidisp = NULL;
-
 	list_unlink(&st->le);
+	vidbridge_frame_release(st->frame);
 	mem_deref(st->device);
 }
 
@@ -44,12 +43,6 @@ int vidbridge_disp_alloc(struct vidisp_st **stp, const struct vidisp *vd,
 	if (err)
 		goto out;
 
-	/* find the vidsrc with the same device-name */
-	st->vidsrc = vidbridge_src_find(dev);
-	if (st->vidsrc) {
-		st->vidsrc->vidisp = st;
-	}
-
 	hash_append(ht_disp, hash_joaat_str(dev), &st->le, st);
 
  out:
@@ -62,33 +55,57 @@ int vidbridge_disp_alloc(struct vidisp_st **stp, const struct vidisp *vd,
 }
 
 
-static bool list_apply_handler(struct le *le, void *arg)
+/*
+ * The decoded frame is only valid during the display call, so it is
+ * copied once into a frame that is shared by reference with all the
+ * sources of the same name. The copy is reused once every source has
+ * released it.
+ */
+static struct vidframe *frame_get(struct vidisp_st *st,
+				  const struct vidframe *src)
 {
-	struct vidisp_st *st = le->data;
+	struct vidframe *f = st->frame;
+
+	if (f && (f->fmt != src->fmt || !vidsz_cmp(&f->size, &src->size))) {
+		vidbridge_frame_release(f);
+		st->frame = NULL;
+	}
+	else {
+		vidbridge_frame_release_inuse(&st->frame);
+	}
+
+	if (!st->frame && vidframe_alloc(&st->frame, src->fmt, &src->size))
+		return NULL;
+
+	vidframe_copy(st->frame, src);
 
-	return 0 == str_cmp(st->device, arg);
+	return st->frame;
 }
 
 
 int vidbridge_disp_display(struct vidisp_st *st, const char *title,
 			   const struct vidframe *frame)
 {
-	int err = 0;
+	struct vidframe *f;
+	uint64_t ts;
 	(void)title;
 
-	if (st->vidsrc)
-		vidbridge_src_input(st->vidsrc, frame);
-	else {
+	if (!st || !frame)
+		return EINVAL;
+
+	if (!vidbridge_src_exists(st->device)) {
 		debug("vidbridge: display: dropping frame (%u x %u)\n",
 		      frame->size.w, frame->size.h);
+		return 0;
 	}
 
-	return err;
-}
+	f = frame_get(st, frame);
+	if (!f)
+		return ENOMEM;
 
+	ts = tmr_jiffies_usec() * VIDEO_TIMEBASE / 1000000;
 
-struct vidisp_st *vidbridge_disp_find(const char *device)
-{
-	return list_ledata(hash_lookup(ht_disp, hash_joaat_str(device),
-				       list_apply_handler, (void *)device));
+	(void)vidbridge_src_input(st->device, f, ts);
+
+	return 0;
 }
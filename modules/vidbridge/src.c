@@ -3,20 +3,121 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
 #include "vidbridge.h"
 
 
-static void destructor(void *arg)
+/*
+ * Each source has a slot holding a reference to the latest frame, and
+ * its own thread that feeds the slot into the encoder. The display side
+ * only swaps the slot, so a slow encoder drops frames instead of
+ * stalling the decoder, and one frame can be shared by many sources.
+ *
+ * The encode filters work in place on the frame they are given, so the
+ * source thread copies the shared frame into a private frame first.
+ *
+ * The reference count of a memory object is not atomic, so references
+ * to shared frames are only taken and released with ref_mutex held.
+ * The list of sources is protected by the same mutex.
+ */
+
+
+static pthread_mutex_t ref_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* copy a shared frame into the private frame of a source */
+static int frame_copy(struct vidsrc_st *st, const struct vidframe *frame)
+{
+	struct vidframe *f = st->frame_enc;
+
+	if (f && (f->fmt != frame->fmt || !vidsz_cmp(&f->size, &frame->size)))
+		st->frame_enc = mem_deref(st->frame_enc);
+
+	if (!st->frame_enc) {
+		int err = vidframe_alloc(&st->frame_enc, frame->fmt,
+					 &frame->size);
+		if (err)
+			return err;
+	}
+
+	vidframe_copy(st->frame_enc, frame);
+
+	return 0;
+}
+
+
+static void *src_thread(void *arg)
 {
 	struct vidsrc_st *st = arg;
 
-	if (st->vidisp)
-		st->vidisp->vidsrc = NULL;
+	(void)realtime_thread_setup(REALTIME_THREAD_VIDEO, "vidbridge");
+
+	pthread_mutex_lock(&st->mutex);
+
+	while (st->run) {
+
+		struct vidframe *frame;
+		uint64_t timestamp;
+
+		if (!st->frame) {
+			pthread_cond_wait(&st->cond, &st->mutex);
+			continue;
+		}
 
+		frame     = st->frame;
+		timestamp = st->timestamp;
+		st->frame = NULL;
+
+		pthread_mutex_unlock(&st->mutex);
+
+		if (!frame_copy(st, frame)) {
+			vidbridge_frame_release(frame);
+			st->frameh(st->frame_enc, timestamp, st->arg);
+		}
+		else {
+			vidbridge_frame_release(frame);
+		}
+
+		pthread_mutex_lock(&st->mutex);
+
+		++st->stats.frames;
+	}
+
+	pthread_mutex_unlock(&st->mutex);
+
+	return NULL;
+}
+
+
+static void destructor(void *arg)
+{
+	struct vidsrc_st *st = arg;
+
+	/* vidbridge_src_input() walks the sources with ref_mutex held */
+	pthread_mutex_lock(&ref_mutex);
 	list_unlink(&st->le);
+	pthread_mutex_unlock(&ref_mutex);
+
+	if (st->run) {
+		pthread_mutex_lock(&st->mutex);
+		st->run = false;
+		pthread_cond_signal(&st->cond);
+		pthread_mutex_unlock(&st->mutex);
+
+		pthread_join(st->thread, NULL);
+
+		info("vidbridge: source '%s': %llu frames, %llu dropped\n",
+		     st->device, st->stats.frames, st->stats.dropped);
+	}
+
+	pthread_cond_destroy(&st->cond);
+	pthread_mutex_destroy(&st->mutex);
+
+	vidbridge_frame_release(st->frame);
+	mem_deref(st->frame_enc);
 	mem_deref(st->device);
 }
 
@@ -43,19 +144,27 @@ int vidbridge_src_alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 	st->vs     = vs;
 	st->frameh = frameh;
 	st->arg    = arg;
-	st->fps    = prm->fps;
+
+	err  = pthread_mutex_init(&st->mutex, NULL);
+	err |= pthread_cond_init(&st->cond, NULL);
+	if (err)
+		goto out;
 
 	err = str_dup(&st->device, dev);
 	if (err)
 		goto out;
 
-	/* find a vidisp device with same name */
-	st->vidisp = vidbridge_disp_find(dev);
-	if (st->vidisp) {
-		st->vidisp->vidsrc = st;
+	st->run = true;
+	err = pthread_create(&st->thread, NULL, src_thread, st);
+	if (err) {
+		st->run = false;
+		goto out;
 	}
 
+	/* all sources with the same device-name get the display frames */
+	pthread_mutex_lock(&ref_mutex);
 	hash_append(ht_src, hash_joaat_str(dev), &st->le, st);
+	pthread_mutex_unlock(&ref_mutex);
 
  out:
 	if (err)
@@ -75,22 +184,108 @@ static bool list_apply_handler(struct le *le, void *arg)
 }
 
 
-struct vidsrc_st *vidbridge_src_find(const char *device)
+/**
+ * Check if there is a source with a given device-name
+ *
+ * @param device Device name
+ *
+ * @return True if found, otherwise false
+ */
+bool vidbridge_src_exists(const char *device)
+{
+	struct le *le;
+
+	pthread_mutex_lock(&ref_mutex);
+	le = hash_lookup(ht_src, hash_joaat_str(device),
+			 list_apply_handler, (void *)device);
+	pthread_mutex_unlock(&ref_mutex);
+
+	return le != NULL;
+}
+
+
+/**
+ * Pass a frame to all sources with a given device-name. Each source
+ * takes a reference to the frame, replacing any frame not yet encoded.
+ *
+ * @param device    Device name
+ * @param frame     Video frame, allocated with mem_alloc
+ * @param timestamp Frame timestamp in VIDEO_TIMEBASE units
+ *
+ * @return Number of sources that got the frame
+ */
+unsigned vidbridge_src_input(const char *device, struct vidframe *frame,
+			     uint64_t timestamp)
+{
+	struct le *le;
+	unsigned n = 0;
+
+	if (!device || !frame)
+		return 0;
+
+	pthread_mutex_lock(&ref_mutex);
+
+	le = list_head(hash_list(ht_src, hash_joaat_str(device)));
+	for (; le; le = le->next) {
+		struct vidsrc_st *st = le->data;
+		struct vidframe *old;
+
+		if (str_cmp(st->device, device))
+			continue;
+
+		pthread_mutex_lock(&st->mutex);
+
+		old = st->frame;
+		st->frame     = mem_ref(frame);
+		st->timestamp = timestamp;
+
+		if (old)
+			++st->stats.dropped;
+
+		pthread_cond_signal(&st->cond);
+		pthread_mutex_unlock(&st->mutex);
+
+		mem_deref(old);
+		++n;
+	}
+
+	pthread_mutex_unlock(&ref_mutex);
+
+	return n;
+}
+
+
+/**
+ * Release a reference to a shared frame
+ *
+ * @param frame Video frame, may be NULL
+ */
+void vidbridge_frame_release(struct vidframe *frame)
 {
-	return list_ledata(hash_lookup(ht_src, hash_joaat_str(device),
-				       list_apply_handler, (void *)device));
+	if (!frame)
+		return;
+
+	pthread_mutex_lock(&ref_mutex);
+	mem_deref(frame);
+	pthread_mutex_unlock(&ref_mutex);
 }
 
 
-void vidbridge_src_input(struct vidsrc_st *st,
-			 const struct vidframe *frame)
+/**
+ * Release a frame if it is still referenced by a source. The check and
+ * the release are done under the same lock.
+ *
+ * @param framep Pointer to the video frame, set to NULL if released
+ */
+void vidbridge_frame_release_inuse(struct vidframe **framep)
 {
-	if (!st || !frame)
+	if (!framep || !*framep)
 		return;
 
-	/* XXX: Read from vidisp input */
-	st->timestamp += VIDEO_TIMEBASE / st->fps;
+	pthread_mutex_lock(&ref_mutex);
+
+	if (mem_nrefs(*framep) > 1)
+		*framep = mem_deref(*framep);
 
-	if (st->frameh)
-		st->frameh((struct vidframe *)frame, st->timestamp, st->arg);
+	pthread_mutex_unlock(&ref_mutex);
 }
@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -18,6 +19,12 @@
  * so that all output to VIDISP device is bridged as the input to
  * a VIDSRC device.
  *
+ * Several VIDSRC devices can use the same name, they all share one
+ * copy of each displayed frame. Every source feeds the encoder from its
+ * own thread and keeps only the latest frame, so a slow encoder drops
+ * frames instead of blocking the display. Each source thread encodes
+ * its own copy of the frame, as the encode video filters modify it.
+ *
  * Sample config:
  *
  \verbatim
@@ -9,12 +9,24 @@ struct vidsrc_st {
 	const struct vidsrc *vs;  /* inheritance (1st) */
 
 	struct le le;
-	struct vidisp_st *vidisp;
-	uint64_t timestamp;
-	double fps;
 	char *device;
 	vidsrc_frame_h *frameh;
 	void *arg;
+
+	/* latest-frame slot, drained by the source thread */
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct vidframe *frame;   /**< Pending frame, referenced         */
+	uint64_t timestamp;       /**< Timestamp of the pending frame    */
+	bool run;
+
+	struct vidframe *frame_enc; /**< Private copy for the encoder    */
+
+	struct {
+		uint64_t frames;  /**< Frames passed to the encoder      */
+		uint64_t dropped; /**< Frames replaced before encoding   */
+	} stats;
 };
 
 
@@ -22,8 +34,8 @@ struct vidisp_st {
 	const struct vidisp *vd;  /* inheritance (1st) */
 
 	struct le le;
-	struct vidsrc_st *vidsrc;
 	char *device;
+	struct vidframe *frame;   /**< Shared copy of the last frame     */
 };
 
 
@@ -36,7 +48,6 @@ int vidbridge_disp_alloc(struct vidisp_st **stp, const struct vidisp *vd,
 			 vidisp_resize_h *resizeh, void *arg);
 int vidbridge_disp_display(struct vidisp_st *st, const char *title,
 			   const struct vidframe *frame);
-struct vidisp_st *vidbridge_disp_find(const char *device);
 
 
 int vidbridge_src_alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
@@ -44,6 +55,8 @@ int vidbridge_src_alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 			const struct vidsz *size, const char *fmt,
 			const char *dev, vidsrc_frame_h *frameh,
 			vidsrc_error_h *errorh, void *arg);
-struct vidsrc_st *vidbridge_src_find(const char *device);
-void vidbridge_src_input(struct vidsrc_st *st,
-			 const struct vidframe *frame);
+bool vidbridge_src_exists(const char *device);
+unsigned vidbridge_src_input(const char *device, struct vidframe *frame,
+			     uint64_t timestamp);
+void vidbridge_frame_release(struct vidframe *frame);
+void vidbridge_frame_release_inuse(struct vidframe **framep);
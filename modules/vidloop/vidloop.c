@@ -83,9 +83,14 @@ struct video_loop {
 		uint64_t src_frames;
 		uint64_t enc_bytes;
 		uint64_t enc_packets;
+		uint64_t enc_frames_in;
+		uint64_t enc_frames_out;
+		uint64_t enc_delay_max;  /* frames */
 		uint64_t disp_frames;
 	} stats;
 
+	struct lathist enc_time;        /* usec per encoded frame */
+
 	struct timestamp_state ts_src;
 	struct timestamp_state ts_rtp;
 };
@@ -174,8 +179,8 @@ static int display(struct video_loop *vl, struct vidframe *frame)
 		 */
 		if (!frame_filt) {
 
-			err = vidframe_alloc(&frame_filt, frame->fmt,
-					     &frame->size);
+			err = vidpool_get(baresip_vidpool(), &frame_filt,
+					  frame->fmt, &frame->size);
 			if (err)
 				return err;
 
@@ -230,6 +235,9 @@ static int packet_handler(bool marker, uint64_t rtp_ts,
 	++vl->stats.enc_packets;
 	vl->stats.enc_bytes += (hdr_len + pld_len);
 
+	if (marker)
+		++vl->stats.enc_frames_out;
+
 	timestamp_state_update(&vl->ts_rtp, rtp_ts);
 
 	mb = mbuf_alloc(hdr_len + pld_len);
@@ -303,7 +311,8 @@ static void vidsrc_frame_handler(struct vidframe *frame, uint64_t timestamp,
 			vl->need_conv = true;
 		}
 
-		if (vidframe_alloc(&f2, vl->cfg.enc_fmt, &frame->size))
+		if (vidpool_get(baresip_vidpool(), &f2, vl->cfg.enc_fmt,
+				&frame->size))
 			return;
 
 		vidconv(f2, frame, 0);
@@ -322,7 +331,18 @@ static void vidsrc_frame_handler(struct vidframe *frame, uint64_t timestamp,
 
 	if (vl->vc_enc && vl->enc) {
 
+		const uint64_t t0 = tmr_jiffies_usec();
+		uint64_t delay;
+
 		err = vl->vc_enc->ench(vl->enc, false, frame, timestamp);
+
+		lathist_add(&vl->enc_time, tmr_jiffies_usec() - t0);
+		++vl->stats.enc_frames_in;
+
+		/* frames held back by the encoder, e.g. by frame threads */
+		delay = vl->stats.enc_frames_in - vl->stats.enc_frames_out;
+		vl->stats.enc_delay_max = max(vl->stats.enc_delay_max, delay);
+
 		if (err) {
 			warning("vidloop: encoder error (%m)\n", err);
 			goto out;
@@ -419,12 +439,23 @@ static int print_stats(struct re_printf *pf, const struct video_loop *vl)
 				  "  bitrate     %u bit/s (avg %.1f bit/s)\n"
 				  "  packets     %llu     (avg %.1f pkt/s)\n"
 				  "  duration    %.3f sec\n"
+				  "  frames      %llu in, %llu out"
+				  " (max delay %llu frames)\n"
+				  "  encode      avg %.2f ms, p50 %.2f ms,"
+				  " p95 %.2f ms, max %.2f ms\n"
 				  "\n"
 				  ,
 				  vl->vc_enc->name,
 				  cfg->bitrate, avg_bitrate,
 				  vl->stats.enc_packets, avg_pktrate,
-				  dur);
+				  dur,
+				  vl->stats.enc_frames_in,
+				  vl->stats.enc_frames_out,
+				  vl->stats.enc_delay_max,
+				  lathist_mean(&vl->enc_time) * .001,
+				  lathist_percentile(&vl->enc_time, 50) * .001,
+				  lathist_percentile(&vl->enc_time, 95) * .001,
+				  vl->enc_time.max * .001);
 	}
 
 	/* Decoder */
@@ -539,7 +570,7 @@ static void print_status(struct video_loop *vl)
 	(void)re_fprintf(stdout,
 			 "\rstatus:"
 			 " %.3f sec [%s] [%s]  fmt=%s  intra=%zu "
-			 " EFPS=%.1f      %u kbit/s       \r",
+			 " EFPS=%.1f  enc=%.2fms  %u kbit/s       \r",
 			 timestamp_state_duration(&vl->ts_src,
 						  VIDEO_TIMEBASE),
 
@@ -547,7 +578,8 @@ static void print_status(struct video_loop *vl)
 			 vl->vc_dec ? vl->vc_dec->name : "",
 			 vidfmt_name(vl->cfg.enc_fmt),
 			 vl->stat.n_intra,
-			 vl->stat.efps, vl->stat.bitrate);
+			 vl->stat.efps, lathist_mean(&vl->enc_time) * .001,
+			 vl->stat.bitrate);
 	fflush(stdout);
 }
 
@@ -190,7 +190,8 @@ static int draw_text_osd(struct panel *panel, struct vidframe *frame)
 	vidframe_init_buf(&f, VID_FMT_RGB32, &panel->size_text,
 			  cairo_image_surface_get_data(panel->surface));
 
-	err = vidframe_alloc(&f2, frame->fmt, &panel->size_text);
+	err = vidpool_get(baresip_vidpool(), &f2, frame->fmt,
+			  &panel->size_text);
 	if (err)
 		goto out;
 
@@ -8,6 +8,7 @@
 #define _BSD_SOURCE 1
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -25,6 +26,19 @@
 #include "magic.h"
 
 
+/** Deadline-based TX thread needs clock_nanosleep() */
+#if defined (HAVE_PTHREAD) && defined (LINUX)
+#define AUDIO_TX_TIMER 1
+#endif
+
+
+enum {
+	TX_IDLE_USEC   = 4000,  /**< Wait interval before aubuf started */
+	TX_LATE_USEC   = 1000,  /**< Send is counted as late after this */
+	TX_MAX_CATCHUP = 4,     /**< Max packets behind before skipping */
+};
+
+
 /**
  * \page GenericAudioStream Generic Audio Stream
  *
@@ -80,6 +94,7 @@ struct autx {
 	const struct aucodec *ac;     /**< Current audio encoder           */
 	struct auenc_state *enc;      /**< Audio encoder state (optional)  */
 	struct aubuf *aubuf;          /**< Packetize outgoing stream       */
+	struct auring *ring;          /**< Lock-free ring, replaces aubuf  */
 	size_t aubuf_maxsz;           /**< Maximum aubuf size in [bytes]   */
 	volatile bool aubuf_started;  /**< Aubuf was started flag          */
 	struct auresamp resamp;       /**< Optional resampler for DSP      */
@@ -99,10 +114,17 @@ struct autx {
 	enum aufmt src_fmt;           /**< Sample format for audio source  */
 	enum aufmt enc_fmt;           /**< Sample format for encoder       */
 	bool need_conv;               /**< Sample format conversion needed */
+	void *sampv_conv;             /**< Scratch buffer for conversion   */
+	size_t sampv_conv_sz;         /**< Conversion buffer size [bytes]  */
 
 	struct {
 		uint64_t aubuf_overrun;
 		uint64_t aubuf_underrun;
+		uint64_t conv_frames;
+		uint64_t conv_alloc;
+		uint64_t tx_late;      /**< Sends later than TX_LATE_USEC */
+		uint64_t tx_skip;      /**< Packet periods skipped        */
+		uint64_t tx_late_max;  /**< Max lateness in [us]          */
 	} stats;
 
 #ifdef HAVE_PTHREAD
@@ -111,6 +133,9 @@ struct autx {
 			pthread_t tid;/**< Audio transmit thread           */
 			bool run;     /**< Audio transmit thread running   */
 		} thr;
+		struct {
+			struct txsched_entry *entry; /**< Pool entry */
+		} pool;
 	} u;
 #endif
 };
@@ -137,6 +162,7 @@ struct aurx {
 	const struct aucodec *ac;     /**< Current audio decoder           */
 	struct audec_state *dec;      /**< Audio decoder state (optional)  */
 	struct aubuf *aubuf;          /**< Incoming audio buffer           */
+	struct auring *ring;          /**< Lock-free ring, replaces aubuf  */
 	size_t aubuf_maxsz;           /**< Maximum aubuf size in [bytes]   */
 	volatile bool aubuf_started;  /**< Aubuf was started flag          */
 	struct auresamp resamp;       /**< Optional resampler for DSP      */
@@ -151,12 +177,27 @@ struct aurx {
 	enum aufmt play_fmt;          /**< Sample format for audio playback*/
 	enum aufmt dec_fmt;           /**< Sample format for decoder       */
 	bool need_conv;               /**< Sample format conversion needed */
+	void *sampv_conv;             /**< Scratch buffer for conversion   */
+	size_t sampv_conv_sz;         /**< Conversion buffer size [bytes]  */
 	struct timestamp_recv ts_recv;/**< Receive timestamp state         */
 
+	/** Adaptive jitter buffer */
+	struct {
+		bool enabled;         /**< Adapt the playout delay         */
+		uint64_t level;       /**< Filtered playout delay [us]     */
+		uint64_t target;      /**< Target playout delay [us]       */
+		uint64_t n_accel;     /**< Frames shortened                */
+		uint64_t n_expand;    /**< Frames lengthened               */
+		uint64_t usec_accel;  /**< Playing time removed [us]       */
+		uint64_t usec_expand; /**< Playing time added [us]         */
+	} ajb;
+
 	struct {
 		uint64_t aubuf_overrun;
 		uint64_t aubuf_underrun;
 		uint64_t n_discard;
+		uint64_t conv_frames;
+		uint64_t conv_alloc;
 	} stats;
 };
 
@@ -229,11 +270,18 @@ static void stop_tx(struct autx *tx, struct audio *a)
 
 #ifdef HAVE_PTHREAD
 	case AUDIO_MODE_THREAD:
+#ifdef AUDIO_TX_TIMER
+	case AUDIO_MODE_TIMER:
+#endif
 		if (tx->u.thr.run) {
 			tx->u.thr.run = false;
 			pthread_join(tx->u.thr.tid, NULL);
 		}
 		break;
+
+	case AUDIO_MODE_POOL:
+		tx->u.pool.entry = mem_deref(tx->u.pool.entry);
+		break;
 #endif
 	default:
 		break;
@@ -242,6 +290,7 @@ static void stop_tx(struct autx *tx, struct audio *a)
 	/* audio source must be stopped first */
 	tx->ausrc = mem_deref(tx->ausrc);
 	tx->aubuf = mem_deref(tx->aubuf);
+	tx->ring  = mem_deref(tx->ring);
 
 	list_flush(&tx->filtl);
 }
@@ -255,6 +304,7 @@ static void stop_rx(struct aurx *rx)
 	/* audio player must be stopped first */
 	rx->auplay = mem_deref(rx->auplay);
 	rx->aubuf  = mem_deref(rx->aubuf);
+	rx->ring   = mem_deref(rx->ring);
 
 	list_flush(&rx->filtl);
 }
@@ -270,12 +320,16 @@ static void audio_destructor(void *arg)
 	mem_deref(a->tx.enc);
 	mem_deref(a->rx.dec);
 	mem_deref(a->tx.aubuf);
+	mem_deref(a->tx.ring);
 	mem_deref(a->tx.mb);
 	mem_deref(a->tx.sampv);
 	mem_deref(a->rx.sampv);
 	mem_deref(a->rx.aubuf);
+	mem_deref(a->rx.ring);
 	mem_deref(a->tx.sampv_rs);
 	mem_deref(a->rx.sampv_rs);
+	mem_deref(a->tx.sampv_conv);
+	mem_deref(a->rx.sampv_conv);
 
 	list_flush(&a->tx.filtl);
 	list_flush(&a->rx.filtl);
@@ -345,6 +399,33 @@ static inline uint32_t get_framesize(const struct aucodec *ac,
 }
 
 
+/*
+ * Allocate the scratch buffer used for sample format conversion.
+ * The buffer holds one frame of the largest size handled by the
+ * pipeline, so that the real-time path never has to allocate.
+ */
+static int conv_buffer_alloc(void **bufp, size_t *szp, enum aufmt fmt,
+			     uint64_t *allocc)
+{
+	size_t sz = AUDIO_SAMPSZ * aufmt_sample_size(fmt);
+
+	if (*bufp && *szp >= sz)
+		return 0;
+
+	*bufp = mem_deref(*bufp);
+	*szp  = 0;
+
+	*bufp = mem_zalloc(sz, NULL);
+	if (!*bufp)
+		return ENOMEM;
+
+	*szp = sz;
+	++*allocc;
+
+	return 0;
+}
+
+
 static bool aucodec_equal(const struct aucodec *a, const struct aucodec *b)
 {
 	if (!a || !b)
@@ -354,6 +435,50 @@ static bool aucodec_equal(const struct aucodec *a, const struct aucodec *b)
 }
 
 
+/*
+ * The device edges use either an aubuf or, if configured, the lock-free
+ * ring. Exactly one of the two is allocated.
+ */
+static inline size_t buf_cur_size(const struct aubuf *ab,
+				  const struct auring *ring)
+{
+	return ring ? auring_cur_size(ring) : aubuf_cur_size(ab);
+}
+
+
+static inline void buf_read(struct aubuf *ab, struct auring *ring,
+			    void *p, size_t sz)
+{
+	if (ring)
+		auring_read(ring, p, sz);
+	else
+		aubuf_read(ab, p, sz);
+}
+
+
+/* a full ring drops the frame and counts it, like an aubuf overrun */
+static inline int buf_write(struct aubuf *ab, struct auring *ring,
+			    const void *p, size_t sz)
+{
+	if (ring) {
+		(void)auring_write(ring, p, sz);
+		return 0;
+	}
+
+	return aubuf_write(ab, p, sz);
+}
+
+
+/* playing time of a number of bytes in the device buffers, in [us] */
+static inline uint64_t bytes_to_usec(size_t bytes, uint32_t srate,
+				     uint8_t ch, size_t sampsz)
+{
+	uint64_t rate = (uint64_t)srate * ch * sampsz;
+
+	return rate ? bytes * 1000000ULL / rate : 0;
+}
+
+
 static int add_audio_codec(struct audio *a, struct sdp_media *m,
 			   struct aucodec *ac)
 {
@@ -420,6 +545,7 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 	size_t sampc_rtp;
 	size_t len;
 	size_t ext_len = 0;
+	uint64_t t0, t1;
 	int err;
 
 	if (!tx->ac || !tx->ac->ench)
@@ -451,9 +577,14 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 
 	len = mbuf_get_space(tx->mb);
 
+	t0 = tmr_jiffies_usec();
+
 	err = tx->ac->ench(tx->enc, mbuf_buf(tx->mb), &len,
 			   tx->enc_fmt, sampv, sampc);
 
+	t1 = tmr_jiffies_usec();
+	stream_latency_add(a->strm, LAT_ENCODE, t1 - t0);
+
 	if ((err & 0xffff0000) == 0x00010000) {
 		/* MPA needs some special treatment here */
 		tx->ts_ext = err & 0xffff;
@@ -477,6 +608,9 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 					  rtp_ts, tx->mb);
 			if (err)
 				goto out;
+
+			stream_latency_add(a->strm, LAT_SEND,
+					   tmr_jiffies_usec() - t1);
 		}
 	}
 
@@ -517,18 +651,22 @@ static void poll_aubuf_tx(struct audio *a)
 	num_bytes = tx->psize;
 	sampc = tx->psize / sz;
 
+	/* the samples read now have waited for the whole buffer */
+	stream_latency_add(a->strm, LAT_CAPTURE,
+			   bytes_to_usec(buf_cur_size(tx->aubuf, tx->ring),
+					 tx->ausrc_prm.srate,
+					 tx->ausrc_prm.ch, sz));
+
 	/* timed read from audio-buffer */
 
 	if (tx->src_fmt == tx->enc_fmt) {
 
-		aubuf_read(tx->aubuf, (uint8_t *)tx->sampv, num_bytes);
+		buf_read(tx->aubuf, tx->ring, tx->sampv, num_bytes);
 	}
 	else if (tx->enc_fmt == AUFMT_S16LE) {
 
 		/* Convert from ausrc format to 16-bit format */
 
-		void *tmp_sampv;
-
 		if (!tx->need_conv) {
 			info("audio: NOTE: source sample conversion"
 			     " needed: %s  -->  %s\n",
@@ -536,15 +674,18 @@ static void poll_aubuf_tx(struct audio *a)
 			tx->need_conv = true;
 		}
 
-		tmp_sampv = mem_zalloc(num_bytes, NULL);
-		if (!tmp_sampv)
+		if (num_bytes > tx->sampv_conv_sz) {
+			warning("audio: tx: conversion buffer too small"
+				" (%zu > %zu bytes)\n",
+				num_bytes, tx->sampv_conv_sz);
 			return;
+		}
 
-		aubuf_read(tx->aubuf, tmp_sampv, num_bytes);
+		buf_read(tx->aubuf, tx->ring, tx->sampv_conv, num_bytes);
 
-		auconv_to_s16(sampv, tx->src_fmt, tmp_sampv, sampc);
+		auconv_to_s16(sampv, tx->src_fmt, tx->sampv_conv, sampc);
 
-		mem_deref(tmp_sampv);
+		++tx->stats.conv_frames;
 	}
 	else {
 		warning("audio: tx: invalid sample formats (%s -> %s)\n",
@@ -645,7 +786,8 @@ static void auplay_write_handler(void *sampv, size_t sampc, void *arg)
 	struct aurx *rx = arg;
 	size_t num_bytes = sampc * aufmt_sample_size(rx->play_fmt);
 
-	if (rx->aubuf_started && aubuf_cur_size(rx->aubuf) < num_bytes) {
+	if (rx->aubuf_started &&
+	    buf_cur_size(rx->aubuf, rx->ring) < num_bytes) {
 
 		++rx->stats.aubuf_underrun;
 
@@ -655,7 +797,7 @@ static void auplay_write_handler(void *sampv, size_t sampc, void *arg)
 #endif
 	}
 
-	aubuf_read(rx->aubuf, sampv, num_bytes);
+	buf_read(rx->aubuf, rx->ring, sampv, num_bytes);
 }
 
 
@@ -679,7 +821,7 @@ static void ausrc_read_handler(const void *sampv, size_t sampc, void *arg)
 	if (tx->muted)
 		memset((void *)sampv, 0, num_bytes);
 
-	if (aubuf_cur_size(tx->aubuf) >= tx->aubuf_maxsz) {
+	if (buf_cur_size(tx->aubuf, tx->ring) >= tx->aubuf_maxsz) {
 
 		++tx->stats.aubuf_overrun;
 
@@ -687,7 +829,7 @@ static void ausrc_read_handler(const void *sampv, size_t sampc, void *arg)
 		      tx->stats.aubuf_overrun);
 	}
 
-	(void)aubuf_write(tx->aubuf, sampv, num_bytes);
+	(void)buf_write(tx->aubuf, tx->ring, sampv, num_bytes);
 
 	tx->aubuf_started = true;
 
@@ -696,7 +838,7 @@ static void ausrc_read_handler(const void *sampv, size_t sampc, void *arg)
 
 		for (i=0; i<16; i++) {
 
-			if (aubuf_cur_size(tx->aubuf) < tx->psize)
+			if (buf_cur_size(tx->aubuf, tx->ring) < tx->psize)
 				break;
 
 			poll_aubuf_tx(a);
@@ -721,9 +863,10 @@ static void ausrc_error_handler(int err, const char *str, void *arg)
 static int pt_handler(struct audio *a, uint8_t pt_old, uint8_t pt_new)
 {
 	const struct sdp_format *lc;
+	enum stream_ptclass cls;
 
-	lc = sdp_media_lformat(stream_sdpmedia(a->strm), pt_new);
-	if (!lc)
+	lc = stream_pt_lookup(a->strm, pt_new, &cls);
+	if (!lc || cls != STREAM_PT_CODEC)
 		return ENOENT;
 
 	if (pt_old != (uint8_t)-1) {
@@ -751,11 +894,80 @@ static void handle_telev(struct audio *a, struct mbuf *mb)
 }
 
 
-static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
+/*
+ * Adaptive jitter buffer. The playout delay is the fill level of the
+ * rx buffer, which is kept between the target and one frame above it
+ * by shortening or lengthening decoded frames by one pitch period. The
+ * target follows the delay spread of the arriving packets, within the
+ * configured jitter buffer delay.
+ */
+static void aurx_adapt(struct aurx *rx, struct stream *strm, size_t *sampc)
+{
+	const uint32_t srate = get_srate(rx->ac);
+	const uint8_t ch = get_ch(rx->ac);
+	const uint64_t ptime = rx->ptime * 1000ULL;
+	const struct range *del = &strm->cfg.jbuf_del;
+	uint64_t level, usec;
+	size_t sampc_old = *sampc;
+	size_t maxc;
+
+	level = bytes_to_usec(buf_cur_size(rx->aubuf, rx->ring),
+			      rx->auplay_prm.srate, rx->auplay_prm.ch,
+			      aufmt_sample_size(rx->play_fmt));
+
+	/* the player takes whole frames, so the level is smoothed */
+	if (rx->ajb.level)
+		rx->ajb.level = (7 * rx->ajb.level + level) / 8;
+	else
+		rx->ajb.level = level;
+
+	rx->ajb.target = stream_delay_spread(strm);
+	rx->ajb.target = max(rx->ajb.target, del->min * ptime);
+	rx->ajb.target = min(rx->ajb.target, del->max * ptime);
+
+	if (rx->ajb.level > rx->ajb.target + max(ptime, 20000ULL)) {
+
+		if (austretch_accel(rx->sampv, sampc, srate, ch))
+			return;
+
+		usec = (sampc_old - *sampc) / ch * 1000000ULL / srate;
+
+		++rx->ajb.n_accel;
+		rx->ajb.usec_accel += usec;
+		rx->ajb.level -= min(usec, rx->ajb.level);
+	}
+	else if (rx->ajb.level < rx->ajb.target) {
+
+		/* leave room for the resampler output */
+		maxc = min(sampc_old + sampc_old / 2, (size_t)AUDIO_SAMPSZ);
+		if (rx->resamp.resample) {
+			uint64_t rate = (uint64_t)rx->auplay_prm.srate *
+				rx->auplay_prm.ch;
+
+			maxc = min(maxc, (size_t)(AUDIO_SAMPSZ * srate * ch /
+						  rate));
+		}
+
+		if (austretch_expand(rx->sampv, sampc, maxc, srate, ch))
+			return;
+
+		usec = (*sampc - sampc_old) / ch * 1000000ULL / srate;
+
+		++rx->ajb.n_expand;
+		rx->ajb.usec_expand += usec;
+		rx->ajb.level += usec;
+	}
+}
+
+
+static int aurx_stream_decode(struct aurx *rx, struct stream *strm,
+			      struct mbuf *mb)
 {
 	size_t sampc = AUDIO_SAMPSZ;
+	size_t sampsz;
 	void *sampv;
 	struct le *le;
+	uint64_t t0 = tmr_jiffies_usec();
 	int err = 0;
 
 	/* No decoder set */
@@ -785,6 +997,8 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 		goto out;
 	}
 
+	stream_latency_add(strm, LAT_DECODE, tmr_jiffies_usec() - t0);
+
 	if (rx->dec_fmt == AUFMT_S16LE) {
 		/* Process exactly one audio-frame in reverse list order */
 		for (le = rx->filtl.tail; le; le = le->prev) {
@@ -800,9 +1014,12 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 			aufmt_name(rx->dec_fmt));
 	}
 
-	if (!rx->aubuf)
+	if (!rx->aubuf && !rx->ring)
 		goto out;
 
+	if (rx->ajb.enabled && rx->dec_fmt == AUFMT_S16LE && sampc)
+		aurx_adapt(rx, strm, &sampc);
+
 	sampv = rx->sampv;
 
 	/* optional resampler */
@@ -826,7 +1043,7 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 		sampc = sampc_rs;
 	}
 
-	if (aubuf_cur_size(rx->aubuf) >= rx->aubuf_maxsz) {
+	if (buf_cur_size(rx->aubuf, rx->ring) >= rx->aubuf_maxsz) {
 
 		++rx->stats.aubuf_overrun;
 
@@ -834,18 +1051,24 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 		      rx->stats.aubuf_overrun);
 	}
 
+	/* the decoded samples are played after the whole buffer */
+	sampsz = aufmt_sample_size(rx->play_fmt);
+	stream_latency_add(strm, LAT_PLAYOUT,
+			   bytes_to_usec(buf_cur_size(rx->aubuf, rx->ring),
+					 rx->auplay_prm.srate,
+					 rx->auplay_prm.ch, sampsz));
+
 	if (rx->play_fmt == rx->dec_fmt) {
 
 		size_t num_bytes = sampc * aufmt_sample_size(rx->play_fmt);
 
-		err = aubuf_write(rx->aubuf, sampv, num_bytes);
+		err = buf_write(rx->aubuf, rx->ring, sampv, num_bytes);
 		if (err)
 			goto out;
 	}
 	else if (rx->dec_fmt == AUFMT_S16LE) {
 
 		/* Convert from 16-bit to auplay format */
-		void *tmp_sampv;
 		size_t num_bytes = sampc * aufmt_sample_size(rx->play_fmt);
 
 		if (!rx->need_conv) {
@@ -856,18 +1079,21 @@ static int aurx_stream_decode(struct aurx *rx, struct mbuf *mb)
 			rx->need_conv = true;
 		}
 
-		tmp_sampv = mem_zalloc(num_bytes, NULL);
-		if (!tmp_sampv)
+		if (num_bytes > rx->sampv_conv_sz) {
+			warning("audio: rx: conversion buffer too small"
+				" (%zu > %zu bytes)\n",
+				num_bytes, rx->sampv_conv_sz);
 			return ENOMEM;
+		}
 
-		auconv_from_s16(rx->play_fmt, tmp_sampv, sampv, sampc);
-
-		err = aubuf_write(rx->aubuf, tmp_sampv, num_bytes);
-
-		mem_deref(tmp_sampv);
+		auconv_from_s16(rx->play_fmt, rx->sampv_conv, sampv, sampc);
 
+		err = buf_write(rx->aubuf, rx->ring, rx->sampv_conv,
+				num_bytes);
 		if (err)
 			goto out;
+
+		++rx->stats.conv_frames;
 	}
 	else {
 		warning("audio: decode: invalid sample formats (%s -> %s)\n",
@@ -889,6 +1115,7 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 {
 	struct audio *a = arg;
 	struct aurx *rx = &a->rx;
+	enum stream_ptclass cls = STREAM_PT_CODEC;
 	bool discard = false;
 	size_t i;
 	int wrap;
@@ -897,20 +1124,17 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 	if (!mb)
 		goto out;
 
-	/* Telephone event? */
-	if (hdr->pt != rx->pt) {
-		const struct sdp_format *fmt;
+	if (hdr->pt != rx->pt)
+		(void)stream_pt_lookup(a->strm, hdr->pt, &cls);
 
-		fmt = sdp_media_lformat(stream_sdpmedia(a->strm), hdr->pt);
-
-		if (fmt && !str_casecmp(fmt->name, "telephone-event")) {
-			handle_telev(a, mb);
-			return;
-		}
+	/* Telephone event? */
+	if (cls == STREAM_PT_TELEV) {
+		handle_telev(a, mb);
+		return;
 	}
 
 	/* Comfort Noise (CN) as of RFC 3389 */
-	if (PT_CN == hdr->pt)
+	if (cls == STREAM_PT_CN)
 		return;
 
 	/* Audio payload-type changed? */
@@ -1002,7 +1226,7 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 	}
 
  out:
-	(void)aurx_stream_decode(&a->rx, mb);
+	(void)aurx_stream_decode(&a->rx, a->strm, mb);
 }
 
 
@@ -1123,6 +1347,14 @@ int audio_alloc(struct audio **ap, const struct stream_param *stream_prm,
 		stream_set_bw(a->strm, AUDIO_BANDWIDTH);
 	}
 
+	if (cfg->avt.jbuf_adaptive) {
+		err = stream_jbuf_adaptive(a->strm);
+		if (err)
+			goto out;
+
+		rx->ajb.enabled = true;
+	}
+
 	err = sdp_media_set_lattr(stream_sdpmedia(a->strm), true,
 				  "ptime", "%u", ptime);
 	if (err)
@@ -1205,6 +1437,8 @@ static void *tx_thread(void *arg)
 	struct autx *tx = &a->tx;
 	uint64_t ts = 0;
 
+	(void)realtime_thread_setup(REALTIME_THREAD_AUDIO, "baresip-autx");
+
 	while (a->tx.u.thr.run) {
 
 		uint64_t now;
@@ -1226,7 +1460,7 @@ static void *tx_thread(void *arg)
 
 		/* Now is the time to send */
 
-		if (aubuf_cur_size(tx->aubuf) >= tx->psize) {
+		if (buf_cur_size(tx->aubuf, tx->ring) >= tx->psize) {
 
 			poll_aubuf_tx(a);
 		}
@@ -1245,6 +1479,150 @@ static void *tx_thread(void *arg)
 #endif
 
 
+#ifdef HAVE_PTHREAD
+static uint32_t tx_pool_handler(void *arg)
+{
+	struct audio *a = arg;
+	struct autx *tx = &a->tx;
+
+	if (!tx->aubuf_started)
+		return TX_IDLE_USEC;
+
+	if (buf_cur_size(tx->aubuf, tx->ring) >= tx->psize) {
+
+		poll_aubuf_tx(a);
+	}
+	else {
+		++tx->stats.aubuf_underrun;
+
+		debug("audio: pool: tx aubuf underrun"
+		      " (total %llu)\n", tx->stats.aubuf_underrun);
+	}
+
+	return tx->ptime * 1000;
+}
+#endif
+
+
+#ifdef AUDIO_TX_TIMER
+static void timespec_add_usec(struct timespec *ts, uint64_t usec)
+{
+	ts->tv_sec  += usec / 1000000;
+	ts->tv_nsec += (usec % 1000000) * 1000;
+
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_nsec -= 1000000000;
+		++ts->tv_sec;
+	}
+}
+
+
+static int64_t timespec_diff_usec(const struct timespec *a,
+				  const struct timespec *b)
+{
+	return (int64_t)(a->tv_sec - b->tv_sec) * 1000000 +
+		(a->tv_nsec - b->tv_nsec) / 1000;
+}
+
+
+/*
+ * Discard up to n packets of stale samples from the tx buffer, keeping
+ * the latest packet. The samples are read into the buffer that
+ * poll_aubuf_tx() reads into, from the same thread.
+ */
+static void tx_discard(struct autx *tx, uint64_t n)
+{
+	void *p = tx->src_fmt == tx->enc_fmt ? tx->sampv : tx->sampv_conv;
+
+	if (!p || (p == tx->sampv_conv && tx->psize > tx->sampv_conv_sz))
+		return;
+
+	while (n-- && buf_cur_size(tx->aubuf, tx->ring) >= 2 * tx->psize)
+		buf_read(tx->aubuf, tx->ring, p, tx->psize);
+}
+
+
+/*
+ * Sleep until the absolute deadline of the next packet, instead of
+ * polling. If the thread falls behind it sends back-to-back to catch
+ * up, but never more than TX_MAX_CATCHUP packets; beyond that the
+ * missed periods are skipped and the schedule is realigned.
+ */
+static void *tx_timer_thread(void *arg)
+{
+	struct audio *a = arg;
+	struct autx *tx = &a->tx;
+	struct timespec deadline, now;
+
+	(void)realtime_thread_setup(REALTIME_THREAD_AUDIO, "baresip-autx");
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+	while (tx->u.thr.run) {
+
+		uint64_t period = tx->ptime * 1000;
+		int64_t lag;
+		int err;
+
+		err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				      &deadline, NULL);
+		if (err == EINTR)
+			continue;
+
+		if (!tx->u.thr.run)
+			break;
+
+		(void)clock_gettime(CLOCK_MONOTONIC, &now);
+
+		if (!tx->aubuf_started) {
+			deadline = now;
+			timespec_add_usec(&deadline, TX_IDLE_USEC);
+			continue;
+		}
+
+		lag = timespec_diff_usec(&now, &deadline);
+
+		if (lag > TX_LATE_USEC)
+			++tx->stats.tx_late;
+		if (lag > (int64_t)tx->stats.tx_late_max)
+			tx->stats.tx_late_max = lag;
+
+		if (period && lag > (int64_t)(TX_MAX_CATCHUP * period)) {
+
+			uint64_t n = lag / period;
+
+			tx->stats.tx_skip += n;
+
+			debug("audio: timer: %lld us behind, skipping"
+			      " (total %llu)\n", lag, tx->stats.tx_skip);
+
+			/* the samples of the skipped periods are stale */
+			tx_discard(tx, n);
+
+			deadline = now;
+		}
+
+		/* Now is the time to send */
+
+		if (buf_cur_size(tx->aubuf, tx->ring) >= tx->psize) {
+
+			poll_aubuf_tx(a);
+		}
+		else {
+			++tx->stats.aubuf_underrun;
+
+			debug("audio: timer: tx aubuf underrun"
+			      " (total %llu)\n", tx->stats.aubuf_underrun);
+		}
+
+		timespec_add_usec(&deadline, period);
+	}
+
+	return NULL;
+}
+#endif
+
+
 static void aufilt_param_set(struct aufilt_prm *prm,
 			     const struct aucodec *ac, uint32_t ptime)
 {
@@ -1425,7 +1803,16 @@ static int start_player(struct aurx *rx, struct audio *a)
 		prm.ptime      = rx->ptime;
 		prm.fmt        = rx->play_fmt;
 
-		if (!rx->aubuf) {
+		if (rx->play_fmt != rx->dec_fmt) {
+			err = conv_buffer_alloc(&rx->sampv_conv,
+						&rx->sampv_conv_sz,
+						rx->play_fmt,
+						&rx->stats.conv_alloc);
+			if (err)
+				return err;
+		}
+
+		if (!rx->aubuf && !rx->ring) {
 			size_t psize;
 			size_t sz = aufmt_sample_size(rx->play_fmt);
 
@@ -1433,8 +1820,20 @@ static int start_player(struct aurx *rx, struct audio *a)
 
 			rx->aubuf_maxsz = psize * 8;
 
-			err = aubuf_alloc(&rx->aubuf, psize * 1,
-					  rx->aubuf_maxsz);
+			/* room for the largest adaptive delay */
+			if (rx->ajb.enabled) {
+				rx->aubuf_maxsz = psize *
+					max(8U, a->strm->cfg.jbuf_del.max + 2);
+			}
+
+			if (a->cfg.ring) {
+				err = auring_alloc(&rx->ring, psize, psize * 1,
+						   rx->aubuf_maxsz);
+			}
+			else {
+				err = aubuf_alloc(&rx->aubuf, psize * 1,
+						  rx->aubuf_maxsz);
+			}
 			if (err)
 				return err;
 		}
@@ -1519,9 +1918,26 @@ static int start_source(struct autx *tx, struct audio *a)
 
 		tx->aubuf_maxsz = tx->psize * 30;
 
-		if (!tx->aubuf) {
-			err = aubuf_alloc(&tx->aubuf, tx->psize,
-					  tx->aubuf_maxsz);
+		if (tx->src_fmt != tx->enc_fmt) {
+			err = conv_buffer_alloc(&tx->sampv_conv,
+						&tx->sampv_conv_sz,
+						tx->src_fmt,
+						&tx->stats.conv_alloc);
+			if (err)
+				return err;
+		}
+
+		if (!tx->aubuf && !tx->ring) {
+
+			/* the tx consumers check the level, so no target */
+			if (a->cfg.ring) {
+				err = auring_alloc(&tx->ring, tx->psize, 0,
+						   tx->aubuf_maxsz);
+			}
+			else {
+				err = aubuf_alloc(&tx->aubuf, tx->psize,
+						  tx->aubuf_maxsz);
+			}
 			if (err)
 				return err;
 		}
@@ -1555,6 +1971,32 @@ static int start_source(struct autx *tx, struct audio *a)
 			break;
 #endif
 
+#ifdef HAVE_PTHREAD
+		case AUDIO_MODE_POOL:
+			if (!tx->u.pool.entry) {
+				err = txsched_add(&tx->u.pool.entry,
+						  a->cfg.tx_workers,
+						  tx_pool_handler, a);
+				if (err)
+					return err;
+			}
+			break;
+#endif
+
+#ifdef AUDIO_TX_TIMER
+		case AUDIO_MODE_TIMER:
+			if (!tx->u.thr.run) {
+				tx->u.thr.run = true;
+				err = pthread_create(&tx->u.thr.tid, NULL,
+						     tx_timer_thread, a);
+				if (err) {
+					tx->u.thr.run = false;
+					return err;
+				}
+			}
+			break;
+#endif
+
 		default:
 			warning("audio: tx mode not supported (%d)\n",
 				a->cfg.txmode);
@@ -1946,6 +2388,24 @@ static int aucodec_print(struct re_printf *pf, const struct aucodec *ac)
 }
 
 
+static int txbuf_debug(struct re_printf *pf, const struct autx *tx)
+{
+	if (tx->ring)
+		return auring_debug(pf, tx->ring);
+
+	return aubuf_debug(pf, tx->aubuf);
+}
+
+
+static int rxbuf_debug(struct re_printf *pf, const struct aurx *rx)
+{
+	if (rx->ring)
+		return auring_debug(pf, rx->ring);
+
+	return aubuf_debug(pf, rx->aubuf);
+}
+
+
 int audio_debug(struct re_printf *pf, const struct audio *a)
 {
 	const struct autx *tx;
@@ -1970,8 +2430,8 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 			  aufmt_name(tx->enc_fmt));
 	err |= re_hprintf(pf, "       aubuf: %H"
 			  " (cur %.2fms, max %.2fms, or %llu, ur %llu)\n",
-			  aubuf_debug, tx->aubuf,
-			  calc_ptime(aubuf_cur_size(tx->aubuf)/sztx,
+			  txbuf_debug, tx,
+			  calc_ptime(buf_cur_size(tx->aubuf, tx->ring)/sztx,
 				     tx->ausrc_prm.srate,
 				     tx->ausrc_prm.ch),
 			  calc_ptime(tx->aubuf_maxsz/sztx,
@@ -1983,6 +2443,26 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 			  tx->ausrc ? tx->ausrc->as->name : "none",
 			  tx->device,
 			  aufmt_name(tx->src_fmt));
+	if (tx->need_conv) {
+		err |= re_hprintf(pf, "       conv: %s -> %s"
+				  " (frames %llu, alloc %llu)\n",
+				  aufmt_name(tx->src_fmt),
+				  aufmt_name(tx->enc_fmt),
+				  tx->stats.conv_frames,
+				  tx->stats.conv_alloc);
+	}
+	if (a->cfg.txmode == AUDIO_MODE_TIMER) {
+		err |= re_hprintf(pf, "       timer: late %llu, skipped %llu,"
+				  " max lateness %.3fms\n",
+				  tx->stats.tx_late, tx->stats.tx_skip,
+				  tx->stats.tx_late_max / 1000.0);
+	}
+#ifdef HAVE_PTHREAD
+	if (a->cfg.txmode == AUDIO_MODE_POOL) {
+		err |= re_hprintf(pf, "       pool:\n%H",
+				  txsched_debug, tx->u.pool.entry);
+	}
+#endif
 	err |= re_hprintf(pf, "       time = %.3f sec\n",
 			  autx_calc_seconds(tx));
 
@@ -1993,8 +2473,8 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 			  rx->ptime, rx->pt);
 	err |= re_hprintf(pf, "       aubuf: %H"
 			  " (cur %.2fms, max %.2fms, or %llu, ur %llu)\n",
-			  aubuf_debug, rx->aubuf,
-			  calc_ptime(aubuf_cur_size(rx->aubuf)/szrx,
+			  rxbuf_debug, rx,
+			  calc_ptime(buf_cur_size(rx->aubuf, rx->ring)/szrx,
 				     rx->auplay_prm.srate,
 				     rx->auplay_prm.ch),
 			  calc_ptime(rx->aubuf_maxsz/szrx,
@@ -2003,10 +2483,31 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 			  rx->stats.aubuf_overrun,
 			  rx->stats.aubuf_underrun
 			  );
+	if (rx->ajb.enabled) {
+		err |= re_hprintf(pf, "       adaptive: delay %.2fms,"
+				  " target %.2fms, jitter %.2fms\n"
+				  "         accel %llu (%.1fms),"
+				  " expand %llu (%.1fms)\n",
+				  rx->ajb.level / 1000.0,
+				  rx->ajb.target / 1000.0,
+				  stream_jitter(a->strm) / 1000.0,
+				  rx->ajb.n_accel,
+				  rx->ajb.usec_accel / 1000.0,
+				  rx->ajb.n_expand,
+				  rx->ajb.usec_expand / 1000.0);
+	}
 	err |= re_hprintf(pf, "       player: %s,%s %s\n",
 			  rx->auplay ? rx->auplay->ap->name : "none",
 			  rx->device,
 			  aufmt_name(rx->play_fmt));
+	if (rx->need_conv) {
+		err |= re_hprintf(pf, "       conv: %s -> %s"
+				  " (frames %llu, alloc %llu)\n",
+				  aufmt_name(rx->dec_fmt),
+				  aufmt_name(rx->play_fmt),
+				  rx->stats.conv_frames,
+				  rx->stats.conv_alloc);
+	}
 	err |= re_hprintf(pf, "       n_discard:%llu\n",
 			  rx->stats.n_discard);
 	if (rx->level_set) {
@@ -2160,21 +2661,22 @@ int audio_print_rtpstat(struct re_printf *pf, const struct audio *a)
 			 "EX=BareSip;"   /* Reporter Identifier	             */
 			 "CS=%d;"        /* Call Setup in milliseconds       */
 			 "CD=%d;"        /* Call Duration in seconds	     */
-			 "PR=%u;PS=%u;"  /* Packets RX, TX                   */
+			 "PR=%llu;PS=%llu;" /* Packets RX, TX                */
 			 "PL=%d,%d;"     /* Packets Lost RX, TX              */
-			 "PD=%d,%d;"     /* Packets Discarded, RX, TX        */
+			 "PD=%llu,%llu;" /* Packets Discarded, RX, TX        */
 			 "JI=%.1f,%.1f;" /* Jitter RX, TX in timestamp units */
 			 "IP=%J,%J"      /* Local, Remote IPs                */
 			 ,
 			 call_setup_duration(s->call) * 1000,
 			 call_duration(s->call),
 
-			 s->metric_rx.n_packets,
-			 s->metric_tx.n_packets,
+			 metric_n_packets(&s->metric_rx),
+			 metric_n_packets(&s->metric_tx),
 
 			 rtcp->rx.lost, rtcp->tx.lost,
 
-			 s->metric_rx.n_err, s->metric_tx.n_err,
+			 metric_n_err(&s->metric_rx),
+			 metric_n_err(&s->metric_tx),
 
 			 /* timestamp units (ie: 8 ts units = 1 ms @ 8KHZ) */
 			 1.0 * rtcp->rx.jit/1000 * (srate_rx/1000),
@@ -8,6 +8,226 @@
 #include <re.h>
 #include <baresip.h>
 #include "core.h"
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_TARGET 1
+#endif
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+
+/**
+ * Sum of squares kernel, exact for any number of int16 samples
+ * below 2^33
+ */
+typedef uint64_t (sumsq_h)(const int16_t *sampv, size_t sampc);
+
+
+static uint64_t sumsq_scalar(const int16_t *sampv, size_t sampc)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < sampc; i++) {
+		const int32_t sample = sampv[i];
+
+		sum += (uint32_t)(sample * sample);
+	}
+
+	return sum;
+}
+
+
+#if defined (__SSE2__)
+static uint64_t sumsq_sse2(const int16_t *sampv, size_t sampc)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	uint64_t lane[2];
+	size_t i = 0;
+
+	for (; i + 8 <= sampc; i += 8) {
+
+		__m128i v = _mm_loadu_si128((const __m128i *)&sampv[i]);
+
+		/* pairwise s0*s0 + s1*s1, fits in unsigned 32-bit */
+		__m128i p = _mm_madd_epi16(v, v);
+
+		acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(p, zero));
+		acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(p, zero));
+	}
+
+	_mm_storeu_si128((__m128i *)lane, acc);
+
+	return lane[0] + lane[1] + sumsq_scalar(&sampv[i], sampc - i);
+}
+#endif
+
+
+#ifdef HAVE_AVX2_TARGET
+__attribute__((target("avx2")))
+static uint64_t sumsq_avx2(const int16_t *sampv, size_t sampc)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc = _mm256_setzero_si256();
+	uint64_t lane[4];
+	size_t i = 0;
+
+	for (; i + 16 <= sampc; i += 16) {
+
+		__m256i v = _mm256_loadu_si256((const __m256i *)&sampv[i]);
+		__m256i p = _mm256_madd_epi16(v, v);
+
+		acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(p, zero));
+		acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(p, zero));
+	}
+
+	_mm256_storeu_si256((__m256i *)lane, acc);
+
+	return lane[0] + lane[1] + lane[2] + lane[3] +
+		sumsq_scalar(&sampv[i], sampc - i);
+}
+#endif
+
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+static uint64_t sumsq_neon(const int16_t *sampv, size_t sampc)
+{
+	uint64x2_t acc = vdupq_n_u64(0);
+	size_t i = 0;
+
+	for (; i + 8 <= sampc; i += 8) {
+
+		int16x8_t v = vld1q_s16(&sampv[i]);
+		int32x4_t lo = vmull_s16(vget_low_s16(v), vget_low_s16(v));
+		int32x4_t hi = vmull_s16(vget_high_s16(v), vget_high_s16(v));
+
+		/* squares are non-negative, widen and add pairwise */
+		acc = vpadalq_u32(acc, vreinterpretq_u32_s32(lo));
+		acc = vpadalq_u32(acc, vreinterpretq_u32_s32(hi));
+	}
+
+	return vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1) +
+		sumsq_scalar(&sampv[i], sampc - i);
+}
+#endif
+
+
+static sumsq_h *sumsq_get(enum aulevel_impl impl)
+{
+	switch (impl) {
+
+	case AULEVEL_IMPL_SCALAR:
+		return sumsq_scalar;
+
+#if defined (__SSE2__)
+	case AULEVEL_IMPL_SSE2:
+		return sumsq_sse2;
+#endif
+
+#ifdef HAVE_AVX2_TARGET
+	case AULEVEL_IMPL_AVX2:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return sumsq_avx2;
+		return NULL;
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+	case AULEVEL_IMPL_NEON:
+		return sumsq_neon;
+#endif
+
+	default:
+		return NULL;
+	}
+}
+
+
+static enum aulevel_impl impl_best(void)
+{
+	static const enum aulevel_impl prefv[] = {
+		AULEVEL_IMPL_AVX2,
+		AULEVEL_IMPL_NEON,
+		AULEVEL_IMPL_SSE2,
+	};
+	size_t i;
+
+	for (i=0; i<ARRAY_SIZE(prefv); i++) {
+		if (sumsq_get(prefv[i]))
+			return prefv[i];
+	}
+
+	return AULEVEL_IMPL_SCALAR;
+}
+
+
+static enum aulevel_impl cur_impl = AULEVEL_IMPL_AUTO;
+static sumsq_h *cur_sumsq;
+
+
+/**
+ * Select the implementation of the audio level kernel
+ *
+ * @param impl Implementation, AULEVEL_IMPL_AUTO for the fastest one
+ *
+ * @return 0 if success, ENOTSUP if not supported on this CPU
+ */
+int aulevel_impl_set(enum aulevel_impl impl)
+{
+	sumsq_h *h;
+
+	if (impl == AULEVEL_IMPL_AUTO)
+		impl = impl_best();
+
+	h = sumsq_get(impl);
+	if (!h)
+		return ENOTSUP;
+
+	cur_sumsq = h;
+	cur_impl  = impl;
+
+	return 0;
+}
+
+
+/**
+ * Get the currently used implementation of the audio level kernel
+ *
+ * @return Audio level implementation
+ */
+enum aulevel_impl aulevel_impl_get(void)
+{
+	if (!cur_sumsq)
+		(void)aulevel_impl_set(AULEVEL_IMPL_AUTO);
+
+	return cur_impl;
+}
+
+
+/**
+ * Get the name of an audio level kernel implementation
+ *
+ * @param impl Audio level implementation
+ *
+ * @return Name of the implementation
+ */
+const char *aulevel_impl_name(enum aulevel_impl impl)
+{
+	switch (impl) {
+
+	case AULEVEL_IMPL_AUTO:   return "auto";
+	case AULEVEL_IMPL_SCALAR: return "scalar";
+	case AULEVEL_IMPL_SSE2:   return "sse2";
+	case AULEVEL_IMPL_AVX2:   return "avx2";
+	case AULEVEL_IMPL_NEON:   return "neon";
+	default:                  return "?";
+	}
+}
 
 
 /**
@@ -38,19 +258,17 @@
  */
 static double calc_rms(const int16_t *data, size_t len)
 {
-	double sum = 0;
-	size_t i;
+	uint64_t sum;
 
 	if (!data || !len)
 		return .0;
 
-	for (i = 0; i < len; i++) {
-		const double sample = data[i];
+	if (!cur_sumsq)
+		(void)aulevel_impl_set(AULEVEL_IMPL_AUTO);
 
-		sum += sample * sample;
-	}
+	sum = cur_sumsq(data, len);
 
-	return sqrt(sum / (double)len);
+	return sqrt((double)sum / (double)len);
 }
 
 
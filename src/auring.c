@@ -0,0 +1,268 @@
+/**
+ * @file auring.c  Lock-free audio ring buffer
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page AuRing Lock-free audio ring buffer
+ *
+ * A wait-free single-producer/single-consumer byte ring, used instead
+ * of aubuf between the audio device threads and the core. The producer
+ * only writes the head index and the consumer only writes the tail
+ * index, so neither side ever blocks on the other.
+ *
+ * The ring size is a power of two and the indices run freely, the fill
+ * level is simply head - tail. Each index sits on its own cache line.
+ *
+ * Since the producer cannot discard old data, a write that does not fit
+ * is dropped and counted as an overrun. The consumer keeps a fill-level
+ * target: it waits until the target is reached before it starts
+ * reading, raises the target by one frame on every underrun, lowers it
+ * again after a period without underruns and trims the ring down to
+ * the target when the level has drifted too far above it.
+ */
+
+
+enum {
+	CACHE_LINE   = 64,
+	STABLE_READS = 500,  /**< Reads without underrun to lower target */
+	TRIM_FRAMES  = 3,    /**< Frames above target before trimming    */
+};
+
+
+struct auring_idx {
+	size_t v;
+	uint8_t pad[CACHE_LINE - sizeof(size_t)];
+};
+
+struct auring {
+	struct auring_idx head;     /**< Written by the producer only      */
+	struct auring_idx tail;     /**< Written by the consumer only      */
+	uint8_t *buf;
+	size_t size;                /**< Capacity, power of two [bytes]    */
+	size_t frame;               /**< Frame size, adaption step [bytes] */
+	size_t target_min;
+	size_t target_max;
+
+	/* consumer state */
+	size_t target;              /**< Wanted fill level [bytes]         */
+	unsigned stable;            /**< Reads since the last underrun     */
+	bool filling;               /**< Waiting for the target level      */
+
+	struct {
+		uint64_t overrun;   /**< Writes dropped, ring full         */
+		uint64_t underrun;  /**< Reads with too little data        */
+		uint64_t trim;      /**< Bytes dropped to meet the target  */
+	} stats;
+};
+
+
+static void destructor(void *arg)
+{
+	struct auring *r = arg;
+
+	mem_deref(r->buf);
+}
+
+
+/**
+ * Allocate a lock-free audio ring buffer
+ *
+ * @param rp     Pointer to allocated ring buffer
+ * @param frame  Frame size, the unit of the fill target, in [bytes]
+ * @param min_sz Minimum fill target in [bytes], 0 disables the target
+ * @param max_sz Maximum fill level in [bytes]
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int auring_alloc(struct auring **rp, size_t frame, size_t min_sz,
+		 size_t max_sz)
+{
+	struct auring *r;
+	size_t size = CACHE_LINE;
+
+	if (!rp || !frame || !max_sz || min_sz > max_sz)
+		return EINVAL;
+
+	while (size < max_sz)
+		size <<= 1;
+
+	r = mem_zalloc(sizeof(*r), destructor);
+	if (!r)
+		return ENOMEM;
+
+	r->buf = mem_alloc(size, NULL);
+	if (!r->buf) {
+		mem_deref(r);
+		return ENOMEM;
+	}
+
+	r->size       = size;
+	r->frame      = frame;
+	r->target_min = min_sz;
+	r->target_max = max(min_sz, max_sz / 2);
+	r->target     = min_sz;
+	r->filling    = true;
+
+	*rp = r;
+
+	return 0;
+}
+
+
+/**
+ * Write data to the ring buffer. Must only be called by the producer.
+ *
+ * @param r  Ring buffer
+ * @param p  Data to write
+ * @param sz Number of bytes
+ *
+ * @return 0 if success, ENOSPC if the ring is full
+ *
+ * @note This function has REAL-TIME properties
+ */
+int auring_write(struct auring *r, const void *p, size_t sz)
+{
+	size_t head, tail, pos, n;
+
+	if (!r || !p)
+		return EINVAL;
+
+	head = r->head.v;
+	tail = __atomic_load_n(&r->tail.v, __ATOMIC_ACQUIRE);
+
+	if (sz > r->size - (head - tail)) {
+		++r->stats.overrun;
+		return ENOSPC;
+	}
+
+	pos = head & (r->size - 1);
+	n   = min(sz, r->size - pos);
+
+	memcpy(r->buf + pos, p, n);
+	memcpy(r->buf, (const uint8_t *)p + n, sz - n);
+
+	__atomic_store_n(&r->head.v, head + sz, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+
+static void adapt(struct auring *r, size_t used, size_t *tail)
+{
+	size_t excess;
+
+	if (++r->stable >= STABLE_READS) {
+
+		r->stable = 0;
+
+		if (r->target >= r->target_min + r->frame)
+			r->target -= r->frame;
+	}
+
+	if (used <= r->target + TRIM_FRAMES * r->frame)
+		return;
+
+	/* drop whole frames down to the target */
+	excess = used - r->target;
+	excess -= excess % r->frame;
+
+	*tail += excess;
+	r->stats.trim += excess;
+}
+
+
+/**
+ * Read data from the ring buffer. Must only be called by the consumer.
+ * Silence is returned while the ring is filling up to the target level.
+ *
+ * @param r  Ring buffer
+ * @param p  Buffer to read into
+ * @param sz Number of bytes
+ *
+ * @note This function has REAL-TIME properties
+ */
+void auring_read(struct auring *r, void *p, size_t sz)
+{
+	size_t head, tail, used, pos, n;
+
+	if (!r || !p)
+		return;
+
+	tail = r->tail.v;
+	head = __atomic_load_n(&r->head.v, __ATOMIC_ACQUIRE);
+	used = head - tail;
+
+	if (r->filling && r->target_min) {
+		if (used < max(r->target, sz)) {
+			memset(p, 0, sz);
+			return;
+		}
+
+		r->filling = false;
+	}
+
+	if (used < sz) {
+		++r->stats.underrun;
+
+		r->stable  = 0;
+		r->filling = true;
+		r->target  = min(r->target + r->frame, r->target_max);
+
+		memset(p, 0, sz);
+		return;
+	}
+
+	pos = tail & (r->size - 1);
+	n   = min(sz, r->size - pos);
+
+	memcpy(p, r->buf + pos, n);
+	memcpy((uint8_t *)p + n, r->buf, sz - n);
+
+	tail += sz;
+
+	if (r->target_min)
+		adapt(r, used - sz, &tail);
+
+	__atomic_store_n(&r->tail.v, tail, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Get the number of bytes in the ring buffer
+ *
+ * @param r Ring buffer
+ *
+ * @return Number of bytes
+ */
+size_t auring_cur_size(const struct auring *r)
+{
+	size_t head, tail;
+
+	if (!r)
+		return 0;
+
+	/* tail first, the head can only move further ahead */
+	tail = __atomic_load_n(&r->tail.v, __ATOMIC_ACQUIRE);
+	head = __atomic_load_n(&r->head.v, __ATOMIC_ACQUIRE);
+
+	return head - tail;
+}
+
+
+int auring_debug(struct re_printf *pf, const struct auring *r)
+{
+	if (!r)
+		return 0;
+
+	return re_hprintf(pf, "ring size=%zu target=%zu cur=%zu"
+			  " overrun=%llu underrun=%llu trim=%llu",
+			  r->size, r->target, auring_cur_size(r),
+			  r->stats.overrun, r->stats.underrun, r->stats.trim);
+}
@@ -0,0 +1,216 @@
+/**
+ * @file austretch.c  Audio time-scale modification
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <re.h>
+#include <baresip.h>
+
+
+/*
+ * Pitch-synchronous time-scale modification of one decoded frame, as
+ * used by the adaptive jitter buffer. To shorten a frame one pitch
+ * period is removed, to lengthen it one period is repeated, and the
+ * seam is cross-faded over a whole period. The period is found with a
+ * normalized cross-correlation, first on every n-th sample at rates
+ * above 8000 Hz and then refined at full resolution.
+ *
+ * Frames that are not periodic are left alone unless they are quiet,
+ * so that noise and speech onsets are not smeared. Multi-channel
+ * frames are interleaved; the period is searched in the first channel
+ * and all channels are modified alike.
+ */
+
+
+enum {
+	PITCH_MIN_USEC = 2500,
+	PITCH_MAX_USEC = 15000,
+	QUIET_LEVEL    = 64,    /**< Mean absolute sample value */
+};
+
+#define CORR_MIN 0.9
+
+
+/* normalized correlation of the periods at 0 and t, every step frames */
+static double corr(const int16_t *x, uint8_t ch, size_t t, size_t step)
+{
+	int64_t xy = 0, xx = 0, yy = 0;
+	size_t i;
+
+	for (i=0; i<t; i+=step) {
+
+		const int32_t a = x[i * ch];
+		const int32_t b = x[(i + t) * ch];
+
+		xy += a * b;
+		xx += a * a;
+		yy += b * b;
+	}
+
+	if (!xx || !yy)
+		return 0.0;
+
+	return (double)xy / sqrt((double)xx * (double)yy);
+}
+
+
+static bool is_quiet(const int16_t *sampv, size_t sampc)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i=0; i<sampc; i++)
+		sum += abs(sampv[i]);
+
+	return sum < (uint64_t)QUIET_LEVEL * sampc;
+}
+
+
+/*
+ * Find the pitch period of a frame with n sample frames, at most tmax.
+ *
+ * @return Period in sample frames, 0 if the frame cannot be modified
+ */
+static size_t period_find(const int16_t *x, size_t n, uint32_t srate,
+			  uint8_t ch, size_t tmax)
+{
+	const size_t tmin = (size_t)srate * PITCH_MIN_USEC / 1000000;
+	const size_t step = max(srate / 8000, 1U);
+	size_t t, lo, hi, best = 0;
+	double c, cbest = -1.0;
+
+	tmax = min(tmax, (size_t)srate * PITCH_MAX_USEC / 1000000);
+	tmax = min(tmax, n / 2);
+
+	if (!tmin || tmax < tmin)
+		return 0;
+
+	for (t=tmin; t<=tmax; t+=step) {
+
+		c = corr(x, ch, t, step);
+		if (c > cbest) {
+			cbest = c;
+			best  = t;
+		}
+	}
+
+	if (step > 1) {
+
+		lo = max(best - step + 1, tmin);
+		hi = min(best + step - 1, tmax);
+
+		cbest = -1.0;
+
+		for (t=lo; t<=hi; t++) {
+
+			c = corr(x, ch, t, 1);
+			if (c > cbest) {
+				cbest = c;
+				best  = t;
+			}
+		}
+	}
+
+	if (cbest >= CORR_MIN || is_quiet(x, n * ch))
+		return best;
+
+	return 0;
+}
+
+
+/* cross-fade from a to b over t sample frames, into dst */
+static void xfade(int16_t *dst, const int16_t *a, const int16_t *b,
+		  size_t t, uint8_t ch)
+{
+	size_t i, j;
+
+	for (i=0; i<t; i++) {
+		for (j=0; j<ch; j++) {
+
+			const int32_t va = a[i * ch + j];
+			const int32_t vb = b[i * ch + j];
+
+			dst[i * ch + j] = (int16_t)((va * (int32_t)(t - i) +
+						     vb * (int32_t)i) /
+						    (int32_t)t);
+		}
+	}
+}
+
+
+/**
+ * Shorten an audio frame by one pitch period
+ *
+ * @param sampv Interleaved 16-bit samples, modified in place
+ * @param sampc Number of samples, updated on success
+ * @param srate Sample rate in [Hz]
+ * @param ch    Number of channels
+ *
+ * @return 0 if success, ENOENT if the frame was not modified,
+ *         otherwise errorcode
+ */
+int austretch_accel(int16_t *sampv, size_t *sampc, uint32_t srate,
+		    uint8_t ch)
+{
+	size_t n, t;
+
+	if (!sampv || !sampc || !srate || !ch)
+		return EINVAL;
+
+	n = *sampc / ch;
+
+	t = period_find(sampv, n, srate, ch, n / 2);
+	if (!t)
+		return ENOENT;
+
+	/* the first two periods are merged into one */
+	xfade(sampv, sampv, sampv + t * ch, t, ch);
+
+	memmove(sampv + t * ch, sampv + 2 * t * ch,
+		(n - 2 * t) * ch * sizeof(*sampv));
+
+	*sampc -= t * ch;
+
+	return 0;
+}
+
+
+/**
+ * Lengthen an audio frame by one pitch period
+ *
+ * @param sampv Interleaved 16-bit samples, modified in place
+ * @param sampc Number of samples, updated on success
+ * @param maxc  Capacity of the sample buffer in [samples]
+ * @param srate Sample rate in [Hz]
+ * @param ch    Number of channels
+ *
+ * @return 0 if success, ENOENT if the frame was not modified,
+ *         otherwise errorcode
+ */
+int austretch_expand(int16_t *sampv, size_t *sampc, size_t maxc,
+		     uint32_t srate, uint8_t ch)
+{
+	size_t n, t;
+
+	if (!sampv || !sampc || !srate || !ch || maxc < *sampc)
+		return EINVAL;
+
+	n = *sampc / ch;
+
+	t = period_find(sampv, n, srate, ch, (maxc - *sampc) / ch);
+	if (!t)
+		return ENOENT;
+
+	/* insert a period that fades from the second back into the first */
+	memmove(sampv + 2 * t * ch, sampv + t * ch,
+		(n - t) * ch * sizeof(*sampv));
+
+	xfade(sampv + t * ch, sampv + 2 * t * ch, sampv, t, ch);
+
+	*sampc += t * ch;
+
+	return 0;
+}
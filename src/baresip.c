@@ -28,6 +28,7 @@ static struct baresip {
 	struct list vidsrcl;
 	struct list vidispl;
 	struct list vidfiltl;
+	struct vidpool *vidpool;
 	struct ui_sub uis;
 } baresip;
 
@@ -72,10 +73,23 @@ static int rmmod_handler(struct re_printf *pf, void *arg)
 }
 
 
+#ifdef USE_VIDEO
+static int vidpool_handler(struct re_printf *pf, void *unused)
+{
+	(void)unused;
+
+	return vidpool_debug(pf, baresip.vidpool);
+}
+#endif
+
+
 static const struct cmd corecmdv[] = {
 	{"quit", 'q', 0, "Quit",                     cmd_quit             },
 	{"insmod", 0, CMD_PRM, "Load module",        insmod_handler       },
 	{"rmmod",  0, CMD_PRM, "Unload module",      rmmod_handler        },
+#ifdef USE_VIDEO
+	{"vidpool", 0, 0,      "Video frame pool",   vidpool_handler      },
+#endif
 };
 
 
@@ -98,6 +112,9 @@ int baresip_init(struct config *cfg, bool prefer_ipv6)
 	list_init(&baresip.vidispl);
 	list_init(&baresip.vidfiltl);
 
+	if (cfg->realtime.mlockall)
+		(void)realtime_lock_memory();
+
 	/* Initialise Network */
 	err = net_alloc(&baresip.net, &cfg->net,
 			prefer_ipv6 ? AF_INET6 : AF_INET);
@@ -124,6 +141,13 @@ int baresip_init(struct config *cfg, bool prefer_ipv6)
 		return err;
 	}
 
+#ifdef USE_VIDEO
+	baresip.vidpool = mem_deref(baresip.vidpool);
+	err = vidpool_alloc(&baresip.vidpool);
+	if (err)
+		return err;
+#endif
+
 	err = cmd_register(baresip.commands, corecmdv, ARRAY_SIZE(corecmdv));
 	if (err)
 		return err;
@@ -139,6 +163,7 @@ void baresip_close(void)
 	baresip.message = mem_deref(baresip.message);
 	baresip.player = mem_deref(baresip.player);
 	baresip.commands = mem_deref(baresip.commands);
+	baresip.vidpool = mem_deref(baresip.vidpool);
 	contact_close(&baresip.contacts);
 
 	baresip.net = mem_deref(baresip.net);
@@ -242,6 +267,17 @@ struct list *baresip_vidfiltl(void)
 }
 
 
+/**
+ * Get the shared video frame pool
+ *
+ * @return Video frame pool, NULL if not initialised
+ */
+struct vidpool *baresip_vidpool(void)
+{
+	return baresip.vidpool;
+}
+
+
 struct ui_sub *baresip_uis(void)
 {
 	return &baresip.uis;
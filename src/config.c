@@ -55,6 +55,8 @@ static struct config core_config = {
 		0,
 		false,
 		AUDIO_MODE_POLL,
+		1,
+		false,
 		false,
 		AUFMT_S16LE,
 		AUFMT_S16LE,
@@ -72,6 +74,9 @@ static struct config core_config = {
 		25,
 		true,
 		VID_FMT_YUV420P,
+		2.5,
+		100,
+		false,
 	},
 #endif
 
@@ -84,7 +89,9 @@ static struct config core_config = {
 		false,
 		{5, 10},
 		false,
-		0
+		0,
+		false,
+		false
 	},
 
 	/* Network */
@@ -105,6 +112,15 @@ static struct config core_config = {
 	{
 		false
 	},
+
+	/* Real-time */
+	{
+		REALTIME_POLICY_OTHER,
+		50,
+		false,
+		-1,
+		-1
+	},
 };
 
 
@@ -144,6 +160,18 @@ static int dns_server_handler(const struct pl *pl, void *arg)
 }
 
 
+static const char *realtime_policy_name(enum realtime_policy policy)
+{
+	switch (policy) {
+
+	case REALTIME_POLICY_OTHER: return "other";
+	case REALTIME_POLICY_FIFO:  return "fifo";
+	case REALTIME_POLICY_RR:    return "rr";
+	default:                    return "?";
+	}
+}
+
+
 static enum aufmt resolve_aufmt(const struct pl *fmt)
 {
 	if (0 == pl_strcasecmp(fmt, "s16"))     return AUFMT_S16LE;
@@ -225,6 +253,7 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 	enum poll_method method;
 	struct vidsz size = {0, 0};
 	struct pl txmode;
+	struct pl rtpolicy;
 	uint32_t v;
 	int err = 0;
 
@@ -294,11 +323,18 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 			cfg->audio.txmode = AUDIO_MODE_POLL;
 		else if (0 == pl_strcasecmp(&txmode, "thread"))
 			cfg->audio.txmode = AUDIO_MODE_THREAD;
+		else if (0 == pl_strcasecmp(&txmode, "timer"))
+			cfg->audio.txmode = AUDIO_MODE_TIMER;
+		else if (0 == pl_strcasecmp(&txmode, "pool"))
+			cfg->audio.txmode = AUDIO_MODE_POOL;
 		else {
 			warning("unsupported audio txmode (%r)\n", &txmode);
 		}
 	}
 
+	(void)conf_get_u32(conf, "audio_tx_workers", &cfg->audio.tx_workers);
+	(void)conf_get_bool(conf, "audio_ring", &cfg->audio.ring);
+
 	(void)conf_get_bool(conf, "audio_level", &cfg->audio.level);
 
 	conf_get_aufmt(conf, "ausrc_format", &cfg->audio.src_fmt);
@@ -323,6 +359,11 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 	(void)conf_get_bool(conf, "video_fullscreen", &cfg->video.fullscreen);
 
 	conf_get_vidfmt(conf, "videnc_format", &cfg->video.enc_fmt);
+	(void)conf_get_float(conf, "video_pacing", &cfg->video.pacing);
+	(void)conf_get_u32(conf, "video_pacing_budget",
+			   &cfg->video.pacing_budget);
+	(void)conf_get_bool(conf, "video_decode_thread",
+			    &cfg->video.decode_thread);
 #else
 	(void)size;
 #endif
@@ -340,8 +381,11 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 	(void)conf_get_bool(conf, "rtcp_mux", &cfg->avt.rtcp_mux);
 	(void)conf_get_range(conf, "jitter_buffer_delay",
 			     &cfg->avt.jbuf_del);
+	(void)conf_get_bool(conf, "jitter_buffer_adaptive",
+			    &cfg->avt.jbuf_adaptive);
 	(void)conf_get_bool(conf, "rtp_stats", &cfg->avt.rtp_stats);
 	(void)conf_get_u32(conf, "rtp_timeout", &cfg->avt.rtp_timeout);
+	(void)conf_get_bool(conf, "rtp_rx_batch", &cfg->avt.rtp_rx_batch);
 
 	if (err) {
 		warning("config: configure parse error (%m)\n", err);
@@ -361,6 +405,28 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 	/* SDP */
 	(void)conf_get_bool(conf, "sdp_ebuacip", &cfg->sdp.ebuacip);
 
+	/* Real-time */
+	if (0 == conf_get(conf, "realtime_policy", &rtpolicy)) {
+
+		if (0 == pl_strcasecmp(&rtpolicy, "other"))
+			cfg->realtime.policy = REALTIME_POLICY_OTHER;
+		else if (0 == pl_strcasecmp(&rtpolicy, "fifo"))
+			cfg->realtime.policy = REALTIME_POLICY_FIFO;
+		else if (0 == pl_strcasecmp(&rtpolicy, "rr"))
+			cfg->realtime.policy = REALTIME_POLICY_RR;
+		else {
+			warning("unsupported realtime policy (%r)\n",
+				&rtpolicy);
+		}
+	}
+	(void)conf_get_u32(conf, "realtime_priority", &cfg->realtime.prio);
+	(void)conf_get_bool(conf, "realtime_mlockall",
+			    &cfg->realtime.mlockall);
+	if (0 == conf_get_u32(conf, "audio_thread_cpu", &v))
+		cfg->realtime.audio_cpu = v;
+	if (0 == conf_get_u32(conf, "video_thread_cpu", &v))
+		cfg->realtime.video_cpu = v;
+
 	return err;
 }
 
@@ -403,6 +469,7 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "auplay_channels\t\t%u\n"
 			 "ausrc_channels\t\t%u\n"
 			 "audio_level\t\t%s\n"
+			 "audio_tx_workers\t%u\n"
 			 "\n"
 #ifdef USE_VIDEO
 			 "# Video\n"
@@ -413,6 +480,9 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "video_fps\t\t%.2f\n"
 			 "video_fullscreen\t%s\n"
 			 "videnc_format\t\t%s\n"
+			 "video_pacing\t\t%.2f\n"
+			 "video_pacing_budget\t%u\n"
+			 "video_decode_thread\t%s\n"
 			 "\n"
 #endif
 			 "# AVT\n"
@@ -422,8 +492,10 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "rtcp_enable\t\t%s\n"
 			 "rtcp_mux\t\t%s\n"
 			 "jitter_buffer_delay\t%H\n"
+			 "jitter_buffer_adaptive\t%s\n"
 			 "rtp_stats\t\t%s\n"
 			 "rtp_timeout\t\t%u # in seconds\n"
+			 "rtp_rx_batch\t\t%s\n"
 			 "\n"
 			 "# Network\n"
 			 "net_interface\t\t%s\n"
@@ -433,6 +505,13 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "bfcp_proto\t\t%s\n"
 			 "\n"
 #endif
+			 "# Real-time\n"
+			 "realtime_policy\t\t%s\n"
+			 "realtime_priority\t%u\n"
+			 "realtime_mlockall\t%s\n"
+			 "audio_thread_cpu\t%d\n"
+			 "video_thread_cpu\t%d\n"
+			 "\n"
 			 ,
 
 			 cfg->sip.trans_bsize, cfg->sip.local, cfg->sip.cert,
@@ -449,6 +528,7 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 cfg->audio.srate_play, cfg->audio.srate_src,
 			 cfg->audio.channels_play, cfg->audio.channels_src,
 			 cfg->audio.level ? "yes" : "no",
+			 cfg->audio.tx_workers,
 
 #ifdef USE_VIDEO
 			 cfg->video.src_mod, cfg->video.src_dev,
@@ -457,6 +537,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 cfg->video.bitrate, cfg->video.fps,
 			 cfg->video.fullscreen ? "yes" : "no",
 			 vidfmt_name(cfg->video.enc_fmt),
+			 cfg->video.pacing, cfg->video.pacing_budget,
+			 cfg->video.decode_thread ? "yes" : "no",
 #endif
 
 			 cfg->avt.rtp_tos,
@@ -465,14 +547,21 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 cfg->avt.rtcp_enable ? "yes" : "no",
 			 cfg->avt.rtcp_mux ? "yes" : "no",
 			 range_print, &cfg->avt.jbuf_del,
+			 cfg->avt.jbuf_adaptive ? "yes" : "no",
 			 cfg->avt.rtp_stats ? "yes" : "no",
 			 cfg->avt.rtp_timeout,
+			 cfg->avt.rtp_rx_batch ? "yes" : "no",
 
 			 cfg->net.ifname
 
 #ifdef USE_VIDEO
 			 ,cfg->bfcp.proto
 #endif
+			 ,realtime_policy_name(cfg->realtime.policy),
+			 cfg->realtime.prio,
+			 cfg->realtime.mlockall ? "yes" : "no",
+			 cfg->realtime.audio_cpu,
+			 cfg->realtime.video_cpu
 		   );
 
 	return err;
@@ -584,7 +673,9 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "#auplay_srate\t\t48000\n"
 			  "#ausrc_channels\t\t0\n"
 			  "#auplay_channels\t\t0\n"
-			  "#audio_txmode\t\tpoll\t\t# poll, thread\n"
+			  "#audio_txmode\t\tpoll\t\t# poll, thread, timer, pool\n"
+			  "#audio_tx_workers\t1\t\t# pool size, 0 = one per CPU\n"
+			  "#audio_ring\t\tno\t\t# lock-free device buffers\n"
 			  "audio_level\t\tno\n"
 			  "ausrc_format\t\ts16\t\t# s16, float, ..\n"
 			  "auplay_format\t\ts16\t\t# s16, float, ..\n"
@@ -611,12 +702,16 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "video_fps\t\t%.2f\n"
 			  "video_fullscreen\tyes\n"
 			  "videnc_format\t\t%s\n"
+			  "#video_pacing\t\t%.2f\t\t# x bitrate, 0 = off\n"
+			  "#video_pacing_budget\t%u\t\t# [ms]\n"
+			  "#video_decode_thread\tno\n"
 			  ,
 			  default_video_device(),
 			  default_video_display(),
 			  cfg->video.width, cfg->video.height,
 			  cfg->video.bitrate, cfg->video.fps,
-			  vidfmt_name(cfg->video.enc_fmt));
+			  vidfmt_name(cfg->video.enc_fmt),
+			  cfg->video.pacing, cfg->video.pacing_budget);
 #endif
 
 	err |= re_hprintf(pf,
@@ -627,8 +722,10 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "rtcp_enable\t\tyes\n"
 			  "rtcp_mux\t\tno\n"
 			  "jitter_buffer_delay\t%u-%u\t\t# frames\n"
+			  "#jitter_buffer_adaptive\tno\t\t# audio only\n"
 			  "rtp_stats\t\tno\n"
 			  "#rtp_timeout\t\t60\n"
+			  "#rtp_rx_batch\t\tno\t\t# Linux, needs rtcp off\n"
 			  "\n# Network\n"
 			  "#dns_server\t\t10.0.0.1:53\n"
 			  "#net_interface\t\t%H\n",
@@ -641,6 +738,14 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "#bfcp_proto\t\tudp\n");
 #endif
 
+	err |= re_hprintf(pf,
+			  "\n# Real-time scheduling of media threads\n"
+			  "#realtime_policy\tfifo\t\t# other, fifo, rr\n"
+			  "#realtime_priority\t50\t\t# 1-99\n"
+			  "#realtime_mlockall\tno\n"
+			  "#audio_thread_cpu\t1\n"
+			  "#video_thread_cpu\t2\n");
+
 	return err;
 }
 
@@ -933,6 +1038,18 @@ int config_write_template(const char *file, const struct config *cfg)
 	(void)re_fprintf(f, "\n# Opus codec parameters\n");
 	(void)re_fprintf(f, "opus_bitrate\t\t28000 # 6000-510000\n");
 
+	(void)re_fprintf(f,
+			"\n# avcodec\n"
+			"#avcodec_threads\t0 # 0 = one per core\n"
+			"#avcodec_thread_type\tslice # {slice,frame}\n"
+			"#avcodec_latency\t100 # frame threads [ms]\n");
+
+	(void)re_fprintf(f,
+			"\n# swscale\n"
+			"#swscale_format\t\tyuv420p\n"
+			"#swscale_algorithm\tbicubic\n"
+			"#swscale_threads\t0 # 0 = one per core\n");
+
 	(void)re_fprintf(f,
 			"\n# Selfview\n"
 			"video_selfview\t\twindow # {window,pip}\n"
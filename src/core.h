@@ -230,27 +230,45 @@ const struct mnat *mnat_find(const struct list *mnatl, const char *id);
  * Metric
  */
 
+enum {METRIC_WINDOW_MAX = 60};
+
+/** One snapshot of the counters, taken every second */
+struct metric_slot {
+	uint64_t jfs;
+	uint64_t n_bytes;
+	uint64_t n_packets;
+};
+
 struct metric {
 	/* internal stuff: */
 	struct tmr tmr;
 	uint64_t ts_start;
-	bool started;
 
-	/* counters: */
-	uint32_t n_packets;
-	uint32_t n_bytes;
-	uint32_t n_err;
+	/* counters, updated atomically from any thread: */
+	uint64_t n_packets;
+	uint64_t n_bytes;
+	uint64_t n_err;
 
-	/* bitrate calculation */
-	uint32_t cur_bitrate;
-	uint64_t ts_last;
-	uint32_t n_bytes_last;
+	/* sliding windows, main thread only: */
+	struct metric_slot slotv[METRIC_WINDOW_MAX + 1];
+	uint64_t slotc;
+	uint64_t peak_bitrate;
 };
 
 void     metric_init(struct metric *metric);
 void     metric_reset(struct metric *metric);
 void     metric_add_packet(struct metric *metric, size_t packetsize);
+void     metric_add_err(struct metric *metric);
+uint64_t metric_n_packets(const struct metric *metric);
+uint64_t metric_n_bytes(const struct metric *metric);
+uint64_t metric_n_err(const struct metric *metric);
 double   metric_avg_bitrate(const struct metric *metric);
+uint64_t metric_bitrate(const struct metric *metric, unsigned secs);
+double   metric_pktrate(const struct metric *metric, unsigned secs);
+uint64_t metric_peak_bitrate(const struct metric *metric);
+int      metric_debug(struct re_printf *pf, const char *name,
+		      const struct metric *metric);
+int      metric_encode_odict(struct odict *od, const struct metric *metric);
 
 
 /*
@@ -261,6 +279,41 @@ int module_init(const struct conf *conf);
 void module_app_unload(void);
 
 
+/*
+ * Real-time
+ */
+
+int realtime_lock_memory(void);
+
+
+/*
+ * Lock-free audio ring buffer
+ */
+
+struct auring;
+
+int    auring_alloc(struct auring **rp, size_t frame, size_t min_sz,
+		    size_t max_sz);
+int    auring_write(struct auring *r, const void *p, size_t sz);
+void   auring_read(struct auring *r, void *p, size_t sz);
+size_t auring_cur_size(const struct auring *r);
+int    auring_debug(struct re_printf *pf, const struct auring *r);
+
+
+/*
+ * Shared audio transmit scheduler
+ */
+
+struct txsched_entry;
+
+/** Scheduler handler, returns the period until the next call in [us] */
+typedef uint32_t (txsched_h)(void *arg);
+
+int txsched_add(struct txsched_entry **ep, uint32_t workerc,
+		txsched_h *h, void *arg);
+int txsched_debug(struct re_printf *pf, const struct txsched_entry *e);
+
+
 /*
  * Register client
  */
@@ -345,6 +398,8 @@ struct stream_param {
 	bool use_rtp;
 };
 
+enum {STREAM_RXTS_SLOTS = 256, STREAM_JIT_SLOTS = 256};
+
 /** Defines a generic media stream */
 struct stream {
 	struct le le;            /**< Linked list element                   */
@@ -379,6 +434,47 @@ struct stream {
 	uint32_t rtp_timeout_ms; /**< RTP Timeout value in [ms]             */
 	bool rtp_estab;          /**< True if RTP stream is established     */
 	bool hold;               /**< Stream is on-hold (local)             */
+	struct stream_batch *batch; /**< Batched send state (optional)      */
+	struct stream_rxbatch *rxbatch; /**< Batched receive (optional)     */
+	struct latency lat;      /**< Latency histograms per stage          */
+	struct {
+		uint64_t jfs;            /**< Receive time in [us]          */
+		uint16_t seq;            /**< RTP sequence number           */
+	} rxtsv[STREAM_RXTS_SLOTS];  /**< Receive times, by sequence    */
+	uint32_t srate_rx;       /**< Incoming RTP clock rate [Hz]          */
+	struct {
+		int32_t delayv[STREAM_JIT_SLOTS]; /**< Relative delay [us]  */
+		unsigned n;              /**< Number of delays recorded     */
+		uint64_t jfs0;           /**< Arrival time of origin [us]   */
+		uint32_t ts0;            /**< RTP timestamp of origin       */
+		int32_t delay_last;      /**< Last relative delay [us]      */
+		uint32_t jitter;         /**< Smoothed jitter [us]          */
+		uint32_t spread;         /**< Delay spread, 95th pct [us]   */
+		bool enabled;            /**< Estimate for adaptive jbuf    */
+	} jit;                   /**< Jitter of arriving packets            */
+	struct {
+		const struct sdp_format *fmt; /**< Local format            */
+		uint8_t cls;             /**< enum stream_ptclass           */
+	} ptv[128];              /**< Payload type table, by PT value       */
+	bool ptv_valid;          /**< Payload type table is up to date      */
+};
+
+enum {STREAM_BATCH_MAX = 64};
+
+/** Classification of an incoming RTP payload type */
+enum stream_ptclass {
+	STREAM_PT_UNKNOWN = 0,   /**< Not in local SDP                      */
+	STREAM_PT_CODEC,         /**< Media codec                           */
+	STREAM_PT_TELEV,         /**< Telephony events (RFC 4733)           */
+	STREAM_PT_CN,            /**< Comfort Noise (RFC 3389)              */
+};
+
+/** One RTP packet for stream_send_batch() */
+struct stream_pkt {
+	struct mbuf *mb;
+	uint32_t ts;
+	int pt;
+	bool marker;
 };
 
 int  stream_alloc(struct stream **sp, const struct stream_param *prm,
@@ -392,6 +488,10 @@ int  stream_alloc(struct stream **sp, const struct stream_param *prm,
 struct sdp_media *stream_sdpmedia(const struct stream *s);
 int  stream_send(struct stream *s, bool ext, bool marker, int pt, uint32_t ts,
 		 struct mbuf *mb);
+int  stream_send_batch(struct stream *s, bool ext,
+		       const struct stream_pkt *pktv, size_t pktc);
+const struct sdp_format *stream_pt_lookup(struct stream *s, uint8_t pt,
+					  enum stream_ptclass *clsp);
 void stream_update(struct stream *s);
 void stream_update_encoder(struct stream *s, int pt_enc);
 int  stream_jbuf_stat(struct re_printf *pf, const struct stream *s);
@@ -403,6 +503,11 @@ void stream_set_bw(struct stream *s, uint32_t bps);
 void stream_set_error_handler(struct stream *strm,
 			      stream_error_h *errorh, void *arg);
 int  stream_debug(struct re_printf *pf, const struct stream *s);
+void stream_latency_add(struct stream *s, enum lat_stage stage,
+			uint64_t usec);
+int  stream_jbuf_adaptive(struct stream *s);
+uint32_t stream_jitter(const struct stream *s);
+uint32_t stream_delay_spread(const struct stream *s);
 int  stream_print(struct re_printf *pf, const struct stream *s);
 void stream_enable_rtp_timeout(struct stream *strm, uint32_t timeout_ms);
 
@@ -33,6 +33,7 @@ static const char *event_class_name(enum ua_event ev)
 	case UA_EVENT_CALL_DTMF_END:
 	case UA_EVENT_CALL_RTCP:
 	case UA_EVENT_CALL_MENC:
+	case UA_EVENT_CALL_LATENCY:
 		return "call";
 	case UA_EVENT_VU_RX:
 	case UA_EVENT_VU_TX:
@@ -90,6 +91,76 @@ static int add_rtcp_stats(struct odict *od_parent, const struct rtcp_stats *rs)
 }
 
 
+static int add_metric(struct odict *od_parent, const struct stream *strm)
+{
+	struct odict *od = NULL, *tx = NULL, *rx = NULL;
+	int err;
+
+	if (!od_parent || !strm)
+		return EINVAL;
+
+	err  = odict_alloc(&od, 8);
+	err |= odict_alloc(&tx, 16);
+	err |= odict_alloc(&rx, 16);
+	if (err)
+		goto out;
+
+	err  = metric_encode_odict(tx, &strm->metric_tx);
+	err |= metric_encode_odict(rx, &strm->metric_rx);
+	if (err)
+		goto out;
+
+	err  = odict_entry_add(od, "tx", ODICT_OBJECT, tx);
+	err |= odict_entry_add(od, "rx", ODICT_OBJECT, rx);
+	if (err)
+		goto out;
+
+	err = odict_entry_add(od_parent, "metric", ODICT_OBJECT, od);
+
+ out:
+	mem_deref(od);
+	mem_deref(tx);
+	mem_deref(rx);
+
+	return err;
+}
+
+
+static int add_latency(struct odict *od_parent, const struct latency *lat)
+{
+	struct odict *od = NULL;
+	int err;
+
+	if (!od_parent || !lat)
+		return EINVAL;
+
+	err = odict_alloc(&od, 8);
+	if (err)
+		return err;
+
+	err  = latency_encode_odict(od, lat);
+	err |= odict_entry_add(od_parent, "latency", ODICT_OBJECT, od);
+
+	mem_deref(od);
+
+	return err;
+}
+
+
+/* the stream of a call, by media name */
+static struct stream *call_stream(const struct call *call, const char *name)
+{
+	if (0 == str_casecmp(name, "audio"))
+		return audio_strm(call_audio(call));
+#ifdef USE_VIDEO
+	else if (0 == str_casecmp(name, "video"))
+		return video_strm(call_video(call));
+#endif
+
+	return NULL;
+}
+
+
 int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
 		      struct call *call, const char *prm)
 {
@@ -132,16 +203,17 @@ int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
 	}
 
 	if (ev == UA_EVENT_CALL_RTCP) {
-		struct stream *strm = NULL;
+		struct stream *strm = call_stream(call, prm);
 
-		if (0 == str_casecmp(prm, "audio"))
-			strm = audio_strm(call_audio(call));
-#ifdef USE_VIDEO
-		else if (0 == str_casecmp(prm, "video"))
-			strm = video_strm(call_video(call));
-#endif
+		err  = add_rtcp_stats(od, stream_rtcp_stats(strm));
+		err |= add_metric(od, strm);
+		if (err)
+			goto out;
+	}
+	else if (ev == UA_EVENT_CALL_LATENCY) {
+		struct stream *strm = call_stream(call, prm);
 
-		err = add_rtcp_stats(od, stream_rtcp_stats(strm));
+		err = add_latency(od, stream_latency(strm));
 		if (err)
 			goto out;
 	}
@@ -179,6 +251,7 @@ const char *uag_event_str(enum ua_event ev)
 	case UA_EVENT_CALL_DTMF_END:        return "CALL_DTMF_END";
 	case UA_EVENT_CALL_RTCP:            return "CALL_RTCP";
 	case UA_EVENT_CALL_MENC:            return "CALL_MENC";
+	case UA_EVENT_CALL_LATENCY:         return "CALL_LATENCY";
 	case UA_EVENT_VU_TX:                return "VU_TX_REPORT";
 	case UA_EVENT_VU_RX:                return "VU_RX_REPORT";
 	default: return "?";
@@ -7,6 +7,12 @@
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#endif
 
 
 int h264_hdr_encode(const struct h264_hdr *hdr, struct mbuf *mb)
@@ -62,11 +68,12 @@ int h264_fu_hdr_decode(struct h264_fu *fu, struct mbuf *mb)
 
 
 /*
- * Find the NAL start sequence in a H.264 byte stream
+ * Find the NAL start sequence, scalar version
  *
  * @note: copied from ffmpeg source
  */
-const uint8_t *h264_find_startcode(const uint8_t *p, const uint8_t *end)
+static const uint8_t *find_startcode_scalar(const uint8_t *p,
+					    const uint8_t *end)
 {
 	const uint8_t *a = p + 4 - ((long)p & 3);
 
@@ -102,6 +109,62 @@ const uint8_t *h264_find_startcode(const uint8_t *p, const uint8_t *end)
 }
 
 
+/**
+ * Find the NAL start sequence in a H.264 byte stream
+ *
+ * 16 positions are tested per step, by comparing the bytes at p, p+1
+ * and p+2 against 00 00 01 in three overlapping vector loads.
+ *
+ * @param p   Start of the byte stream
+ * @param end End of the byte stream
+ *
+ * @return Pointer to the first 00 00 01 sequence, or end if none
+ */
+const uint8_t *h264_find_startcode(const uint8_t *p, const uint8_t *end)
+{
+#if defined (__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one  = _mm_set1_epi8(1);
+
+	for (; end - p >= 18; p += 16) {
+		__m128i v0 = _mm_loadu_si128((const __m128i *)p);
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(p + 1));
+		__m128i v2 = _mm_loadu_si128((const __m128i *)(p + 2));
+		int m;
+
+		m = _mm_movemask_epi8(_mm_and_si128(
+				_mm_and_si128(_mm_cmpeq_epi8(v0, zero),
+					      _mm_cmpeq_epi8(v1, zero)),
+				_mm_cmpeq_epi8(v2, one)));
+		if (m)
+			return p + __builtin_ctz(m);
+	}
+#elif defined (HAVE_NEON)
+	const uint8x16_t one = vdupq_n_u8(1);
+
+	for (; end - p >= 18; p += 16) {
+		uint8x16_t v0 = vld1q_u8(p);
+		uint8x16_t v1 = vld1q_u8(p + 1);
+		uint8x16_t v2 = vld1q_u8(p + 2);
+		uint8x16_t m;
+		uint64_t bits;
+
+		/* 00 00 01 <=> (v0 | v1) == 0 and v2 == 1 */
+		m = vandq_u8(vceqq_u8(vorrq_u8(v0, v1), vdupq_n_u8(0)),
+			     vceqq_u8(v2, one));
+
+		/* narrow to 4 bits per byte */
+		bits = vget_lane_u64(vreinterpret_u64_u8(
+				vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+		if (bits)
+			return p + (__builtin_ctzll(bits) >> 2);
+	}
+#endif
+
+	return find_startcode_scalar(p, end);
+}
+
+
 static int rtp_send_data(const uint8_t *hdr, size_t hdr_sz,
 			 const uint8_t *buf, size_t sz,
 			 bool eof, uint64_t rtp_ts,
@@ -153,31 +216,148 @@ int h264_nal_send(bool first, bool last,
 }
 
 
-int h264_packetize(uint64_t rtp_ts, const uint8_t *buf, size_t len,
-		   size_t pktsize, videnc_packet_h *pkth, void *arg)
+/**
+ * Initialize a H.264 packetizer. The packets are produced in the same
+ * way as by h264_packetize(), but the payloads are returned as slices of
+ * the input buffer instead of being passed to a handler.
+ *
+ * @param pz      Packetizer state
+ * @param buf     H.264 byte stream, must stay valid while packetizing
+ * @param len     Length of the byte stream
+ * @param pktsize Maximum packet size, without RTP header
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int h264_packetizer_init(struct h264_packetizer *pz, const uint8_t *buf,
+			 size_t len, size_t pktsize)
 {
-	const uint8_t *start = buf;
-	const uint8_t *end   = buf + len;
-	const uint8_t *r;
-	int err = 0;
+	if (!pz || (!buf && len) || pktsize <= 2)
+		return EINVAL;
+
+	memset(pz, 0, sizeof(*pz));
+
+	pz->end   = buf + len;
+	pz->maxsz = pktsize;
+	pz->r     = h264_find_startcode(buf, pz->end);
+
+	return 0;
+}
 
-	r = h264_find_startcode(start, end);
 
-	while (r < end) {
-		const uint8_t *r1;
+static int packetizer_nal(struct h264_packetizer *pz)
+{
+	const uint8_t *r = pz->r;
+	const uint8_t *r1;
 
+	for (;;) {
 		/* skip zeros */
-		while (!*(r++))
+		while (r < pz->end && !*(r++))
 			;
 
-		r1 = h264_find_startcode(r, end);
+		if (r >= pz->end)
+			return ENOENT;
+
+		r1 = h264_find_startcode(r, pz->end);
+
+		/* a start code right after the previous one is skipped */
+		if (r1 > r)
+			break;
 
-		err |= h264_nal_send(true, true, (r1 >= end), r[0],
-				     rtp_ts, r+1, r1-r-1, pktsize,
-				     pkth, arg);
 		r = r1;
 	}
 
+	pz->nal_hdr = r[0];
+	pz->pld     = r + 1;
+	pz->pld_len = r1 - r - 1;
+	pz->last    = (r1 >= pz->end);
+	pz->frag    = (pz->pld_len > pz->maxsz);
+	pz->start   = true;
+	pz->busy    = true;
+	pz->r       = r1;
+
+	return 0;
+}
+
+
+/**
+ * Get the next RTP packet from a H.264 packetizer
+ *
+ * @param pz  Packetizer state
+ * @param pkt Returned packet
+ *
+ * @return 0 if success, ENOENT when there are no more packets
+ */
+int h264_packetizer_next(struct h264_packetizer *pz, struct h264_pkt *pkt)
+{
+	const size_t sz = pz ? pz->maxsz - 2 : 0;
+	int err;
+
+	if (!pz || !pkt)
+		return EINVAL;
+
+	if (!pz->busy) {
+
+		if (pz->r >= pz->end)
+			return ENOENT;
+
+		err = packetizer_nal(pz);
+		if (err)
+			return err;
+	}
+
+	if (!pz->frag) {
+		pkt->hdr[0]  = pz->nal_hdr;
+		pkt->hdr_len = 1;
+		pkt->pld     = pz->pld;
+		pkt->pld_len = pz->pld_len;
+		pkt->marker  = pz->last;
+
+		pz->busy = false;
+
+		return 0;
+	}
+
+	pkt->hdr[0]  = (pz->nal_hdr & 0x60) | H264_NAL_FU_A;
+	pkt->hdr[1]  = (pz->start ? 1<<7 : 0) | (pz->nal_hdr & 0x1f);
+	pkt->hdr_len = 2;
+	pkt->pld     = pz->pld;
+
+	if (pz->pld_len > sz) {
+		pkt->pld_len = sz;
+		pkt->marker  = false;
+
+		pz->pld     += sz;
+		pz->pld_len -= sz;
+		pz->start    = false;
+	}
+	else {
+		pkt->hdr[1] |= 1<<6;  /* end bit */
+		pkt->pld_len = pz->pld_len;
+		pkt->marker  = pz->last;
+
+		pz->busy = false;
+	}
+
+	return 0;
+}
+
+
+int h264_packetize(uint64_t rtp_ts, const uint8_t *buf, size_t len,
+		   size_t pktsize, videnc_packet_h *pkth, void *arg)
+{
+	struct h264_packetizer pz;
+	struct h264_pkt pkt;
+	int err = 0;
+
+	if (h264_packetizer_init(&pz, buf, len, pktsize))
+		return EINVAL;
+
+	while (0 == h264_packetizer_next(&pz, &pkt)) {
+
+		err |= pkth(pkt.marker, rtp_ts, pkt.hdr, pkt.hdr_len,
+			    pkt.pld, pkt.pld_len, arg);
+	}
+
 	return err;
 }
 
@@ -0,0 +1,291 @@
+/**
+ * @file latency.c  Media pipeline latency histograms
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <baresip.h>
+
+
+/*
+ * Log-linear histogram in [us], in the style of HdrHistogram. Values
+ * below 32 have one bucket each, above that every power of two is split
+ * into 16 buckets, which gives a relative error of at most 1/16.
+ *
+ * The counters are updated with relaxed atomics, so a histogram can be
+ * recorded from any media thread and read from the main thread without
+ * locking. A reader may see a count that is not yet in the buckets,
+ * which is harmless for statistics.
+ */
+
+
+enum {
+	SUB_BITS = 4,
+	SUB      = 1 << SUB_BITS,
+	LINEAR   = 2 * SUB,
+};
+
+/* largest value with a bucket of its own, about 67 seconds */
+#define LATHIST_MAXVAL \
+	((1ULL << ((LATHIST_BUCKETS - LINEAR) / SUB + SUB_BITS + 1)) - 1)
+
+
+static const char *stage_namev[LAT_STAGES] = {
+	"capture",
+	"filter",
+	"encode",
+	"send",
+	"jbuf",
+	"decode",
+	"playout",
+};
+
+
+static inline unsigned lathist_index(uint64_t usec)
+{
+	unsigned e;
+
+	if (usec < LINEAR)
+		return (unsigned)usec;
+
+	if (usec > LATHIST_MAXVAL)
+		usec = LATHIST_MAXVAL;
+
+	e = 63 - __builtin_clzll(usec);
+
+	return LINEAR + (e - SUB_BITS - 1) * SUB +
+		(unsigned)((usec >> (e - SUB_BITS)) & (SUB - 1));
+}
+
+
+/* highest value that falls into bucket i */
+static uint64_t lathist_value(unsigned i)
+{
+	unsigned e, sub;
+
+	if (i < LINEAR)
+		return i;
+
+	e   = (i - LINEAR) / SUB + SUB_BITS + 1;
+	sub = (i - LINEAR) % SUB;
+
+	return ((uint64_t)(SUB + sub + 1) << (e - SUB_BITS)) - 1;
+}
+
+
+/**
+ * Record one latency value
+ *
+ * @param h    Latency histogram
+ * @param usec Latency in [us]
+ *
+ * @note This function may be called from any thread
+ */
+void lathist_add(struct lathist *h, uint64_t usec)
+{
+	uint64_t m;
+
+	if (!h)
+		return;
+
+	__atomic_fetch_add(&h->bucketv[lathist_index(usec)], 1,
+			   __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->sum, usec, __ATOMIC_RELAXED);
+
+	m = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	while (usec > m) {
+		if (__atomic_compare_exchange_n(&h->max, &m, usec, true,
+						__ATOMIC_RELAXED,
+						__ATOMIC_RELAXED))
+			break;
+	}
+}
+
+
+/**
+ * Reset a latency histogram
+ *
+ * @param h Latency histogram
+ */
+void lathist_reset(struct lathist *h)
+{
+	unsigned i;
+
+	if (!h)
+		return;
+
+	for (i=0; i<LATHIST_BUCKETS; i++)
+		__atomic_store_n(&h->bucketv[i], 0, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&h->count, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->sum, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&h->max, 0, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Get a percentile from a latency histogram
+ *
+ * @param h   Latency histogram
+ * @param pct Percentile, 0 - 100
+ *
+ * @return Highest value of the bucket with the percentile in [us],
+ *         but never more than the largest recorded value
+ */
+uint64_t lathist_percentile(const struct lathist *h, double pct)
+{
+	uint64_t count, rank, n = 0, m;
+	unsigned i;
+
+	if (!h)
+		return 0;
+
+	count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+	if (!count)
+		return 0;
+
+	pct  = min(max(pct, 0.0), 100.0);
+	rank = (uint64_t)(pct * count / 100.0 + 0.5);
+	rank = max(rank, 1ULL);
+
+	m = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+	for (i=0; i<LATHIST_BUCKETS; i++) {
+
+		n += __atomic_load_n(&h->bucketv[i], __ATOMIC_RELAXED);
+
+		/* the last bucket also holds all larger values */
+		if (n >= rank && i < LATHIST_BUCKETS - 1)
+			return min(lathist_value(i), m);
+		else if (n >= rank)
+			return m;
+	}
+
+	return m;
+}
+
+
+/**
+ * Get the mean value of a latency histogram
+ *
+ * @param h Latency histogram
+ *
+ * @return Mean latency in [us]
+ */
+uint64_t lathist_mean(const struct lathist *h)
+{
+	uint64_t count;
+
+	if (!h)
+		return 0;
+
+	count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+
+	return count ? __atomic_load_n(&h->sum, __ATOMIC_RELAXED) / count : 0;
+}
+
+
+/**
+ * Get the name of a media pipeline stage
+ *
+ * @param stage Pipeline stage
+ *
+ * @return Name of the stage
+ */
+const char *latency_stage_name(enum lat_stage stage)
+{
+	return (unsigned)stage < LAT_STAGES ? stage_namev[stage] : "?";
+}
+
+
+/**
+ * Print the latency histograms of all stages
+ *
+ * @param pf  Print handler
+ * @param lat Latency histograms
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int latency_debug(struct re_printf *pf, const struct latency *lat)
+{
+	unsigned i;
+	int err;
+
+	if (!lat)
+		return 0;
+
+	err = re_hprintf(pf, " latency [us]:  %10s %7s %7s %7s %7s %7s\n",
+			 "count", "mean", "p50", "p90", "p99", "max");
+
+	for (i=0; i<LAT_STAGES; i++) {
+
+		const struct lathist *h = &lat->histv[i];
+
+		if (!h->count)
+			continue;
+
+		err |= re_hprintf(pf, "   %-12s %10llu %7llu %7llu %7llu"
+				  " %7llu %7llu\n",
+				  latency_stage_name(i), h->count,
+				  lathist_mean(h),
+				  lathist_percentile(h, 50),
+				  lathist_percentile(h, 90),
+				  lathist_percentile(h, 99),
+				  h->max);
+	}
+
+	return err;
+}
+
+
+/**
+ * Encode the latency histograms as a dictionary, with one entry per
+ * stage that has values
+ *
+ * @param od  Dictionary to add the stages to
+ * @param lat Latency histograms
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int latency_encode_odict(struct odict *od, const struct latency *lat)
+{
+	unsigned i;
+	int err = 0;
+
+	if (!od || !lat)
+		return EINVAL;
+
+	for (i=0; i<LAT_STAGES && !err; i++) {
+
+		const struct lathist *h = &lat->histv[i];
+		struct odict *o;
+
+		if (!h->count)
+			continue;
+
+		err = odict_alloc(&o, 8);
+		if (err)
+			break;
+
+		err |= odict_entry_add(o, "count", ODICT_INT,
+				       (int64_t)h->count);
+		err |= odict_entry_add(o, "mean", ODICT_INT,
+				       (int64_t)lathist_mean(h));
+		err |= odict_entry_add(o, "p50", ODICT_INT,
+				       (int64_t)lathist_percentile(h, 50));
+		err |= odict_entry_add(o, "p90", ODICT_INT,
+				       (int64_t)lathist_percentile(h, 90));
+		err |= odict_entry_add(o, "p99", ODICT_INT,
+				       (int64_t)lathist_percentile(h, 99));
+		err |= odict_entry_add(o, "max", ODICT_INT, (int64_t)h->max);
+		if (!err) {
+			err = odict_entry_add(od, latency_stage_name(i),
+					      ODICT_OBJECT, o);
+		}
+
+		mem_deref(o);
+	}
+
+	return err;
+}
@@ -8,41 +8,101 @@
 #include "core.h"
 
 
-enum {TMR_INTERVAL = 3};
+/*
+ * The counters are updated with atomics from the RTP send and receive
+ * paths, which run in the audio and video threads. Once per second the
+ * timer in the main thread takes a snapshot of the counters; the rates
+ * over a window of N seconds are computed from the newest snapshot and
+ * the one taken N seconds before it.
+ */
+
+
+enum {TMR_INTERVAL = 1000};
+
+/* the windows shown in debug output and events, in [s] */
+static const unsigned windowv[] = {1, 10, 60};
+
+
+static inline uint64_t load(const uint64_t *p)
+{
+	return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+
+static inline const struct metric_slot *slot_get(const struct metric *m,
+						 uint64_t n)
+{
+	return &m->slotv[n % ARRAY_SIZE(m->slotv)];
+}
+
+
+/*
+ * Get the counter deltas over a window. Until the window is full it
+ * starts when the first packet was counted.
+ */
+static bool window_get(const struct metric *metric, unsigned secs,
+		       struct metric_slot *delta)
+{
+	const struct metric_slot *cur;
+	struct metric_slot base;
+
+	if (!metric || !metric->slotc)
+		return false;
+
+	secs = min(max(secs, 1U), (unsigned)METRIC_WINDOW_MAX);
+
+	cur = slot_get(metric, metric->slotc - 1);
+
+	if (metric->slotc > secs) {
+		base = *slot_get(metric, metric->slotc - 1 - secs);
+	}
+	else {
+		base.jfs       = load(&metric->ts_start);
+		base.n_bytes   = 0;
+		base.n_packets = 0;
+	}
+
+	if (cur->jfs <= base.jfs)
+		return false;
+
+	delta->jfs       = cur->jfs - base.jfs;
+	delta->n_bytes   = cur->n_bytes - base.n_bytes;
+	delta->n_packets = cur->n_packets - base.n_packets;
+
+	return true;
+}
+
+
 static void tmr_handler(void *arg)
 {
 	struct metric *metric = arg;
-	const uint64_t now = tmr_jiffies();
-	uint32_t diff;
+	struct metric_slot *slot;
 
-	tmr_start(&metric->tmr, TMR_INTERVAL * 1000, tmr_handler, metric);
+	tmr_start(&metric->tmr, TMR_INTERVAL, tmr_handler, metric);
 
-	if (!metric->started)
+	if (!load(&metric->ts_start))
 		return;
 
- 	if (now <= metric->ts_last)
-		return;
+	slot = &metric->slotv[metric->slotc % ARRAY_SIZE(metric->slotv)];
 
-	if (metric->ts_last) {
-		uint32_t bytes = metric->n_bytes - metric->n_bytes_last;
-		diff = (uint32_t)(now - metric->ts_last);
-		metric->cur_bitrate = 1000 * 8 * bytes / diff;
-	}
+	slot->jfs       = tmr_jiffies();
+	slot->n_bytes   = load(&metric->n_bytes);
+	slot->n_packets = load(&metric->n_packets);
+
+	++metric->slotc;
 
-	/* Update counters */
-	metric->ts_last = now;
-	metric->n_bytes_last = metric->n_bytes;
+	metric->peak_bitrate = max(metric->peak_bitrate,
+				   metric_bitrate(metric, 1));
 }
 
 
 static void metric_start(struct metric *metric)
 {
-	if (metric->started)
-		return;
-
-	metric->ts_start = tmr_jiffies();
+	uint64_t zero = 0;
 
-	metric->started = true;
+	(void)__atomic_compare_exchange_n(&metric->ts_start, &zero,
+					  tmr_jiffies(), false,
+					  __ATOMIC_RELAXED, __ATOMIC_RELAXED);
 }
 
 
@@ -51,7 +111,7 @@ void metric_init(struct metric *metric)
 	if (!metric)
 		return;
 
-	tmr_start(&metric->tmr, 100, tmr_handler, metric);
+	tmr_start(&metric->tmr, TMR_INTERVAL, tmr_handler, metric);
 }
 
 
@@ -64,27 +124,211 @@ void metric_reset(struct metric *metric)
 }
 
 
+/**
+ * Count one packet
+ *
+ * @param metric     Metric object
+ * @param packetsize Size of the packet in [bytes]
+ *
+ * @note This function may be called from any thread
+ */
 void metric_add_packet(struct metric *metric, size_t packetsize)
 {
 	if (!metric)
 		return;
 
-	if (!metric->started)
+	if (!load(&metric->ts_start))
 		metric_start(metric);
 
-	metric->n_bytes += (uint32_t)packetsize;
-	metric->n_packets++;
+	__atomic_fetch_add(&metric->n_bytes, packetsize, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&metric->n_packets, 1, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Count one error
+ *
+ * @param metric Metric object
+ *
+ * @note This function may be called from any thread
+ */
+void metric_add_err(struct metric *metric)
+{
+	if (!metric)
+		return;
+
+	__atomic_fetch_add(&metric->n_err, 1, __ATOMIC_RELAXED);
+}
+
+
+uint64_t metric_n_packets(const struct metric *metric)
+{
+	return metric ? load(&metric->n_packets) : 0;
+}
+
+
+uint64_t metric_n_bytes(const struct metric *metric)
+{
+	return metric ? load(&metric->n_bytes) : 0;
+}
+
+
+uint64_t metric_n_err(const struct metric *metric)
+{
+	return metric ? load(&metric->n_err) : 0;
 }
 
 
+/**
+ * Get the average bitrate since the first packet
+ *
+ * @param metric Metric object
+ *
+ * @return Bitrate in [bit/s]
+ */
 double metric_avg_bitrate(const struct metric *metric)
 {
-	int diff;
+	uint64_t start, diff;
 
-	if (!metric || !metric->ts_start)
+	if (!metric)
 		return 0;
 
-	diff = (int)(tmr_jiffies() - metric->ts_start);
+	start = load(&metric->ts_start);
+	if (!start)
+		return 0;
+
+	diff = tmr_jiffies() - start;
+	if (!diff)
+		return 0;
+
+	return 1000.0 * 8 * (double)load(&metric->n_bytes) / (double)diff;
+}
+
+
+/**
+ * Get the bitrate over a sliding window
+ *
+ * @param metric Metric object
+ * @param secs   Window length in [s], 1 - METRIC_WINDOW_MAX
+ *
+ * @return Bitrate in [bit/s]
+ */
+uint64_t metric_bitrate(const struct metric *metric, unsigned secs)
+{
+	struct metric_slot d;
+
+	if (!window_get(metric, secs, &d))
+		return 0;
+
+	return 1000 * 8 * d.n_bytes / d.jfs;
+}
+
+
+/**
+ * Get the packet rate over a sliding window
+ *
+ * @param metric Metric object
+ * @param secs   Window length in [s], 1 - METRIC_WINDOW_MAX
+ *
+ * @return Packet rate in [packets/s]
+ */
+double metric_pktrate(const struct metric *metric, unsigned secs)
+{
+	struct metric_slot d;
+
+	if (!window_get(metric, secs, &d))
+		return 0;
+
+	return 1000.0 * (double)d.n_packets / (double)d.jfs;
+}
+
+
+/**
+ * Get the highest bitrate over one second
+ *
+ * @param metric Metric object
+ *
+ * @return Peak bitrate in [bit/s]
+ */
+uint64_t metric_peak_bitrate(const struct metric *metric)
+{
+	return metric ? metric->peak_bitrate : 0;
+}
+
+
+/**
+ * Print the counters and rates
+ *
+ * @param pf     Print handler
+ * @param name   Direction name, e.g. "tx"
+ * @param metric Metric object
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int metric_debug(struct re_printf *pf, const char *name,
+		 const struct metric *metric)
+{
+	size_t i;
+	int err;
+
+	if (!metric)
+		return 0;
+
+	err = re_hprintf(pf, " %s: packets %llu (%.1f/s), %llu bytes,"
+			 " errors %llu\n", name,
+			 metric_n_packets(metric), metric_pktrate(metric, 1),
+			 metric_n_bytes(metric), metric_n_err(metric));
+
+	err |= re_hprintf(pf, "     bitrate:");
+	for (i=0; i<ARRAY_SIZE(windowv); i++) {
+		err |= re_hprintf(pf, " %.1f (%us)",
+				  metric_bitrate(metric, windowv[i]) / 1000.0,
+				  windowv[i]);
+	}
+	err |= re_hprintf(pf, ", peak %.1f kbit/s\n",
+			  metric_peak_bitrate(metric) / 1000.0);
+
+	return err;
+}
+
+
+/**
+ * Encode the counters and rates into a dictionary
+ *
+ * @param od     Dictionary to add the entries to
+ * @param metric Metric object
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int metric_encode_odict(struct odict *od, const struct metric *metric)
+{
+	char key[32];
+	size_t i;
+	int err;
+
+	if (!od || !metric)
+		return EINVAL;
+
+	err  = odict_entry_add(od, "packets", ODICT_INT,
+			       (int64_t)metric_n_packets(metric));
+	err |= odict_entry_add(od, "bytes", ODICT_INT,
+			       (int64_t)metric_n_bytes(metric));
+	err |= odict_entry_add(od, "errors", ODICT_INT,
+			       (int64_t)metric_n_err(metric));
+	err |= odict_entry_add(od, "bitrate_peak", ODICT_INT,
+			       (int64_t)metric_peak_bitrate(metric));
+
+	for (i=0; i<ARRAY_SIZE(windowv) && !err; i++) {
+
+		const uint64_t bitrate = metric_bitrate(metric, windowv[i]);
+
+		re_snprintf(key, sizeof(key), "bitrate_%us", windowv[i]);
+		err |= odict_entry_add(od, key, ODICT_INT, (int64_t)bitrate);
+
+		re_snprintf(key, sizeof(key), "pktrate_%us", windowv[i]);
+		err |= odict_entry_add(od, key, ODICT_DOUBLE,
+				       metric_pktrate(metric, windowv[i]));
+	}
 
-	return 1000.0 * 8 * (double)metric->n_bytes / (double)diff;
+	return err;
 }
@@ -3,26 +3,71 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
 #include "core.h"
 
 
-enum {PTIME = 40};
+/**
+ * \page AudioFilePlayer Audio-file player
+ *
+ * Small files are decoded once and kept in a cache of prompts, shared by
+ * all plays of the same file. Cached prompts that are not playing are
+ * evicted, oldest first, when the cache grows beyond PLAY_CACHE_SIZE.
+ *
+ * Files larger than PLAY_STREAM_SIZE are not cached. They are decoded
+ * incrementally from the main loop, keeping about one second of audio
+ * ahead of the player.
+ */
+
+
+enum {
+	PTIME            = 40,
+	PLAY_CACHE_SIZE  = 16 * 1024 * 1024, /**< Max cached bytes          */
+	PLAY_STREAM_SIZE = 1024 * 1024,      /**< File size for streaming   */
+	STREAM_AHEAD     = 1000,             /**< Decoded ahead in [ms]     */
+	STREAM_REFILL    = 100,              /**< Refill interval in [ms]   */
+	STREAM_CHUNK     = 4096,             /**< Bytes read per aufile_read*/
+};
 
 /** Audio file player */
 struct play {
 	struct le le;
 	struct play **playp;
 	struct lock *lock;
-	struct mbuf *mb;
+	struct mbuf *mb;           /**< Samples, shared with other plays  */
+	size_t pos;                /**< Read position in mb               */
 	struct auplay_st *auplay;
 	struct tmr tmr;
 	int repeat;
 	bool eof;
+
+	/* streaming from file */
+	struct tmr tmr_fill;
+	struct aufile *af;         /**< Open file, NULL if not streaming  */
+	struct aufile_prm fprm;
+	struct aubuf *aubuf;       /**< Decoded samples ahead of player   */
+	char *path;
+	size_t ahead;              /**< Wanted aubuf fill level [bytes]   */
+	bool src_eof;              /**< No more data will be decoded      */
+};
+
+/** A decoded audio file in the prompt cache */
+struct prompt {
+	struct le le;
+	char *path;
+	struct mbuf *mb;           /**< Samples, in native endianess      */
+	uint32_t srate;
+	uint8_t ch;
+	time_t mtime;              /**< File modification time            */
+	uint64_t used;             /**< Last use, for eviction [ms]       */
 };
 
 
@@ -34,6 +79,8 @@ static const char default_play_path[FS_PATH_MAX] = PREFIX "/share/baresip";
 
 struct player {
 	struct list playl;
+	struct list promptl;       /**< Cached prompts (struct prompt)    */
+	size_t prompt_bytes;       /**< Total size of cached prompts      */
 	char play_path[FS_PATH_MAX];
 };
 
@@ -82,12 +129,24 @@ static void write_handler(void *sampv, size_t sampc, void *arg)
 	if (play->eof)
 		goto silence;
 
+	if (play->aubuf) {
+		/* the aubuf fills in silence on underrun */
+		if (play->src_eof && aubuf_cur_size(play->aubuf) < sz)
+			play->eof = true;
+
+		aubuf_read(play->aubuf, sampv, sz);
+		pos = sz;
+		goto silence;
+	}
+
 	while (pos < sz) {
-		left = mbuf_get_left(play->mb);
+		left = play->mb->end - play->pos;
 		count = (left > sz - pos) ? sz - pos : left;
 
-		(void)mbuf_read_mem(play->mb, (uint8_t *)sampv + pos, count);
+		memcpy((uint8_t *)sampv + pos, play->mb->buf + play->pos,
+		       count);
 
+		play->pos += count;
 		pos += count;
 
 		if (pos < sz) {
@@ -99,7 +158,7 @@ static void write_handler(void *sampv, size_t sampc, void *arg)
 				goto silence;
 			}
 
-			play->mb->pos = 0;
+			play->pos = 0;
 		}
 	}
 
@@ -117,6 +176,7 @@ static void destructor(void *arg)
 
 	list_unlink(&play->le);
 	tmr_cancel(&play->tmr);
+	tmr_cancel(&play->tmr_fill);
 
 	lock_write_get(play->lock);
 	play->eof = true;
@@ -124,6 +184,9 @@ static void destructor(void *arg)
 
 	mem_deref(play->auplay);
 	mem_deref(play->mb);
+	mem_deref(play->aubuf);
+	mem_deref(play->af);
+	mem_deref(play->path);
 	mem_deref(play->lock);
 
 	if (play->playp)
@@ -131,19 +194,18 @@ static void destructor(void *arg)
 }
 
 
-static int aufile_load(struct mbuf *mb, const char *filename,
-		       uint32_t *srate, uint8_t *channels)
+/*
+ * Decode up to maxsz bytes from the file into native-endian 16-bit
+ * samples. The end of the file is reached when nothing was decoded.
+ */
+static int aufile_decode(struct mbuf *mb, struct aufile *af,
+			 enum aufmt fmt, size_t maxsz)
 {
-	struct aufile_prm prm;
-	struct aufile *af;
-	int err;
+	size_t start = mb->end;
+	int err = 0;
 
-	err = aufile_open(&af, &prm, filename, AUFILE_READ);
-	if (err)
-		return err;
-
-	while (!err) {
-		uint8_t buf[4096];
+	while (!err && mb->end - start < maxsz) {
+		uint8_t buf[STREAM_CHUNK];
 		size_t i, n;
 		int16_t *p = (void *)buf;
 
@@ -153,7 +215,7 @@ static int aufile_load(struct mbuf *mb, const char *filename,
 		if (err || !n)
 			break;
 
-		switch (prm.fmt) {
+		switch (fmt) {
 
 		case AUFMT_S16LE:
 			/* convert from Little-Endian to Native-Endian */
@@ -184,6 +246,23 @@ static int aufile_load(struct mbuf *mb, const char *filename,
 		}
 	}
 
+	return err;
+}
+
+
+static int aufile_load(struct mbuf *mb, const char *filename,
+		       uint32_t *srate, uint8_t *channels)
+{
+	struct aufile_prm prm;
+	struct aufile *af;
+	int err;
+
+	err = aufile_open(&af, &prm, filename, AUFILE_READ);
+	if (err)
+		return err;
+
+	err = aufile_decode(mb, af, prm.fmt, (size_t)-1);
+
 	mem_deref(af);
 
 	if (!err) {
@@ -197,6 +276,235 @@ static int aufile_load(struct mbuf *mb, const char *filename,
 }
 
 
+static void prompt_destructor(void *arg)
+{
+	struct prompt *pr = arg;
+
+	list_unlink(&pr->le);
+	mem_deref(pr->mb);
+	mem_deref(pr->path);
+}
+
+
+/* Evict prompts which are not playing, oldest first */
+static void prompt_evict(struct player *player, size_t sz)
+{
+	while (player->prompt_bytes + sz > PLAY_CACHE_SIZE) {
+
+		struct prompt *victim = NULL;
+		struct le *le;
+
+		for (le = player->promptl.head; le; le = le->next) {
+			struct prompt *pr = le->data;
+
+			if (mem_nrefs(pr->mb) > 1)
+				continue;
+
+			if (!victim || pr->used < victim->used)
+				victim = pr;
+		}
+
+		if (!victim)
+			break;
+
+		debug("play: evict prompt %s\n", victim->path);
+
+		player->prompt_bytes -= victim->mb->end;
+		mem_deref(victim);
+	}
+}
+
+
+/* Find a prompt in the cache, or decode the file and add it */
+static int prompt_get(struct prompt **prp, struct player *player,
+		      const char *path, time_t mtime)
+{
+	struct prompt *pr;
+	struct le *le;
+	int err;
+
+	for (le = player->promptl.head; le; le = le->next) {
+
+		pr = le->data;
+
+		if (0 != str_cmp(pr->path, path))
+			continue;
+
+		if (pr->mtime == mtime) {
+			pr->used = tmr_jiffies();
+			*prp = pr;
+			return 0;
+		}
+
+		/* the file has changed, playing copies keep their samples */
+		player->prompt_bytes -= pr->mb->end;
+		mem_deref(pr);
+		break;
+	}
+
+	pr = mem_zalloc(sizeof(*pr), prompt_destructor);
+	if (!pr)
+		return ENOMEM;
+
+	pr->mb = mbuf_alloc(1024);
+	if (!pr->mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = str_dup(&pr->path, path);
+	if (err)
+		goto out;
+
+	err = aufile_load(pr->mb, path, &pr->srate, &pr->ch);
+	if (err)
+		goto out;
+
+	pr->mtime = mtime;
+	pr->used  = tmr_jiffies();
+
+	prompt_evict(player, pr->mb->end);
+
+	list_append(&player->promptl, &pr->le, pr);
+	player->prompt_bytes += pr->mb->end;
+
+ out:
+	if (err)
+		mem_deref(pr);
+	else
+		*prp = pr;
+
+	return err;
+}
+
+
+static int stream_fill(struct play *play)
+{
+	struct mbuf *mb;
+	int err = 0;
+
+	mb = mbuf_alloc(STREAM_CHUNK * 2);
+	if (!mb)
+		return ENOMEM;
+
+	while (!play->src_eof &&
+	       aubuf_cur_size(play->aubuf) < play->ahead) {
+
+		mb->pos = mb->end = 0;
+
+		err = aufile_decode(mb, play->af, play->fprm.fmt,
+				    STREAM_CHUNK);
+		if (err)
+			break;
+
+		if (mb->end) {
+			mb->pos = 0;
+			err = aubuf_write(play->aubuf, mb->buf, mb->end);
+			if (err)
+				break;
+			continue;
+		}
+
+		/* end of file */
+		lock_write_get(play->lock);
+
+		if (play->repeat > 0)
+			play->repeat--;
+
+		if (play->repeat == 0)
+			play->src_eof = true;
+
+		lock_rel(play->lock);
+
+		if (play->src_eof)
+			break;
+
+		play->af = mem_deref(play->af);
+
+		err = aufile_open(&play->af, &play->fprm, play->path,
+				  AUFILE_READ);
+		if (err)
+			break;
+	}
+
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static void tmr_fill(void *arg)
+{
+	struct play *play = arg;
+	int err;
+
+	err = stream_fill(play);
+	if (err) {
+		warning("play: %s: %m\n", play->path, err);
+
+		lock_write_get(play->lock);
+		play->src_eof = true;
+		lock_rel(play->lock);
+		return;
+	}
+
+	if (!play->src_eof)
+		tmr_start(&play->tmr_fill, STREAM_REFILL, tmr_fill, play);
+}
+
+
+static int play_alloc(struct play **playp, int repeat)
+{
+	struct play *play;
+	int err;
+
+	play = mem_zalloc(sizeof(*play), destructor);
+	if (!play)
+		return ENOMEM;
+
+	tmr_init(&play->tmr);
+	tmr_init(&play->tmr_fill);
+	play->repeat = repeat;
+
+	err = lock_alloc(&play->lock);
+	if (err)
+		mem_deref(play);
+	else
+		*playp = play;
+
+	return err;
+}
+
+
+static int play_start(struct play *play, struct player *player,
+		      uint32_t srate, uint8_t ch)
+{
+	struct auplay_prm wprm;
+	struct config *cfg;
+	int err;
+
+	cfg = conf_config();
+	if (!cfg)
+		return ENOENT;
+
+	wprm.ch         = ch;
+	wprm.srate      = srate;
+	wprm.ptime      = PTIME;
+	wprm.fmt        = AUFMT_S16LE;
+
+	err = auplay_alloc(&play->auplay, baresip_auplayl(),
+			   cfg->audio.alert_mod, &wprm,
+			   cfg->audio.alert_dev, write_handler, play);
+	if (err)
+		return err;
+
+	list_append(&player->playl, &play->le, play);
+	tmr_start(&play->tmr, 1000, tmr_polling, play);
+
+	return 0;
+}
+
+
 /**
  * Play a tone from a PCM buffer
  *
@@ -208,50 +516,75 @@ static int aufile_load(struct mbuf *mb, const char *filename,
  * @param repeat   Number of times to repeat
  *
  * @return 0 if success, otherwise errorcode
+ *
+ * @note The buffer is shared, not copied, and must not be modified
  */
 int play_tone(struct play **playp, struct player *player,
 	      struct mbuf *tone, uint32_t srate,
 	      uint8_t ch, int repeat)
 {
-	struct auplay_prm wprm;
 	struct play *play;
-	struct config *cfg;
 	int err;
 
-	if (!player)
+	if (!player || !tone)
 		return EINVAL;
 	if (playp && *playp)
 		return EALREADY;
 
-	cfg = conf_config();
-	if (!cfg)
-		return ENOENT;
+	err = play_alloc(&play, repeat);
+	if (err)
+		return err;
 
-	play = mem_zalloc(sizeof(*play), destructor);
-	if (!play)
-		return ENOMEM;
+	play->mb  = mem_ref(tone);
+	play->pos = tone->pos;
 
-	tmr_init(&play->tmr);
-	play->repeat = repeat;
-	play->mb     = mem_ref(tone);
+	err = play_start(play, player, srate, ch);
 
-	err = lock_alloc(&play->lock);
+	if (err) {
+		mem_deref(play);
+	}
+	else if (playp) {
+		play->playp = playp;
+		*playp = play;
+	}
+
+	return err;
+}
+
+
+static int play_stream(struct play **playp, struct player *player,
+		       const char *path, int repeat)
+{
+	struct play *play;
+	int err;
+
+	err = play_alloc(&play, repeat);
+	if (err)
+		return err;
+
+	err = str_dup(&play->path, path);
 	if (err)
 		goto out;
 
-	wprm.ch         = ch;
-	wprm.srate      = srate;
-	wprm.ptime      = PTIME;
-	wprm.fmt        = AUFMT_S16LE;
+	err = aufile_open(&play->af, &play->fprm, path, AUFILE_READ);
+	if (err)
+		goto out;
 
-	err = auplay_alloc(&play->auplay, baresip_auplayl(),
-			   cfg->audio.alert_mod, &wprm,
-			   cfg->audio.alert_dev, write_handler, play);
+	play->ahead = play->fprm.srate * play->fprm.channels * 2
+		* STREAM_AHEAD / 1000;
+
+	err = aubuf_alloc(&play->aubuf, 0, play->ahead * 2);
 	if (err)
 		goto out;
 
-	list_append(&player->playl, &play->le, play);
-	tmr_start(&play->tmr, 1000, tmr_polling, play);
+	err = stream_fill(play);
+	if (err)
+		goto out;
+
+	if (!play->src_eof)
+		tmr_start(&play->tmr_fill, STREAM_REFILL, tmr_fill, play);
+
+	err = play_start(play, player, play->fprm.srate, play->fprm.channels);
 
  out:
 	if (err) {
@@ -269,6 +602,9 @@ int play_tone(struct play **playp, struct player *player,
 /**
  * Play an audio file in WAV format
  *
+ * Small files are played from the prompt cache, large files are
+ * streamed.
+ *
  * @param playp    Pointer to allocated player object
  * @param player   Audio-file player
  * @param filename Name of WAV file to play
@@ -279,10 +615,9 @@ int play_tone(struct play **playp, struct player *player,
 int play_file(struct play **playp, struct player *player,
 	      const char *filename, int repeat)
 {
-	struct mbuf *mb;
+	struct prompt *pr;
 	char path[FS_PATH_MAX];
-	uint32_t srate = 0;
-	uint8_t ch = 0;
+	struct stat st;
 	int err;
 
 	if (!player)
@@ -294,20 +629,26 @@ int play_file(struct play **playp, struct player *player,
 			player->play_path, filename) < 0)
 		return ENOMEM;
 
-	mb = mbuf_alloc(1024);
-	if (!mb)
-		return ENOMEM;
-
-	err = aufile_load(mb, path, &srate, &ch);
-	if (err) {
+	if (stat(path, &st) < 0) {
+		err = errno;
 		warning("play: %s: %m\n", path, err);
+		return err;
+	}
+
+	if (st.st_size > PLAY_STREAM_SIZE) {
+		err = play_stream(playp, player, path, repeat);
 		goto out;
 	}
 
-	err = play_tone(playp, player, mb, srate, ch, repeat);
+	err = prompt_get(&pr, player, path, st.st_mtime);
+	if (err)
+		goto out;
+
+	err = play_tone(playp, player, pr->mb, pr->srate, pr->ch, repeat);
 
  out:
-	mem_deref(mb);
+	if (err)
+		warning("play: %s: %m\n", path, err);
 
 	return err;
 }
@@ -318,6 +659,7 @@ static void player_destructor(void *data)
 	struct player *player = data;
 
 	list_flush(&player->playl);
+	list_flush(&player->promptl);
 }
 
 
@@ -333,6 +675,7 @@ int play_init(struct player **playerp)
 		return ENOMEM;
 
 	list_init(&player->playl);
+	list_init(&player->promptl);
 
 	str_ncpy(player->play_path, default_play_path,
 		 sizeof(player->play_path));
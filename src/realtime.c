@@ -3,8 +3,22 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#ifdef LINUX
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#endif
 #include <re.h>
 #include <baresip.h>
+#include "core.h"
 #ifdef DARWIN
 #include <sys/types.h>
 #include <sys/sysctl.h>
@@ -39,6 +53,145 @@ static int set_realtime(int period, int computation, int constraint)
 #endif
 
 
+#if defined (LINUX) && defined (HAVE_PTHREAD)
+static int sched_policy(enum realtime_policy policy)
+{
+	switch (policy) {
+
+	case REALTIME_POLICY_FIFO: return SCHED_FIFO;
+	case REALTIME_POLICY_RR:   return SCHED_RR;
+	default:                   return SCHED_OTHER;
+	}
+}
+
+
+static void limits_warning(int policy, int err)
+{
+	static bool warned = false;
+	struct rlimit rl;
+
+	if (warned)
+		return;
+
+	warned = true;
+
+	if (getrlimit(RLIMIT_RTPRIO, &rl) != 0)
+		rl.rlim_cur = 0;
+
+	warning("realtime: could not set scheduling policy %d (%m)"
+		" -- check RLIMIT_RTPRIO (currently %llu) or grant"
+		" CAP_SYS_NICE, continuing with default scheduling\n",
+		policy, err, (unsigned long long)rl.rlim_cur);
+}
+
+
+static int set_sched(enum realtime_policy rtp, uint32_t prio)
+{
+	struct sched_param param;
+	int policy = sched_policy(rtp);
+	int pmin, pmax, err;
+
+	memset(&param, 0, sizeof(param));
+
+	if (policy != SCHED_OTHER) {
+		pmin = sched_get_priority_min(policy);
+		pmax = sched_get_priority_max(policy);
+
+		param.sched_priority = min(max((int)prio, pmin), pmax);
+	}
+
+	err = pthread_setschedparam(pthread_self(), policy, &param);
+	if (err) {
+		limits_warning(policy, err);
+		return err;
+	}
+
+	return 0;
+}
+#endif
+
+
+/**
+ * Apply the configured real-time settings to the calling media thread
+ *
+ * Sets scheduling policy and priority, pins the thread to the
+ * configured CPU and names it. Failures are not fatal; a warning is
+ * printed once and the thread continues with default scheduling.
+ *
+ * @param type Type of media thread
+ * @param name Thread name (max 15 characters, optional)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int realtime_thread_setup(enum realtime_thread type, const char *name)
+{
+#if defined (LINUX) && defined (HAVE_PTHREAD)
+	const struct config *cfg = conf_config();
+	int cpu, err = 0;
+
+	if (name) {
+		char buf[16];
+
+		str_ncpy(buf, name, sizeof(buf));
+		(void)pthread_setname_np(pthread_self(), buf);
+	}
+
+	if (!cfg)
+		return 0;
+
+	if (cfg->realtime.policy != REALTIME_POLICY_OTHER)
+		err = set_sched(cfg->realtime.policy, cfg->realtime.prio);
+
+	cpu = (type == REALTIME_THREAD_VIDEO) ? cfg->realtime.video_cpu
+					      : cfg->realtime.audio_cpu;
+	if (cpu >= 0 && cpu < CPU_SETSIZE) {
+		cpu_set_t set;
+		int e;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+
+		e = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (e) {
+			warning("realtime: %s: could not pin to cpu %d (%m)\n",
+				name ? name : "thread", cpu, e);
+			err = e;
+		}
+	}
+
+	return err;
+#else
+	(void)type;
+	(void)name;
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Lock all current and future pages of the process in RAM
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int realtime_lock_memory(void)
+{
+#ifdef LINUX
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		int err = errno;
+		warning("realtime: mlockall failed (%m)"
+			" -- check RLIMIT_MEMLOCK\n", err);
+		return err;
+	}
+
+	info("realtime: memory locked\n");
+
+	return 0;
+#else
+	return ENOSYS;
+#endif
+}
+
+
 /**
  * Enable real-time scheduling (for selected platforms)
  *
@@ -92,6 +245,20 @@ int realtime_enable(bool enable, int fps)
 
 		return 0;
 	}
+#elif defined (LINUX) && defined (HAVE_PTHREAD)
+	const struct config *cfg = conf_config();
+	enum realtime_policy policy = REALTIME_POLICY_FIFO;
+	uint32_t prio = 50;
+
+	(void)fps;
+
+	if (cfg) {
+		if (cfg->realtime.policy != REALTIME_POLICY_OTHER)
+			policy = cfg->realtime.policy;
+		prio = cfg->realtime.prio;
+	}
+
+	return set_sched(enable ? policy : REALTIME_POLICY_OTHER, prio);
 #else
 	(void)enable;
 	(void)fps;
@@ -6,7 +6,9 @@
 
 SRCS	+= account.c
 SRCS	+= aucodec.c
+SRCS	+= auring.c
 SRCS	+= audio.c
+SRCS	+= austretch.c
 SRCS	+= aufilt.c
 SRCS	+= aulevel.c
 SRCS	+= auplay.c
@@ -18,6 +20,7 @@ SRCS	+= conf.c
 SRCS	+= config.c
 SRCS	+= contact.c
 SRCS	+= event.c
+SRCS	+= latency.c
 SRCS	+= log.c
 SRCS	+= menc.c
 SRCS	+= message.c
@@ -39,6 +42,10 @@ SRCS	+= timestamp.c
 SRCS	+= ua.c
 SRCS	+= ui.c
 
+ifneq ($(HAVE_PTHREAD),)
+SRCS	+= txsched.c
+endif
+
 ifneq ($(USE_VIDEO),)
 SRCS	+= bfcp.c
 SRCS	+= h264.c
@@ -46,6 +53,7 @@ SRCS	+= mctrl.c
 SRCS	+= video.c
 SRCS	+= vidcodec.c
 SRCS	+= vidfilt.c
+SRCS	+= vidpool.c
 SRCS	+= vidisp.c
 SRCS	+= vidsrc.c
 SRCS	+= vidutil.c
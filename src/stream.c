@@ -3,6 +3,15 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#ifdef LINUX
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <re.h>
@@ -13,10 +22,75 @@
 enum {
 	//RTP_RECV_SIZE = 8192,
 	RTP_RECV_SIZE = 81920,//by aphero
-	RTP_CHECK_INTERVAL = 1000  /* how often to check for RTP [ms] */
+	RTP_CHECK_INTERVAL = 1000, /* how often to check for RTP [ms] */
+	JIT_SPREAD_PKTS = 16,      /* packets between spread updates   */
+	JIT_REBASE_SECS = 60,      /* max RTP time from origin [s]     */
 };
 
 
+#ifdef LINUX
+enum {
+	BATCH_LAYER = -1000,  /* below all other UDP helpers */
+	BATCH_BUFSZ = 1600,
+	RXBATCH_BUFSZ = 2048,
+};
+
+
+/**
+ * Batched RTP sending
+ *
+ * While a batch is active, a UDP helper on the lowest layer captures
+ * the fully processed datagrams (after SRTP, TURN, ICE etc.) instead of
+ * letting libre send them one by one. They are then flushed with
+ * a single sendmmsg() call.
+ */
+struct stream_batch {
+	struct udp_helper *uh;
+	struct udp_sock *us;
+	bool active;
+	unsigned n;
+	struct sa dstv[STREAM_BATCH_MAX];
+	size_t lenv[STREAM_BATCH_MAX];
+	uint8_t bufv[STREAM_BATCH_MAX][BATCH_BUFSZ];
+
+	struct {
+		uint64_t pkts;
+		uint64_t syscalls;
+		uint64_t err;
+	} stats;
+};
+
+
+/**
+ * Batched RTP receiving
+ *
+ * Takes over the read events of the RTP socket and drains it with
+ * recvmmsg() into a pool of preallocated mbufs. Each mbuf is taken out
+ * of its slot while the handler runs, and put back only if the handler
+ * did not keep it. A kept mbuf (e.g. by the jitter buffer, which is the
+ * default) costs one allocation, like the receive path of libre, so the
+ * gain with a jitter buffer is the fewer system calls.
+ *
+ * This bypasses the UDP helpers and RTCP receive statistics of libre,
+ * so it is only used when there is no media NAT traversal, RTCP is
+ * disabled and the media encryption (if any) can decrypt a batch.
+ */
+struct stream_rxbatch {
+	struct stream *s;
+	int fd;
+	struct mbuf *mbv[STREAM_BATCH_MAX];
+
+	struct {
+		uint64_t wakeups;
+		uint64_t pkts;
+		uint64_t max;
+		uint64_t trunc;
+		uint64_t alloc;
+	} stats;
+};
+#endif
+
+
 static void stream_close(struct stream *strm, int err)
 {
 	stream_error_h *errorh = strm->errorh;
@@ -99,21 +173,25 @@ static inline int lostcalc(struct stream *s, uint16_t seq)
 
 static void print_rtp_stats(const struct stream *s)
 {
-	bool started = s->metric_tx.n_packets>0 || s->metric_rx.n_packets>0;
+	bool started = metric_n_packets(&s->metric_tx) > 0 ||
+		metric_n_packets(&s->metric_rx) > 0;
 
 	if (!started)
 		return;
 
 	info("\n%-9s       Transmit:     Receive:\n"
-	     "packets:        %7u      %7u\n"
+	     "packets:        %7llu      %7llu\n"
 	     "avg. bitrate:   %7.1f      %7.1f  (kbit/s)\n"
-	     "errors:         %7d      %7d\n"
+	     "peak bitrate:   %7.1f      %7.1f  (kbit/s)\n"
+	     "errors:         %7llu      %7llu\n"
 	     ,
 	     sdp_media_name(s->sdp),
-	     s->metric_tx.n_packets, s->metric_rx.n_packets,
+	     metric_n_packets(&s->metric_tx), metric_n_packets(&s->metric_rx),
 	     1.0*metric_avg_bitrate(&s->metric_tx)/1000.0,
 	     1.0*metric_avg_bitrate(&s->metric_rx)/1000.0,
-	     s->metric_tx.n_err, s->metric_rx.n_err
+	     metric_peak_bitrate(&s->metric_tx)/1000.0,
+	     metric_peak_bitrate(&s->metric_rx)/1000.0,
+	     metric_n_err(&s->metric_tx), metric_n_err(&s->metric_rx)
 	     );
 
 	if (s->rtcp_stats.tx.sent || s->rtcp_stats.rx.sent) {
@@ -141,6 +219,8 @@ static void stream_destructor(void *arg)
 
 	tmr_cancel(&s->tmr_rtp);
 	list_unlink(&s->le);
+	mem_deref(s->batch);
+	mem_deref(s->rxbatch);
 	mem_deref(s->rtpkeep);
 	mem_deref(s->sdp);
 	mem_deref(s->mes);
@@ -208,6 +288,101 @@ static void handle_rtp(struct stream *s, const struct rtp_header *hdr,
 }
 
 
+/*
+ * The receive time of each packet in the jitter buffer is kept in a
+ * small ring indexed by sequence number, for the jitter buffer delay.
+ */
+static void rxts_put(struct stream *s, uint16_t seq)
+{
+	unsigned i = seq % STREAM_RXTS_SLOTS;
+
+	s->rxtsv[i].jfs = tmr_jiffies_usec();
+	s->rxtsv[i].seq = seq;
+}
+
+
+static void rxts_get(struct stream *s, uint16_t seq)
+{
+	unsigned i = seq % STREAM_RXTS_SLOTS;
+
+	if (!s->rxtsv[i].jfs || s->rxtsv[i].seq != seq)
+		return;
+
+	stream_latency_add(s, LAT_JBUF, tmr_jiffies_usec() - s->rxtsv[i].jfs);
+
+	s->rxtsv[i].jfs = 0;
+}
+
+
+static int delay_cmp(const void *p1, const void *p2)
+{
+	const int32_t d1 = *(const int32_t *)p1;
+	const int32_t d2 = *(const int32_t *)p2;
+
+	return (d1 > d2) - (d1 < d2);
+}
+
+
+/*
+ * Estimate the jitter of arriving packets for the adaptive jitter
+ * buffer. The relative delay of a packet is its arrival time minus its
+ * RTP time, both counted from the first packet. The delay spread is the
+ * 95th percentile of the recent delays above their minimum, i.e. how
+ * much audio the playout buffer must hold so that late packets are
+ * still in time. Clock drift between the peers moves the minimum along.
+ *
+ * The spread is sorted out again every JIT_SPREAD_PKTS packets only, and
+ * the origin is moved along in whole seconds, so that the RTP time from
+ * the origin does not wrap.
+ */
+static void jitter_update(struct stream *s, uint32_t ts)
+{
+	int32_t sortv[STREAM_JIT_SLOTS];
+	const uint64_t now = tmr_jiffies_usec();
+	int64_t delay, d;
+	int32_t dts;
+	unsigned n;
+
+	if (!s->jit.n) {
+		s->jit.jfs0 = now;
+		s->jit.ts0  = ts;
+	}
+
+	dts = (int32_t)(ts - s->jit.ts0);
+	if (dts > (int32_t)(JIT_REBASE_SECS * s->srate_rx)) {
+
+		const uint32_t secs = (uint32_t)dts / s->srate_rx;
+
+		s->jit.ts0  += secs * s->srate_rx;
+		s->jit.jfs0 += secs * 1000000ULL;
+	}
+
+	delay = (int64_t)(now - s->jit.jfs0) -
+		(int64_t)(int32_t)(ts - s->jit.ts0) * 1000000 / s->srate_rx;
+
+	/* RFC 3550, A.8 */
+	if (s->jit.n) {
+		d = delay - s->jit.delay_last;
+		d = d < 0 ? -d : d;
+		s->jit.jitter = (uint32_t)(s->jit.jitter +
+					   (d - (int64_t)s->jit.jitter) / 16);
+	}
+
+	s->jit.delay_last = (int32_t)delay;
+	s->jit.delayv[s->jit.n++ % STREAM_JIT_SLOTS] = (int32_t)delay;
+
+	n = min(s->jit.n, (unsigned)STREAM_JIT_SLOTS);
+
+	if (n >= JIT_SPREAD_PKTS && s->jit.n % JIT_SPREAD_PKTS)
+		return;
+
+	memcpy(sortv, s->jit.delayv, n * sizeof(*sortv));
+	qsort(sortv, n, sizeof(*sortv), delay_cmp);
+
+	s->jit.spread = (uint32_t)(sortv[(n - 1) * 95 / 100] - sortv[0]);
+}
+
+
 static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 			struct mbuf *mb, void *arg)
 {
@@ -241,8 +416,12 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 			     mbuf_get_left(mb), src);
 		}
 		s->ssrc_rx = hdr->ssrc;
+		s->jit.n = 0;
 	}
 
+	if (s->jit.enabled && s->srate_rx)
+		jitter_update(s, hdr->ts);
+
 	if (s->jbuf) {
 
 		struct rtp_header hdr2;
@@ -257,7 +436,10 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 			info("%s: dropping %u bytes from %J (%m)\n",
 			     sdp_media_name(s->sdp), mb->end,
 			     src, err);
-			s->metric_rx.n_err++;
+			metric_add_err(&s->metric_rx);
+		}
+		else {
+			rxts_put(s, hdr->seq);
 		}
 
 		if (jbuf_get(s->jbuf, &hdr2, &mb2)) {
@@ -267,6 +449,9 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 
 			memset(&hdr2, 0, sizeof(hdr2));
 		}
+		else {
+			rxts_get(s, hdr2.seq);
+		}
 
 		s->jbuf_started = true;
 
@@ -306,6 +491,8 @@ static void rtcp_handler(const struct sa *src, struct rtcp_msg *msg, void *arg)
 
 		ua_event(call_get_ua(s->call), UA_EVENT_CALL_RTCP, s->call,
 			 "%s", sdp_media_name(stream_sdpmedia(s)));
+		ua_event(call_get_ua(s->call), UA_EVENT_CALL_LATENCY, s->call,
+			 "%s", sdp_media_name(stream_sdpmedia(s)));
 		break;
 	}
 }
@@ -348,6 +535,171 @@ static int stream_sock_alloc(struct stream *s, int af)
 }
 
 
+#ifdef LINUX
+static void rxbatch_read_handler(int flags, void *arg)
+{
+	struct stream_rxbatch *rb = arg;
+	struct mmsghdr msgv[STREAM_BATCH_MAX];
+	struct iovec iov[STREAM_BATCH_MAX];
+	struct sa srcv[STREAM_BATCH_MAX];
+	bool dropv[STREAM_BATCH_MAX];
+	const struct menc *menc = rb->s->menc;
+	int i, n, slots;
+
+	if (!(flags & FD_READ))
+		return;
+
+	/* refill the slots of mbufs kept by the handler */
+	for (slots=0; slots<STREAM_BATCH_MAX; slots++) {
+
+		if (rb->mbv[slots])
+			continue;
+
+		rb->mbv[slots] = mbuf_alloc(RXBATCH_BUFSZ);
+		if (!rb->mbv[slots])
+			break;
+
+		++rb->stats.alloc;
+	}
+
+	if (!slots)
+		return;
+
+	memset(msgv, 0, sizeof(msgv));
+
+	for (i=0; i<slots; i++) {
+
+		struct mbuf *mb = rb->mbv[i];
+
+		iov[i].iov_base = mb->buf;
+		iov[i].iov_len  = mb->size;
+
+		sa_init(&srcv[i], AF_UNSPEC);
+		msgv[i].msg_hdr.msg_name    = &srcv[i].u.sa;
+		msgv[i].msg_hdr.msg_namelen = sizeof(srcv[i].u);
+		msgv[i].msg_hdr.msg_iov     = &iov[i];
+		msgv[i].msg_hdr.msg_iovlen  = 1;
+	}
+
+	n = recvmmsg(rb->fd, msgv, slots, MSG_DONTWAIT, NULL);
+	if (n <= 0)
+		return;
+
+	++rb->stats.wakeups;
+	rb->stats.pkts += n;
+	rb->stats.max = max(rb->stats.max, (uint64_t)n);
+
+	for (i=0; i<n; i++) {
+
+		struct mbuf *mb = rb->mbv[i];
+
+		dropv[i] = true;
+
+		if (msgv[i].msg_hdr.msg_flags & MSG_TRUNC) {
+			++rb->stats.trunc;
+			continue;
+		}
+
+		srcv[i].len = msgv[i].msg_hdr.msg_namelen;
+
+		mb->pos = 0;
+		mb->end = msgv[i].msg_len;
+
+		/* RFC 5761: drop multiplexed RTCP, RTCP is disabled */
+		if (mb->end >= 2 && (mb->buf[1] & 0x7f) >= 64 &&
+		    (mb->buf[1] & 0x7f) <= 95)
+			continue;
+
+		dropv[i] = false;
+	}
+
+	/* decrypt the whole batch in one call */
+	if (menc && menc->unprotecth)
+		menc->unprotecth(rb->s->mes, rb->mbv, n, dropv);
+
+	for (i=0; i<n; i++) {
+
+		struct mbuf *mb = rb->mbv[i];
+		struct rtp_header hdr;
+
+		if (dropv[i])
+			continue;
+
+		if (rtp_decode(rb->s->rtp, mb, &hdr))
+			continue;
+
+		/* the slot is refilled before the next receive */
+		rb->mbv[i] = NULL;
+
+		rtp_handler(&srcv[i], &hdr, mb, rb->s);
+
+		if (mem_nrefs(mb) == 1)
+			rb->mbv[i] = mb;
+		else
+			mem_deref(mb);
+	}
+}
+
+
+static void rxbatch_destructor(void *arg)
+{
+	struct stream_rxbatch *rb = arg;
+	unsigned i;
+
+	if (rb->fd >= 0)
+		fd_close(rb->fd);
+
+	for (i=0; i<STREAM_BATCH_MAX; i++)
+		mem_deref(rb->mbv[i]);
+}
+
+
+static int rxbatch_alloc(struct stream *s, int af)
+{
+	struct stream_rxbatch *rb;
+	unsigned i;
+	int err;
+
+	rb = mem_zalloc(sizeof(*rb), rxbatch_destructor);
+	if (!rb)
+		return ENOMEM;
+
+	rb->s  = s;
+	rb->fd = -1;
+
+	for (i=0; i<STREAM_BATCH_MAX; i++) {
+
+		rb->mbv[i] = mbuf_alloc(RXBATCH_BUFSZ);
+		if (!rb->mbv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+
+	rb->fd = udp_sock_fd(rtp_sock(s->rtp), af);
+	if (rb->fd < 0) {
+		err = EBADF;
+		goto out;
+	}
+
+	/* replaces the read handler of libre for this socket */
+	err = fd_listen(rb->fd, FD_READ, rxbatch_read_handler, rb);
+	if (err) {
+		rb->fd = -1;
+		goto out;
+	}
+
+	s->rxbatch = rb;
+
+ out:
+	if (err)
+		mem_deref(rb);
+
+	return err;
+}
+#endif
+
+
 int stream_alloc(struct stream **sp, const struct stream_param *prm,
 		 const struct config_avt *cfg,
 		 struct call *call, struct sdp_session *sdp_sess,
@@ -452,6 +804,22 @@ int stream_alloc(struct stream **sp, const struct stream_param *prm,
 	if (err)
 		goto out;
 
+#ifdef LINUX
+	if (cfg->rtp_rx_batch && s->rtp) {
+
+		if (mnat || (menc && !menc->unprotecth) || s->rtcp) {
+			info("stream: %s: batched receive needs"
+			     " rtcp_enable=no, no medianat and a mediaenc"
+			     " with batch support\n", name);
+		}
+		else {
+			err = rxbatch_alloc(s, call_af(call));
+			if (err)
+				goto out;
+		}
+	}
+#endif
+
 	s->pt_enc = -1;
 
 	metric_init(&s->metric_tx);
@@ -521,7 +889,7 @@ int stream_send(struct stream *s, bool ext, bool marker, int pt, uint32_t ts,
 		err = rtp_send(s->rtp, sdp_media_raddr(s->sdp), ext,
 			       marker, pt, ts, mb);
 		if (err)
-			s->metric_tx.n_err++;
+			metric_add_err(&s->metric_tx);
 	}
 
 	rtpkeep_refresh(s->rtpkeep, ts);
@@ -567,6 +935,9 @@ void stream_update(struct stream *s)
 
 	s->pt_enc = fmt ? fmt->pt : -1;
 
+	/* SDP was renegotiated, rebuild on next lookup */
+	s->ptv_valid = false;
+
 	if (sdp_media_has_media(s->sdp))
 		stream_remote_set(s);
 
@@ -583,6 +954,69 @@ void stream_update(struct stream *s)
 }
 
 
+static void ptv_build(struct stream *s)
+{
+	struct le *le;
+
+	memset(s->ptv, 0, sizeof(s->ptv));
+
+	/* static payload type, accepted even if not negotiated */
+	s->ptv[PT_CN].cls = STREAM_PT_CN;
+
+	for (le = list_head(sdp_media_format_lst(s->sdp, true));
+	     le;
+	     le = le->next) {
+
+		const struct sdp_format *fmt = le->data;
+
+		if (fmt->pt < 0 || fmt->pt >= (int)ARRAY_SIZE(s->ptv))
+			continue;
+
+		s->ptv[fmt->pt].fmt = fmt;
+
+		if (!str_casecmp(fmt->name, "telephone-event"))
+			s->ptv[fmt->pt].cls = STREAM_PT_TELEV;
+		else if (!str_casecmp(fmt->name, "CN"))
+			s->ptv[fmt->pt].cls = STREAM_PT_CN;
+		else
+			s->ptv[fmt->pt].cls = STREAM_PT_CODEC;
+	}
+
+	s->ptv_valid = true;
+}
+
+
+/**
+ * Classify an incoming RTP payload type
+ *
+ * The table is built from the local SDP formats on first use and
+ * rebuilt after each SDP negotiation, so the lookup is O(1).
+ *
+ * @param s    Stream object
+ * @param pt   RTP payload type
+ * @param clsp Returned payload type class (optional)
+ *
+ * @return Local SDP format, or NULL if not found
+ */
+const struct sdp_format *stream_pt_lookup(struct stream *s, uint8_t pt,
+					  enum stream_ptclass *clsp)
+{
+	if (!s || pt >= ARRAY_SIZE(s->ptv)) {
+		if (clsp)
+			*clsp = STREAM_PT_UNKNOWN;
+		return NULL;
+	}
+
+	if (!s->ptv_valid)
+		ptv_build(s);
+
+	if (clsp)
+		*clsp = s->ptv[pt].cls;
+
+	return s->ptv[pt].fmt;
+}
+
+
 void stream_update_encoder(struct stream *s, int pt_enc)
 {
 	if (!s)
@@ -633,6 +1067,11 @@ void stream_set_srate(struct stream *s, uint32_t srate_tx, uint32_t srate_rx)
 		return;
 
 	rtcp_set_srate(s->rtp, srate_tx, srate_rx);
+
+	if (srate_rx != s->srate_rx) {
+		s->srate_rx = srate_rx;
+		s->jit.n = 0;
+	}
 }
 
 
@@ -649,7 +1088,7 @@ void stream_send_fir(struct stream *s, bool pli)
 		err = rtcp_send_fir(s->rtp, rtp_sess_ssrc(s->rtp));
 
 	if (err) {
-		s->metric_tx.n_err++;
+		metric_add_err(&s->metric_tx);
 
 		warning("stream: failed to send RTCP %s: %m\n",
 			pli ? "PLI" : "FIR", err);
@@ -663,11 +1102,68 @@ void stream_reset(struct stream *s)
 		return;
 
 	jbuf_flush(s->jbuf);
+	s->jit.n = 0;
 
 	stream_start_keepalive(s);
 }
 
 
+/**
+ * Let the receiver adapt the playout delay. The jitter buffer then
+ * hands out packets as they arrive, without a fixed delay, and the
+ * delay spread of the arriving packets is estimated.
+ *
+ * @param s Stream object
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_jbuf_adaptive(struct stream *s)
+{
+	int err;
+
+	if (!s)
+		return EINVAL;
+
+	if (s->jbuf) {
+		s->jbuf = mem_deref(s->jbuf);
+
+		err = jbuf_alloc(&s->jbuf, 1, max(s->cfg.jbuf_del.max, 1U));
+		if (err)
+			return err;
+	}
+
+	s->jit.enabled = true;
+
+	return 0;
+}
+
+
+/**
+ * Get the smoothed interarrival jitter, as in RFC 3550
+ *
+ * @param s Stream object
+ *
+ * @return Jitter in [us]
+ */
+uint32_t stream_jitter(const struct stream *s)
+{
+	return s ? s->jit.jitter : 0;
+}
+
+
+/**
+ * Get the delay spread of the arriving packets
+ *
+ * @param s Stream object
+ *
+ * @return Delay spread in [us], 0 if not estimated
+ */
+uint32_t stream_delay_spread(const struct stream *s)
+{
+	return s ? s->jit.spread : 0;
+}
+
+
 void stream_set_bw(struct stream *s, uint32_t bps)
 {
 	if (!s)
@@ -708,6 +1204,184 @@ void stream_set_error_handler(struct stream *strm,
 }
 
 
+#ifdef LINUX
+static int batch_flush(struct stream_batch *b)
+{
+	struct mmsghdr msgv[STREAM_BATCH_MAX];
+	struct iovec iov[STREAM_BATCH_MAX];
+	unsigned i, sent = 0;
+	int fd, err = 0;
+
+	if (!b->n)
+		return 0;
+
+	fd = udp_sock_fd(b->us, sa_af(&b->dstv[0]));
+
+	memset(msgv, 0, b->n * sizeof(*msgv));
+
+	for (i=0; i<b->n; i++) {
+
+		iov[i].iov_base = b->bufv[i];
+		iov[i].iov_len  = b->lenv[i];
+
+		msgv[i].msg_hdr.msg_name    = &b->dstv[i].u.sa;
+		msgv[i].msg_hdr.msg_namelen = b->dstv[i].len;
+		msgv[i].msg_hdr.msg_iov     = &iov[i];
+		msgv[i].msg_hdr.msg_iovlen  = 1;
+	}
+
+	while (sent < b->n) {
+
+		int r = sendmmsg(fd, &msgv[sent], b->n - sent, 0);
+
+		++b->stats.syscalls;
+
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+
+			err = errno;
+
+			/* the socket is full, drop the rest of the batch */
+			if (err == EAGAIN || err == EWOULDBLOCK ||
+			    err == ENOBUFS) {
+				b->stats.err += b->n - sent;
+				break;
+			}
+
+			/* skip the failed message and send the rest */
+			++b->stats.err;
+			++sent;
+			continue;
+		}
+
+		sent += r;
+	}
+
+	b->stats.pkts += b->n;
+	b->n = 0;
+
+	return err;
+}
+
+
+static bool batch_send_handler(int *err, struct sa *dst, struct mbuf *mb,
+			       void *arg)
+{
+	struct stream_batch *b = arg;
+	size_t len = mbuf_get_left(mb);
+
+	if (!b->active || len > BATCH_BUFSZ)
+		return false;
+
+	if (udp_sock_fd(b->us, sa_af(dst)) < 0)
+		return false;
+
+	if (b->n == STREAM_BATCH_MAX ||
+	    (b->n && sa_af(dst) != sa_af(&b->dstv[0])))
+		*err = batch_flush(b);
+
+	memcpy(b->bufv[b->n], mbuf_buf(mb), len);
+	b->lenv[b->n] = len;
+	sa_cpy(&b->dstv[b->n], dst);
+	++b->n;
+
+	return true;
+}
+
+
+static bool batch_recv_handler(struct sa *src, struct mbuf *mb, void *arg)
+{
+	(void)src;
+	(void)mb;
+	(void)arg;
+
+	return false;
+}
+
+
+static void batch_destructor(void *arg)
+{
+	struct stream_batch *b = arg;
+
+	mem_deref(b->uh);
+}
+
+
+static int batch_alloc(struct stream *s)
+{
+	struct stream_batch *b;
+	int err;
+
+	b = mem_zalloc(sizeof(*b), batch_destructor);
+	if (!b)
+		return ENOMEM;
+
+	b->us = rtp_sock(s->rtp);
+
+	err = udp_register_helper(&b->uh, b->us, BATCH_LAYER,
+				  batch_send_handler, batch_recv_handler, b);
+	if (err) {
+		mem_deref(b);
+		return err;
+	}
+
+	s->batch = b;
+
+	return 0;
+}
+#endif
+
+
+/**
+ * Send a batch of RTP packets on a media stream
+ *
+ * Each packet goes through the normal RTP send path, including RTCP
+ * accounting and media encryption, but on Linux the resulting
+ * datagrams are transmitted with a single sendmmsg() system call.
+ *
+ * @param s    Stream object
+ * @param ext  Extension bit
+ * @param pktv Array of packets
+ * @param pktc Number of packets
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int stream_send_batch(struct stream *s, bool ext,
+		      const struct stream_pkt *pktv, size_t pktc)
+{
+	size_t i;
+	int err = 0;
+
+	if (!s || (!pktv && pktc))
+		return EINVAL;
+
+#ifdef LINUX
+	if (pktc > 1 && !s->batch && s->rtp) {
+		if (batch_alloc(s))
+			warning("stream: batch send not available\n");
+	}
+
+	if (s->batch)
+		s->batch->active = true;
+#endif
+
+	for (i=0; i<pktc; i++) {
+		err |= stream_send(s, ext, pktv[i].marker, pktv[i].pt,
+				   pktv[i].ts, pktv[i].mb);
+	}
+
+#ifdef LINUX
+	if (s->batch) {
+		s->batch->active = false;
+		err |= batch_flush(s->batch);
+	}
+#endif
+
+	return err;
+}
+
+
 int stream_debug(struct re_printf *pf, const struct stream *s)
 {
 	struct sa rrtcp;
@@ -725,8 +1399,46 @@ int stream_debug(struct re_printf *pf, const struct stream *s)
 			  sdp_media_laddr(s->sdp),
 			  sdp_media_raddr(s->sdp), &rrtcp);
 
+	err |= metric_debug(pf, "tx", &s->metric_tx);
+	err |= metric_debug(pf, "rx", &s->metric_rx);
+
 	err |= rtp_debug(pf, s->rtp);
 	err |= jbuf_debug(pf, s->jbuf);
+	err |= latency_debug(pf, &s->lat);
+
+	if (s->jit.enabled) {
+		err |= re_hprintf(pf, " jitter: %.2fms, delay spread %.2fms\n",
+				  s->jit.jitter / 1000.0,
+				  s->jit.spread / 1000.0);
+	}
+
+#ifdef LINUX
+	if (s->batch) {
+		const struct stream_batch *b = s->batch;
+
+		err |= re_hprintf(pf, " batch: packets %llu, syscalls %llu"
+				  " (%.3f per packet), errors %llu\n",
+				  b->stats.pkts, b->stats.syscalls,
+				  b->stats.pkts ?
+				  (double)b->stats.syscalls / b->stats.pkts
+				  : 0.0,
+				  b->stats.err);
+	}
+
+	if (s->rxbatch) {
+		const struct stream_rxbatch *rb = s->rxbatch;
+
+		err |= re_hprintf(pf, " rx batch: packets %llu, wakeups %llu"
+				  " (%.2f per wakeup, max %llu),"
+				  " truncated %llu, pool allocs %llu\n",
+				  rb->stats.pkts, rb->stats.wakeups,
+				  rb->stats.wakeups ?
+				  (double)rb->stats.pkts / rb->stats.wakeups
+				  : 0.0,
+				  rb->stats.max, rb->stats.trunc,
+				  rb->stats.alloc);
+	}
+#endif
 
 	return err;
 }
@@ -737,9 +1449,9 @@ int stream_print(struct re_printf *pf, const struct stream *s)
 	if (!s)
 		return 0;
 
-	return re_hprintf(pf, " %s=%u/%u", sdp_media_name(s->sdp),
-			  s->metric_tx.cur_bitrate,
-			  s->metric_rx.cur_bitrate);
+	return re_hprintf(pf, " %s=%llu/%llu", sdp_media_name(s->sdp),
+			  metric_bitrate(&s->metric_tx, 1),
+			  metric_bitrate(&s->metric_rx, 1));
 }
 
 
@@ -749,6 +1461,38 @@ const struct rtcp_stats *stream_rtcp_stats(const struct stream *strm)
 }
 
 
+/**
+ * Get the latency histograms of the stream
+ *
+ * @param strm Stream object
+ *
+ * @return Latency histograms, one per pipeline stage
+ */
+const struct latency *stream_latency(const struct stream *strm)
+{
+	return strm ? &strm->lat : NULL;
+}
+
+
+/**
+ * Record the latency of one pipeline stage
+ *
+ * @param s     Stream object
+ * @param stage Pipeline stage
+ * @param usec  Latency in [us]
+ *
+ * @note This function may be called from any thread
+ */
+void stream_latency_add(struct stream *s, enum lat_stage stage,
+			uint64_t usec)
+{
+	if (!s || (unsigned)stage >= LAT_STAGES)
+		return;
+
+	lathist_add(&s->lat.histv[stage], usec);
+}
+
+
 /**
  * Get the call object from the stream
  *
@@ -0,0 +1,413 @@
+/**
+ * @file txsched.c  Shared audio transmit scheduler
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#define _DEFAULT_SOURCE 1
+#define _BSD_SOURCE 1
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page TxSched Shared audio transmit scheduler
+ *
+ * Instead of one polling thread per audio stream, a small pool of
+ * worker threads drives all active transmitters. Each worker keeps its
+ * entries in a list sorted by deadline, sleeps until the earliest one
+ * is due, calls the handler and re-inserts the entry at its next
+ * deadline. New entries are assigned to the least loaded worker.
+ *
+ * The pool is created when the first entry is added and destroyed
+ * when the last entry is removed.
+ */
+
+
+#ifdef LINUX
+#define TXSCHED_CLOCK CLOCK_MONOTONIC
+#else
+#define TXSCHED_CLOCK CLOCK_REALTIME
+#endif
+
+
+enum {
+	MAX_WORKERS = 64,
+	MAX_CATCHUP = 4,     /**< Max periods behind before realigning */
+	LATE_USEC   = 1000,  /**< Tick is counted as late after this   */
+};
+
+
+struct txsched_worker {
+	struct txsched *sched;
+	pthread_t tid;
+	pthread_cond_t cond;
+	struct list entryl;          /**< Entries sorted by deadline   */
+	unsigned idx;
+	bool run;
+
+	struct {
+		uint64_t ticks;      /**< Handler invocations          */
+		uint64_t late;       /**< Ticks later than LATE_USEC   */
+		uint64_t busy_usec;  /**< Time spent in handlers       */
+		uint64_t start_usec; /**< Worker start time            */
+	} stats;
+};
+
+struct txsched {
+	pthread_mutex_t mutex;
+	struct txsched_worker *workerv;
+	unsigned workerc;
+};
+
+struct txsched_entry {
+	struct le le;
+	struct txsched_worker *w;
+	uint64_t deadline;           /**< Next deadline in [us]        */
+	txsched_h *h;
+	void *arg;
+	bool running;                /**< Handler is executing         */
+};
+
+
+static struct txsched *txsched;
+
+
+static uint64_t now_usec(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(TXSCHED_CLOCK, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static bool sort_handler(struct le *le1, struct le *le2, void *arg)
+{
+	const struct txsched_entry *e1 = le1->data;
+	const struct txsched_entry *e2 = le2->data;
+	(void)arg;
+
+	return e1->deadline <= e2->deadline;
+}
+
+
+/* NOTE: must be called with the mutex held */
+static void entry_insert(struct txsched_entry *e)
+{
+	list_insert_sorted(&e->w->entryl, sort_handler, NULL, &e->le, e);
+}
+
+
+static void *worker_thread(void *arg)
+{
+	struct txsched_worker *w = arg;
+	struct txsched *sched = w->sched;
+	char name[16];
+
+	re_snprintf(name, sizeof(name), "baresip-tx%u", w->idx);
+	(void)realtime_thread_setup(REALTIME_THREAD_AUDIO, name);
+
+	pthread_mutex_lock(&sched->mutex);
+
+	w->stats.start_usec = now_usec();
+
+	while (w->run) {
+
+		struct txsched_entry *e;
+		uint64_t now, t0, period;
+
+		e = list_ledata(list_head(&w->entryl));
+		if (!e) {
+			pthread_cond_wait(&w->cond, &sched->mutex);
+			continue;
+		}
+
+		now = now_usec();
+		if (e->deadline > now) {
+			struct timespec ts;
+
+			ts.tv_sec  = e->deadline / 1000000;
+			ts.tv_nsec = (e->deadline % 1000000) * 1000;
+
+			(void)pthread_cond_timedwait(&w->cond, &sched->mutex,
+						     &ts);
+			continue;
+		}
+
+		if (now - e->deadline > LATE_USEC)
+			++w->stats.late;
+
+		list_unlink(&e->le);
+		e->running = true;
+
+		pthread_mutex_unlock(&sched->mutex);
+
+		t0 = now_usec();
+		period = e->h(e->arg);
+		now = now_usec();
+
+		pthread_mutex_lock(&sched->mutex);
+
+		e->running = false;
+		++w->stats.ticks;
+		w->stats.busy_usec += now - t0;
+
+		if (e->w) {
+			e->deadline += period;
+
+			if (period && now > e->deadline + MAX_CATCHUP * period)
+				e->deadline = now + period;
+
+			entry_insert(e);
+		}
+
+		/* wake up a pending entry destructor */
+		pthread_cond_broadcast(&w->cond);
+	}
+
+	pthread_mutex_unlock(&sched->mutex);
+
+	return NULL;
+}
+
+
+static void txsched_destructor(void *data)
+{
+	struct txsched *sched = data;
+	unsigned i;
+
+	pthread_mutex_lock(&sched->mutex);
+	for (i=0; i<sched->workerc; i++) {
+		sched->workerv[i].run = false;
+		pthread_cond_broadcast(&sched->workerv[i].cond);
+	}
+	pthread_mutex_unlock(&sched->mutex);
+
+	for (i=0; i<sched->workerc; i++) {
+		struct txsched_worker *w = &sched->workerv[i];
+
+		pthread_join(w->tid, NULL);
+		pthread_cond_destroy(&w->cond);
+	}
+
+	mem_deref(sched->workerv);
+	pthread_mutex_destroy(&sched->mutex);
+
+	if (txsched == sched)
+		txsched = NULL;
+}
+
+
+static int cond_init(pthread_cond_t *cond)
+{
+	pthread_condattr_t attr;
+	int err;
+
+	err = pthread_condattr_init(&attr);
+	if (err)
+		return err;
+
+#ifdef LINUX
+	err = pthread_condattr_setclock(&attr, TXSCHED_CLOCK);
+	if (!err)
+#endif
+		err = pthread_cond_init(cond, &attr);
+
+	pthread_condattr_destroy(&attr);
+
+	return err;
+}
+
+
+static int txsched_alloc(struct txsched **schedp, uint32_t workerc)
+{
+	struct txsched *sched;
+	unsigned i;
+	int err = 0;
+
+	if (!workerc) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		workerc = n > 0 ? (uint32_t)n : 1;
+	}
+	workerc = min(workerc, MAX_WORKERS);
+
+	sched = mem_zalloc(sizeof(*sched), txsched_destructor);
+	if (!sched)
+		return ENOMEM;
+
+	sched->workerv = mem_zalloc(workerc * sizeof(*sched->workerv), NULL);
+	if (!sched->workerv) {
+		mem_deref(sched);
+		return ENOMEM;
+	}
+
+	err = pthread_mutex_init(&sched->mutex, NULL);
+	if (err) {
+		mem_deref(sched->workerv);
+		sched->workerv = NULL;
+		mem_deref(sched);
+		return err;
+	}
+
+	for (i=0; i<workerc; i++) {
+		struct txsched_worker *w = &sched->workerv[i];
+
+		w->sched = sched;
+		w->idx   = i;
+		w->run   = true;
+
+		err = cond_init(&w->cond);
+		if (err)
+			goto out;
+
+		err = pthread_create(&w->tid, NULL, worker_thread, w);
+		if (err) {
+			pthread_cond_destroy(&w->cond);
+			goto out;
+		}
+
+		++sched->workerc;
+	}
+
+	info("txsched: started %u worker%s\n",
+	     sched->workerc, sched->workerc == 1 ? "" : "s");
+
+ out:
+	if (err)
+		mem_deref(sched);
+	else
+		*schedp = sched;
+
+	return err;
+}
+
+
+static void entry_destructor(void *data)
+{
+	struct txsched_entry *e = data;
+	struct txsched *sched = txsched;
+	struct txsched_worker *w = e->w;
+
+	if (sched && w) {
+		pthread_mutex_lock(&sched->mutex);
+
+		e->w = NULL;
+		while (e->running)
+			pthread_cond_wait(&w->cond, &sched->mutex);
+
+		list_unlink(&e->le);
+
+		pthread_mutex_unlock(&sched->mutex);
+	}
+
+	mem_deref(sched);
+}
+
+
+/**
+ * Add a periodic handler to the shared transmit scheduler
+ *
+ * @param ep      Pointer to allocated scheduler entry
+ * @param workerc Number of workers if the pool is created (0 = one/CPU)
+ * @param h       Handler, returns the period until next call in [us]
+ * @param arg     Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int txsched_add(struct txsched_entry **ep, uint32_t workerc,
+		txsched_h *h, void *arg)
+{
+	struct txsched_entry *e;
+	struct txsched_worker *w;
+	unsigned i;
+	int err;
+
+	if (!ep || !h)
+		return EINVAL;
+
+	e = mem_zalloc(sizeof(*e), entry_destructor);
+	if (!e)
+		return ENOMEM;
+
+	if (txsched) {
+		mem_ref(txsched);
+	}
+	else {
+		err = txsched_alloc(&txsched, workerc);
+		if (err) {
+			mem_deref(e);
+			return err;
+		}
+	}
+
+	e->h   = h;
+	e->arg = arg;
+
+	pthread_mutex_lock(&txsched->mutex);
+
+	/* assign to the worker with the fewest entries */
+	w = &txsched->workerv[0];
+	for (i=1; i<txsched->workerc; i++) {
+		if (list_count(&txsched->workerv[i].entryl) <
+		    list_count(&w->entryl))
+			w = &txsched->workerv[i];
+	}
+
+	e->w = w;
+	e->deadline = now_usec();
+	entry_insert(e);
+
+	pthread_cond_broadcast(&w->cond);
+
+	pthread_mutex_unlock(&txsched->mutex);
+
+	*ep = e;
+
+	return 0;
+}
+
+
+/**
+ * Print the per-worker load of the shared transmit scheduler
+ *
+ * @param pf Print function
+ * @param e  Scheduler entry of the caller (optional)
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int txsched_debug(struct re_printf *pf, const struct txsched_entry *e)
+{
+	struct txsched *sched = txsched;
+	uint64_t now;
+	unsigned i;
+	int err = 0;
+
+	if (!sched)
+		return 0;
+
+	pthread_mutex_lock(&sched->mutex);
+
+	now = now_usec();
+
+	for (i=0; i<sched->workerc; i++) {
+		const struct txsched_worker *w = &sched->workerv[i];
+		uint64_t wall = now - w->stats.start_usec;
+
+		err |= re_hprintf(pf, "       worker %u%s: entries %u,"
+				  " ticks %llu, late %llu, load %.2f%%\n",
+				  w->idx, (e && e->w == w) ? "*" : "",
+				  list_count(&w->entryl),
+				  w->stats.ticks, w->stats.late,
+				  wall ? 100.0 * w->stats.busy_usec / wall
+				  : 0.0);
+	}
+
+	pthread_mutex_unlock(&sched->mutex);
+
+	return err;
+}
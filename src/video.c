@@ -7,6 +7,9 @@
  */
 #include <string.h>
 #include <stdlib.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -31,6 +34,20 @@ enum {
 	RTP_PRESZ       = 4 + RTP_HEADER_SIZE, /**< TURN and RTP header */
 	RTP_TRAILSZ     = 12 + 4,              /**< SRTP/SRTCP trailer  */
 	PICUP_INTERVAL  = 500,
+	PKTSIZE         = 1400,                /**< Encoder packet size */
+	SENDQ_SLOTS_MIN = 256,                 /**< Power of two        */
+	SENDQ_SLOTS_MAX = 4096,                /**< Power of two        */
+	KEYFRAME_RATIO  = 10,                  /**< Raw to I-frame size */
+	SENDQ_HDRSZ     = 16,                  /**< Payload header room */
+	PACE_DEPTH      = 5000,                /**< Bucket depth in [us]*/
+	RXQ_SLOTS       = 256,                 /**< Power of two        */
+};
+
+/** Decoder events handled in the main thread */
+enum vrx_event {
+	VRX_PICUP,         /**< Request a picture update from the peer */
+	VRX_INTRA,         /**< Intra-frame decoded                    */
+	VRX_CLOSED,        /**< Video display was closed               */
 };
 
 
@@ -87,9 +104,16 @@ struct vtx {
 	struct lock *lock_enc;             /**< Lock for encoder          */
 	struct vidframe *frame;            /**< Source frame              */
 	struct vidframe *mute_frame;       /**< Frame with muted video    */
-	struct lock *lock_tx;              /**< Protect the sendq         */
-	struct list sendq;                 /**< Tx-Queue (struct vidqent) */
+	struct vidslot *sendq;             /**< Tx-Queue, ring of slots   */
+	unsigned sendq_slots;              /**< Ring size, power of two   */
+	unsigned sendq_head;               /**< Written by encoder only   */
+	unsigned sendq_tail;               /**< Written by RTP timer only */
 	struct tmr tmr_rtp;                /**< Timer for sending RTP     */
+	struct {
+		uint64_t jfs;              /**< Last token refill [us]    */
+		uint64_t frame_jfs;        /**< First pkt of frame queued */
+		double tokens;             /**< Token bucket in [bytes]   */
+	} pace;
 	unsigned skipc;                    /**< Number of frames skipped  */
 	struct list filtl;                 /**< Filters in encoding order */
 	char device[128];                  /**< Source device name        */
@@ -105,6 +129,13 @@ struct vtx {
 	/** Statistics */
 	struct {
 		uint64_t src_frames;       /**< Total frames from vidsrc  */
+		uint64_t sendq_full;       /**< Packets dropped, ring full*/
+		uint64_t sendq_grow;       /**< Slots grown for big pkts  */
+		unsigned sendq_hwm;        /**< Ring high-water mark      */
+		uint64_t pace_frames;      /**< Frames sent by the pacer  */
+		uint64_t pace_delay_sum;   /**< Sum of frame delay [us]   */
+		uint64_t pace_delay_max;   /**< Max frame delay [us]      */
+		uint64_t pace_late;        /**< Pkts sent over the budget */
 	} stats;
 };
 
@@ -145,10 +176,34 @@ struct vrx {
 	unsigned n_picup;                  /**< Picture updates sent      */
 	uint32_t ts_min;
 	uint32_t ts_max;
+	bool wait_key;                     /**< Skip frames until intra   */
+#ifdef HAVE_PTHREAD
+	struct {
+		pthread_t tid;             /**< Decode thread             */
+		pthread_mutex_t mutex;     /**< Protects the ring         */
+		pthread_cond_t cond;       /**< Signals queued packets    */
+		struct vidrxslot *q;       /**< Rx-Queue, ring of slots   */
+		struct mqueue *mq;         /**< Events to the main thread */
+		unsigned head;             /**< Written by main thread    */
+		unsigned tail;             /**< Written by decode thread  */
+		bool flush;                /**< Drop all queued packets   */
+		bool run;                  /**< Decode thread is running  */
+	} thr;
+#endif
 
 	/** Statistics */
 	struct {
 		uint64_t disp_frames;      /** Total frames displayed     */
+		uint64_t dec_frames;       /**< Frames decoded            */
+		uint64_t dec_usec_sum;     /**< Sum of decode time [us]   */
+		uint64_t dec_usec_max;     /**< Max decode time [us]      */
+		uint64_t skip_frames;      /**< Frames skipped for intra  */
+		uint64_t rxq_drops;        /**< Packets dropped, behind   */
+		uint64_t rxq_flush;        /**< Times dropped to intra    */
+		uint64_t rxq_delay_sum;    /**< Sum of queue delay [us]   */
+		uint64_t rxq_delay_max;    /**< Max queue delay [us]      */
+		uint64_t rxq_pkts;         /**< Packets decoded from ring */
+		unsigned rxq_hwm;          /**< Ring high-water mark      */
 	} stats;
 };
 
@@ -169,129 +224,332 @@ struct video {
 };
 
 
-struct vidqent {
-	struct le le;
-	struct sa dst;
-	bool marker;
-	uint8_t pt;
+/**
+ * One outgoing RTP packet in the send ring. The mbufs are allocated up
+ * front with room for RTP/TURN headers and SRTP trailer, so that the
+ * encoder thread never allocates on the send path.
+ *
+ * The ring has one producer (the encoder, serialized by lock_enc) and
+ * one consumer (the RTP timer in the main thread).
+ */
+struct vidslot {
+	struct mbuf *mb;
+	uint64_t jfs;
 	uint32_t ts;
+	uint8_t pt;
+	bool marker;
+};
+
+
+/**
+ * One incoming RTP packet in the receive ring, used when decoding in a
+ * worker thread. The main thread copies the payload into the slot, so
+ * the receive buffer can be reused as soon as the handler returns.
+ *
+ * The ring has one producer (the RTP receive handler in the main
+ * thread) and one consumer (the decode thread). When it is full the
+ * decoder is falling behind; all queued packets are dropped and
+ * frames are skipped until the next intra-frame.
+ */
+struct vidrxslot {
+	struct rtp_header hdr;
 	struct mbuf *mb;
+	uint64_t jfs;
 };
 
 
 static void request_picture_update(struct vrx *vrx);
+#ifdef HAVE_PTHREAD
+static void rxq_stop(struct vrx *vrx);
+#endif
 
 
-static void vidqent_destructor(void *arg)
+static void sendq_destructor(void *arg)
 {
-	struct vidqent *qent = arg;
+	struct vidslot *slotv = arg;
+	unsigned i;
 
-	list_unlink(&qent->le);
-	mem_deref(qent->mb);
+	/* the ring is terminated by a slot without mbuf */
+	for (i=0; slotv[i].mb; i++)
+		mem_deref(slotv[i].mb);
 }
 
 
-static int vidqent_alloc(struct vidqent **qentp,
-			 bool marker, uint8_t pt, uint32_t ts,
-			 const uint8_t *hdr, size_t hdr_len,
-			 const uint8_t *pld, size_t pld_len)
+/*
+ * The ring holds one second of packets at the configured bitrate, or
+ * a keyframe of the configured size, whichever is larger, so that a
+ * keyframe and the frames queued behind it are not dropped.
+ */
+static unsigned sendq_slots(const struct config_video *cfg)
 {
-	struct vidqent *qent;
-	int err = 0;
+	const size_t raw = (size_t)cfg->width * cfg->height * 3 / 2;
+	const size_t bytes = max((size_t)cfg->bitrate / 8,
+				 raw / KEYFRAME_RATIO);
+	unsigned n = SENDQ_SLOTS_MIN;
 
-	if (!qentp || !pld)
-		return EINVAL;
+	while (n < SENDQ_SLOTS_MAX && n * PKTSIZE < bytes)
+		n *= 2;
+
+	return n;
+}
+
+
+static int sendq_alloc(struct vtx *vtx, const struct config_video *cfg)
+{
+	const size_t sz = RTP_PRESZ + SENDQ_HDRSZ + PKTSIZE + RTP_TRAILSZ;
+	unsigned i;
+
+	vtx->sendq_slots = sendq_slots(cfg);
 
-	qent = mem_zalloc(sizeof(*qent), vidqent_destructor);
-	if (!qent)
+	vtx->sendq = mem_zalloc((vtx->sendq_slots + 1) * sizeof(*vtx->sendq),
+				sendq_destructor);
+	if (!vtx->sendq)
 		return ENOMEM;
 
-	qent->marker = marker;
-	qent->pt     = pt;
-	qent->ts     = ts;
+	for (i=0; i<vtx->sendq_slots; i++) {
 
-	qent->mb = mbuf_alloc(RTP_PRESZ + hdr_len + pld_len + RTP_TRAILSZ);
-	if (!qent->mb) {
-		err = ENOMEM;
-		goto out;
+		vtx->sendq[i].mb = mbuf_alloc(sz);
+		if (!vtx->sendq[i].mb)
+			return ENOMEM;
 	}
 
-	qent->mb->pos = qent->mb->end = RTP_PRESZ;
+	return 0;
+}
 
-	if (hdr)
-		(void)mbuf_write_mem(qent->mb, hdr, hdr_len);
 
-	(void)mbuf_write_mem(qent->mb, pld, pld_len);
+static inline struct vidslot *sendq_slot(const struct vtx *vtx,
+					 unsigned i)
+{
+	return &vtx->sendq[i & (vtx->sendq_slots - 1)];
+}
 
-	qent->mb->pos = RTP_PRESZ;
 
- out:
+static unsigned sendq_count(const struct vtx *vtx)
+{
+	unsigned head = __atomic_load_n(&vtx->sendq_head, __ATOMIC_ACQUIRE);
+	unsigned tail = __atomic_load_n(&vtx->sendq_tail, __ATOMIC_ACQUIRE);
+
+	return head - tail;
+}
+
+
+/* NOTE: producer side, called with lock_enc held */
+static int sendq_push(struct vtx *vtx, bool marker, uint8_t pt, uint32_t ts,
+		      const uint8_t *hdr, size_t hdr_len,
+		      const uint8_t *pld, size_t pld_len)
+{
+	unsigned head = vtx->sendq_head;
+	unsigned tail = __atomic_load_n(&vtx->sendq_tail, __ATOMIC_ACQUIRE);
+	size_t need = RTP_PRESZ + hdr_len + pld_len + RTP_TRAILSZ;
+	struct vidslot *slot;
+	struct mbuf *mb;
+	int err = 0;
+
+	if (head - tail >= vtx->sendq_slots) {
+
+		const uint64_t full = ++vtx->stats.sendq_full;
+
+		/* log the 1st, 2nd, 4th, 8th .. dropped packet */
+		if (!(full & (full - 1))) {
+			warning("video: send queue full (%u packets),"
+				" %llu packets dropped\n",
+				vtx->sendq_slots, full);
+		}
+
+		return ENOSPC;
+	}
+
+	slot = sendq_slot(vtx, head);
+	mb = slot->mb;
+
+	if (need > mb->size) {
+		err = mbuf_resize(mb, need);
+		if (err)
+			return err;
+
+		++vtx->stats.sendq_grow;
+	}
+
+	mb->pos = mb->end = RTP_PRESZ;
+
+	if (hdr)
+		err |= mbuf_write_mem(mb, hdr, hdr_len);
+	err |= mbuf_write_mem(mb, pld, pld_len);
 	if (err)
-		mem_deref(qent);
-	else
-		*qentp = qent;
+		return err;
 
-	return err;
+	mb->pos = RTP_PRESZ;
+
+	slot->jfs    = tmr_jiffies_usec();
+	slot->marker = marker;
+	slot->pt     = pt;
+	slot->ts     = ts;
+
+	__atomic_store_n(&vtx->sendq_head, head + 1, __ATOMIC_RELEASE);
+
+	if (head + 1 - tail > vtx->stats.sendq_hwm)
+		vtx->stats.sendq_hwm = head + 1 - tail;
+
+	return 0;
 }
 
 
-static void vidqueue_poll(struct vtx *vtx, uint64_t jfs, uint64_t prev_jfs)
+static void vidqueue_sent(struct vtx *vtx, const struct vidslot *slot,
+			  uint64_t now)
 {
-	size_t burst, sent;
-	uint64_t bandwidth_kbps;
-	struct le *le;
+	stream_latency_add(vtx->video->strm, LAT_SEND, now - slot->jfs);
 
-	if (!vtx)
+	if (!vtx->pace.frame_jfs)
+		vtx->pace.frame_jfs = slot->jfs;
+
+	if (slot->marker) {
+		uint64_t delay = now - vtx->pace.frame_jfs;
+
+		++vtx->stats.pace_frames;
+		vtx->stats.pace_delay_sum += delay;
+		vtx->stats.pace_delay_max = max(vtx->stats.pace_delay_max,
+						delay);
+		vtx->pace.frame_jfs = 0;
+	}
+}
+
+
+/*
+ * Send n queued packets starting at tail as one batch, and hand the
+ * slots back to the encoder.
+ */
+static void vidqueue_send(struct vtx *vtx, unsigned tail, unsigned n,
+			  uint64_t now)
+{
+	struct stream_pkt pktv[STREAM_BATCH_MAX];
+	unsigned i;
+
+	if (!n)
 		return;
 
-	lock_write_get(vtx->lock_tx);
+	for (i=0; i<n; i++) {
+		const struct vidslot *slot;
 
-	le = vtx->sendq.head;
-	if (!le)
-		goto out;
+		slot = sendq_slot(vtx, tail + i);
+
+		pktv[i].mb     = slot->mb;
+		pktv[i].ts     = slot->ts;
+		pktv[i].pt     = slot->pt;
+		pktv[i].marker = slot->marker;
+	}
+
+	(void)stream_send_batch(vtx->video->strm, false, pktv, n);
+
+	for (i=0; i<n; i++)
+		vidqueue_sent(vtx, sendq_slot(vtx, tail + i), now);
+
+	__atomic_store_n(&vtx->sendq_tail, tail + n, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Token-bucket pacer. Tokens are accounted in [us] at a rate of
+ * cfg.pacing times the encoder bitrate; a packet which has waited
+ * longer than the latency budget is sent regardless of tokens.
+ *
+ * Returns the delay in [ms] until the queue should be polled again.
+ */
+static uint64_t vidqueue_poll(struct vtx *vtx)
+{
+	const struct config_video *cfg;
+	uint64_t delay = 1000/MEDIA_POLL_RATE;
+	unsigned head, tail, n = 0;
+	uint64_t now;
+	double rate, depth;
+	size_t burst, sent;
+
+	if (!vtx || !vtx->sendq)
+		return delay;
+
+	cfg  = &vtx->video->cfg;
+	head = __atomic_load_n(&vtx->sendq_head, __ATOMIC_ACQUIRE);
+	tail = vtx->sendq_tail;
+	now  = tmr_jiffies_usec();
+
+	if (cfg->pacing <= 0 || !cfg->bitrate) {
+
+		burst = BURST_MAX;//by aphero,重要
+		sent  = 0;
+
+		while (tail + n != head) {
+
+			struct vidslot *slot = sendq_slot(vtx, tail + n);
+
+			sent += mbuf_get_left(slot->mb);
+
+			if (++n == STREAM_BATCH_MAX) {
+				vidqueue_send(vtx, tail, n, now);
+				tail += n;
+				n = 0;
+			}
+
+			if (sent > burst)
+				break;
+		}
+
+		vidqueue_send(vtx, tail, n, now);
+
+		return delay;
+	}
+
+	/* bytes per [us] */
+	rate  = cfg->bitrate * cfg->pacing / 8000000.0;
+	depth = max(PACE_DEPTH * rate, 2.0 * PKTSIZE);
+
+	if (vtx->pace.jfs)
+		vtx->pace.tokens += (now - vtx->pace.jfs) * rate;
+	vtx->pace.jfs = now;
 
-	/*
-	 * time [ms] * bitrate [kbps] / 8 = bytes
-	 */
-	//bandwidth_kbps = vtx->video->cfg.bitrate / 1000;
-	//burst = (1 + jfs - prev_jfs) * bandwidth_kbps / 4;
+	vtx->pace.tokens = min(vtx->pace.tokens, depth);
 
-	//burst = min(burst, BURST_MAX);
-	 burst = BURST_MAX;//by aphero,重要
-	sent  = 0;
+	while (tail + n != head) {
 
-	while (le) {
+		struct vidslot *slot;
+		size_t len;
+		bool late;
 
-		struct vidqent *qent = le->data;
+		slot = sendq_slot(vtx, tail + n);
+		len  = mbuf_get_left(slot->mb);
 
-		sent += mbuf_get_left(qent->mb);
+		late = cfg->pacing_budget &&
+			now - slot->jfs >= cfg->pacing_budget * 1000ULL;
 
-		stream_send(vtx->video->strm, false, qent->marker, qent->pt,
-			    qent->ts, qent->mb);
+		if (vtx->pace.tokens < len && !late) {
 
-		le = le->next;
-		mem_deref(qent);
+			double wait = (len - vtx->pace.tokens) / rate;
 
-		if (sent > burst) {
+			delay = 1 + (uint64_t)wait / 1000;
 			break;
 		}
+
+		if (late)
+			++vtx->stats.pace_late;
+
+		vtx->pace.tokens = max(vtx->pace.tokens - len, -depth);
+
+		if (++n == STREAM_BATCH_MAX) {
+			vidqueue_send(vtx, tail, n, now);
+			tail += n;
+			n = 0;
+		}
 	}
 
- out:
-	lock_rel(vtx->lock_tx);
+	vidqueue_send(vtx, tail, n, now);
+
+	return delay;
 }
 
 
 static void rtp_tmr_handler(void *arg)
 {
 	struct vtx *vtx = arg;
-	uint64_t pjfs;
-
-	pjfs = vtx->tmr_rtp.jfs;
 
-	tmr_start(&vtx->tmr_rtp, 1000/MEDIA_POLL_RATE, rtp_tmr_handler, vtx);
-
-	vidqueue_poll(vtx, vtx->tmr_rtp.jfs, pjfs);
+	tmr_start(&vtx->tmr_rtp, vidqueue_poll(vtx), rtp_tmr_handler, vtx);
 }
 
 
@@ -302,11 +560,6 @@ static void video_destructor(void *arg)
 	struct vrx *vrx = &v->vrx;
 
 	/* transmit */
-	lock_write_get(vtx->lock_tx);
-	list_flush(&vtx->sendq);
-	lock_rel(vtx->lock_tx);
-	mem_deref(vtx->lock_tx);
-
 	tmr_cancel(&vtx->tmr_rtp);
 	mem_deref(vtx->vsrc);
 	lock_write_get(vtx->lock_enc);
@@ -316,8 +569,12 @@ static void video_destructor(void *arg)
 	list_flush(&vtx->filtl);
 	lock_rel(vtx->lock_enc);
 	mem_deref(vtx->lock_enc);
+	mem_deref(vtx->sendq);
 
 	/* receive */
+#ifdef HAVE_PTHREAD
+	rxq_stop(vrx);
+#endif
 	tmr_cancel(&vrx->tmr_picup);
 	lock_write_get(vrx->lock);
 	mem_deref(vrx->dec);
@@ -353,7 +610,6 @@ static int packet_handler(bool marker, uint64_t ts,
 {
 	struct vtx *vtx = arg;
 	struct stream *strm = vtx->video->strm;
-	struct vidqent *qent;
 	uint32_t rtp_ts;
 	int err;
 
@@ -364,16 +620,12 @@ static int packet_handler(bool marker, uint64_t ts,
 	/* add random timestamp offset */
 	rtp_ts = vtx->ts_offset + (ts & 0xffffffff);
 
-	err = vidqent_alloc(&qent, marker, strm->pt_enc, rtp_ts,
-			    hdr, hdr_len, pld, pld_len);
-	if (err)
-		return err;
-
-	lock_write_get(vtx->lock_tx);
-	qent->dst = *sdp_media_raddr(strm->sdp);
-	//info("list_append-[%d]\n",list_count(&vtx->sendq));//查看入队列,发送队列
-	list_append(&vtx->sendq, &qent->le, qent);//添加到队列 * Append a list element to a linked list
-	lock_rel(vtx->lock_tx);
+	err = sendq_push(vtx, marker, strm->pt_enc, rtp_ts,
+			 hdr, hdr_len, pld, pld_len);
+	if (err == ENOSPC) {
+		/* the frame is broken now, recover with a key-frame */
+		vtx->picup = true;
+	}
 
 	return err;
 }
@@ -392,18 +644,17 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 			    uint64_t timestamp)
 {
 	struct le *le;
+	uint64_t t0 = tmr_jiffies_usec(), t1;
 	int err = 0;
 	bool sendq_empty;
 
 	if (!vtx->enc)
 		return;
 
-	lock_write_get(vtx->lock_tx);
-	sendq_empty = (vtx->sendq.head == NULL);
-	lock_rel(vtx->lock_tx);
+	sendq_empty = (sendq_count(vtx) == 0);
 
 	if (!sendq_empty) {//sendq_empty=0跳过帧,队列不为空就跳过此帧 by aphero
-		//info("video:send frame skipc=%d sendq=%d \n",vtx->skipc,list_count(&vtx->sendq));
+		//info("video:send frame skipc=%d sendq=%d \n",vtx->skipc,sendq_count(vtx));
 		++vtx->skipc;
 		//return;//这里为什么要返回，继续发送不行吗＊＊＊＊暂时禁止，继续编码，存入队列＊＊＊＊＊＊＊这里意思应该是，上一包（整个帧）未发送完成，就跳过本包＊＊＊＊＊＊＊＊＊＊＊＊＊＊＊＊＊＊＊＊＊＊＊
 	}
@@ -415,14 +666,14 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 
 		vtx->vsrc_size = frame->size;
 
-		if (!vtx->frame) {
+		/* get it again, the size may have changed and filters may
+		 * have changed the frame */
+		vtx->frame = mem_deref(vtx->frame);
 
-			err = vidframe_alloc(&vtx->frame,
-					     vtx->video->cfg.enc_fmt,
-					     &vtx->vsrc_size);
-			if (err)
-				goto out;
-		}
+		err = vidpool_get(baresip_vidpool(), &vtx->frame,
+				  vtx->video->cfg.enc_fmt, &vtx->vsrc_size);
+		if (err)
+			goto out;
 
 		vidconv(vtx->frame, frame, 0);
 		frame = vtx->frame;
@@ -440,11 +691,18 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 	if (err)
 		goto out;
 
+	/* the capture time of a video source is not known */
+	t1 = tmr_jiffies_usec();
+	stream_latency_add(vtx->video->strm, LAT_FILTER, t1 - t0);
+
 	/* Encode the whole picture frame */
 	err = vtx->vc->ench(vtx->enc, vtx->picup, frame, timestamp);//发送到编码器,编码器编码后，将包存放到packet_handler(),入队列
 	if (err)
 		goto out;
 
+	stream_latency_add(vtx->video->strm, LAT_ENCODE,
+			   tmr_jiffies_usec() - t1);
+
 	vtx->picup = false;
 
  out:
@@ -501,7 +759,7 @@ static int vtx_alloc(struct vtx *vtx, struct video *video)
 	int err;
 
 	err  = lock_alloc(&vtx->lock_enc);
-	err |= lock_alloc(&vtx->lock_tx);
+	err |= sendq_alloc(vtx, &video->cfg);
 	if (err)
 		return err;
 
@@ -567,6 +825,48 @@ static void request_picture_update(struct vrx *vrx)
 }
 
 
+static void vrx_event_handler(int id, void *data, void *arg)
+{
+	struct vrx *vrx = arg;
+	struct video *v = vrx->video;
+	(void)data;
+
+	switch (id) {
+
+	case VRX_PICUP:
+		request_picture_update(vrx);
+		break;
+
+	case VRX_INTRA:
+		tmr_cancel(&vrx->tmr_picup);
+		break;
+
+	case VRX_CLOSED:
+		if (v->errh)
+			v->errh(ENODEV, "display closed", v->arg);
+		break;
+	}
+}
+
+
+/*
+ * Handle a decoder event in the main thread. The timers, RTCP and the
+ * error handler are not thread-safe, so the decode thread posts its
+ * events to the main loop.
+ */
+static void vrx_event(struct vrx *vrx, enum vrx_event ev)
+{
+#ifdef HAVE_PTHREAD
+	if (vrx->thr.mq) {
+		(void)mqueue_push(vrx->thr.mq, ev, NULL);
+		return;
+	}
+#endif
+
+	vrx_event_handler(ev, NULL, vrx);
+}
+
+
 /**
  * Decode incoming RTP packets using the Video decoder
  *
@@ -585,6 +885,7 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 	struct vidframe *frame_filt = NULL;
 	struct vidframe frame_store, *frame = &frame_store;
 	struct le *le;
+	uint64_t t0, t1;
 	bool intra;
 	int err = 0;
 
@@ -606,6 +907,8 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 	if (hdr->ts > vrx->ts_max)
 		vrx->ts_max = hdr->ts;
 
+	t0 = tmr_jiffies_usec();
+
 	frame->data[0] = NULL;
 	err = vrx->vc->dech(vrx->dec, frame, &intra, hdr->m, hdr->seq, mb);
 	if (err) {
@@ -617,26 +920,41 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 				mbuf_get_left(mb), err);
 		}
 
-		request_picture_update(vrx);
+		vrx_event(vrx, VRX_PICUP);
 
 		goto out;
 	}
 
 	if (intra) {
-		tmr_cancel(&vrx->tmr_picup);
+		vrx_event(vrx, VRX_INTRA);
 		++vrx->n_intra;
+		vrx->wait_key = false;
 	}
 
 	/* Got a full picture-frame? */
 	if (!vidframe_isvalid(frame))
 		goto out;
 
+	t1 = tmr_jiffies_usec();
+	stream_latency_add(v->strm, LAT_DECODE, t1 - t0);
+
+	++vrx->stats.dec_frames;
+	vrx->stats.dec_usec_sum += t1 - t0;
+	vrx->stats.dec_usec_max = max(vrx->stats.dec_usec_max, t1 - t0);
+
+	/* Packets were dropped, the picture refers to missing frames */
+	if (vrx->wait_key) {
+		++vrx->stats.skip_frames;
+		goto out;
+	}
+
 	vrx->size = frame->size;
 	vrx->fmt  = frame->fmt;
 
 	if (!list_isempty(&vrx->filtl)) {
 
-		err = vidframe_alloc(&frame_filt, frame->fmt, &frame->size);
+		err = vidpool_get(baresip_vidpool(), &frame_filt,
+				  frame->fmt, &frame->size);
 		if (err)
 			goto out;
 
@@ -658,15 +976,15 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 
 	err = vidisp_display(vrx->vidisp, v->peer, frame);
 	frame_filt = mem_deref(frame_filt);
+
+	stream_latency_add(v->strm, LAT_PLAYOUT, tmr_jiffies_usec() - t1);
 	if (err == ENODEV) {
 		warning("video: video-display was closed\n");
 		vrx->vidisp = mem_deref(vrx->vidisp);
 
 		lock_rel(vrx->lock);
 
-		if (v->errh) {
-			v->errh(err, "display closed", v->arg);
-		}
+		vrx_event(vrx, VRX_CLOSED);
 
 		return err;
 	}
@@ -680,12 +998,215 @@ out:
 }
 
 
+#ifdef HAVE_PTHREAD
+static void rxq_destructor(void *arg)
+{
+	struct vidrxslot *slotv = arg;
+	unsigned i;
+
+	for (i=0; i<RXQ_SLOTS; i++)
+		mem_deref(slotv[i].mb);
+}
+
+
+static void *rxq_thread(void *arg)
+{
+	struct vrx *vrx = arg;
+	struct vidrxslot *slot;
+	uint64_t delay;
+
+	(void)realtime_thread_setup(REALTIME_THREAD_VIDEO, "baresip-vdec");
+
+	pthread_mutex_lock(&vrx->thr.mutex);
+
+	while (vrx->thr.run) {
+
+		if (vrx->thr.head == vrx->thr.tail) {
+			pthread_cond_wait(&vrx->thr.cond, &vrx->thr.mutex);
+			continue;
+		}
+
+		/* the producer never writes the slot at the tail */
+		slot = &vrx->thr.q[vrx->thr.tail & (RXQ_SLOTS - 1)];
+
+		pthread_mutex_unlock(&vrx->thr.mutex);
+
+		delay = tmr_jiffies_usec() - slot->jfs;
+
+		(void)video_stream_decode(vrx, &slot->hdr, slot->mb);
+
+		pthread_mutex_lock(&vrx->thr.mutex);
+
+		++vrx->thr.tail;
+		++vrx->stats.rxq_pkts;
+		vrx->stats.rxq_delay_sum += delay;
+		vrx->stats.rxq_delay_max = max(vrx->stats.rxq_delay_max,
+					       delay);
+
+		if (vrx->thr.flush) {
+			vrx->stats.rxq_drops += vrx->thr.head - vrx->thr.tail;
+			vrx->thr.tail  = vrx->thr.head;
+			vrx->thr.flush = false;
+
+			/* only the decode thread writes this flag */
+			vrx->wait_key = true;
+		}
+	}
+
+	pthread_mutex_unlock(&vrx->thr.mutex);
+
+	return NULL;
+}
+
+
+/*
+ * Queue one packet for the decode thread. When the ring is full the
+ * decoder cannot keep up; instead of adding delay all queued packets
+ * are dropped and a new intra-frame is requested.
+ */
+static void rxq_push(struct vrx *vrx, const struct rtp_header *hdr,
+		     struct mbuf *mb)
+{
+	struct vidrxslot *slot;
+	bool behind = false;
+	unsigned n;
+	int err;
+
+	if (!hdr || !mbuf_get_left(mb))
+		return;
+
+	pthread_mutex_lock(&vrx->thr.mutex);
+
+	n = vrx->thr.head - vrx->thr.tail;
+
+	if (vrx->thr.flush || n >= RXQ_SLOTS) {
+
+		if (!vrx->thr.flush) {
+			vrx->thr.flush = true;
+			++vrx->stats.rxq_flush;
+			behind = true;
+		}
+
+		++vrx->stats.rxq_drops;
+		goto out;
+	}
+
+	slot = &vrx->thr.q[vrx->thr.head & (RXQ_SLOTS - 1)];
+
+	mbuf_rewind(slot->mb);
+	err = mbuf_write_mem(slot->mb, mbuf_buf(mb), mbuf_get_left(mb));
+	if (err) {
+		++vrx->stats.rxq_drops;
+		goto out;
+	}
+
+	slot->mb->pos = 0;
+	slot->hdr     = *hdr;
+	slot->jfs     = tmr_jiffies_usec();
+
+	++vrx->thr.head;
+	vrx->stats.rxq_hwm = max(vrx->stats.rxq_hwm, n + 1);
+
+	pthread_cond_signal(&vrx->thr.cond);
+
+ out:
+	pthread_mutex_unlock(&vrx->thr.mutex);
+
+	if (behind) {
+		info("video: decoder is %u packets behind,"
+		     " waiting for intra-frame\n", n);
+		request_picture_update(vrx);
+	}
+}
+
+
+static int rxq_start(struct vrx *vrx)
+{
+	unsigned i;
+	int err;
+
+	vrx->thr.q = mem_zalloc(RXQ_SLOTS * sizeof(*vrx->thr.q),
+				rxq_destructor);
+	if (!vrx->thr.q)
+		return ENOMEM;
+
+	for (i=0; i<RXQ_SLOTS; i++) {
+
+		vrx->thr.q[i].mb = mbuf_alloc(PKTSIZE);
+		if (!vrx->thr.q[i].mb) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+
+	err = mqueue_alloc(&vrx->thr.mq, vrx_event_handler, vrx);
+	if (err)
+		goto out;
+
+	err = pthread_mutex_init(&vrx->thr.mutex, NULL);
+	if (err)
+		goto out;
+
+	err = pthread_cond_init(&vrx->thr.cond, NULL);
+	if (err) {
+		pthread_mutex_destroy(&vrx->thr.mutex);
+		goto out;
+	}
+
+	vrx->thr.head = 0;
+	vrx->thr.tail = 0;
+	vrx->thr.flush = false;
+	vrx->thr.run  = true;
+
+	err = pthread_create(&vrx->thr.tid, NULL, rxq_thread, vrx);
+	if (err) {
+		vrx->thr.run = false;
+		pthread_cond_destroy(&vrx->thr.cond);
+		pthread_mutex_destroy(&vrx->thr.mutex);
+		goto out;
+	}
+
+	info("video: decoding in a separate thread (%u packets queue)\n",
+	     RXQ_SLOTS);
+
+ out:
+	if (err) {
+		vrx->thr.mq = mem_deref(vrx->thr.mq);
+		vrx->thr.q  = mem_deref(vrx->thr.q);
+	}
+
+	return err;
+}
+
+
+static void rxq_stop(struct vrx *vrx)
+{
+	if (!vrx->thr.run)
+		return;
+
+	pthread_mutex_lock(&vrx->thr.mutex);
+	vrx->thr.run = false;
+	pthread_cond_signal(&vrx->thr.cond);
+	pthread_mutex_unlock(&vrx->thr.mutex);
+
+	pthread_join(vrx->thr.tid, NULL);
+
+	pthread_cond_destroy(&vrx->thr.cond);
+	pthread_mutex_destroy(&vrx->thr.mutex);
+
+	vrx->thr.mq = mem_deref(vrx->thr.mq);
+	vrx->thr.q  = mem_deref(vrx->thr.q);
+}
+#endif
+
+
 static int pt_handler(struct video *v, uint8_t pt_old, uint8_t pt_new)
 {
 	const struct sdp_format *lc;
+	enum stream_ptclass cls;
 
-	lc = sdp_media_lformat(stream_sdpmedia(v->strm), pt_new);
-	if (!lc)
+	lc = stream_pt_lookup(v->strm, pt_new, &cls);
+	if (!lc || cls != STREAM_PT_CODEC)
 		return ENOENT;
 
 	if (pt_old != (uint8_t)-1) {
@@ -721,6 +1242,12 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 		return;
 
  out:
+#ifdef HAVE_PTHREAD
+	if (v->vrx.thr.run) {
+		rxq_push(&v->vrx, hdr, mb);
+		return;
+	}
+#endif
 	(void)video_stream_decode(&v->vrx, hdr, mb);
 }
 
@@ -918,6 +1445,9 @@ static void vidisp_resize_handler(const struct vidsz *sz, void *arg)
 static int set_vidisp(struct vrx *vrx)
 {
 	struct vidisp *vd;
+	int err;
+
+	lock_write_get(vrx->lock);
 
 	vrx->vidisp = mem_deref(vrx->vidisp);
 	vrx->vidisp_prm.view = NULL;
@@ -925,11 +1455,18 @@ static int set_vidisp(struct vrx *vrx)
 
 	vd = (struct vidisp *)vidisp_find(baresip_vidispl(),
 					  vrx->video->cfg.disp_mod);
-	if (!vd)
-		return ENOENT;
+	if (!vd) {
+		err = ENOENT;
+		goto out;
+	}
 
-	return vd->alloch(&vrx->vidisp, vd, &vrx->vidisp_prm, vrx->device,
-			  vidisp_resize_handler, vrx);
+	err = vd->alloch(&vrx->vidisp, vd, &vrx->vidisp_prm, vrx->device,
+			 vidisp_resize_handler, vrx);
+
+ out:
+	lock_rel(vrx->lock);
+
+	return err;
 }
 
 
@@ -1028,6 +1565,16 @@ int video_start(struct video *v, const char *peer)
 		info("video: no video source\n");
 	}
 
+#ifdef HAVE_PTHREAD
+	if (v->cfg.decode_thread && !v->vrx.thr.run) {
+		err = rxq_start(&v->vrx);
+		if (err) {
+			warning("video: could not start decode thread,"
+				" decoding in main thread (%m)\n", err);
+		}
+	}
+#endif
+
 	tmr_start(&v->tmr, TMR_INTERVAL * 1000, tmr_handler, v);
 
 	if (v->vtx.vc && v->vrx.vc) {
@@ -1089,8 +1636,10 @@ static int vidisp_update(struct vrx *vrx)
 	int err = 0;
 
 	if (vd->updateh) {
+		lock_write_get(vrx->lock);
 		err = vd->updateh(vrx->vidisp, vrx->vidisp_prm.fullscreen,
 				  vrx->orient, NULL);
+		lock_rel(vrx->lock);
 	}
 
 	return err;
@@ -1168,7 +1717,7 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 
 		prm.bitrate = v->cfg.bitrate;
 		//prm.pktsize = 1024;
-		prm.pktsize = 1400;//by aphero 原来是:1024
+		prm.pktsize = PKTSIZE;//by aphero 原来是:1024
 		prm.fps     = get_fps(v);
 		prm.max_fs  = -1;
 
@@ -1230,15 +1779,21 @@ int video_decoder_set(struct video *v, struct vidcodec *vc, int pt_rx,
 
 		info("Set video decoder: %s %s\n", vc->name, vc->variant);
 
+		/* the decode thread may be using the old decoder */
+		lock_write_get(vrx->lock);
+
 		vrx->dec = mem_deref(vrx->dec);
 
 		err = vc->decupdh(&vrx->dec, vc, fmtp);
 		if (err) {
+			lock_rel(vrx->lock);
 			warning("video: decoder alloc: %m\n", err);
 			return err;
 		}
 
 		vrx->vc = vc;
+
+		lock_rel(vrx->lock);
 	}
 
 	return err;
@@ -1346,8 +1901,21 @@ static int vtx_debug(struct re_printf *pf, const struct vtx *vtx)
 			  vtx->vsrc_size.w,
 			  vtx->vsrc_size.h, vtx->vsrc_prm.fps,
 			  vtx->stats.src_frames,vtx->frames);
-	err |= re_hprintf(pf, "     skipc=%u sendq=%u\n",
-			  vtx->skipc, list_count(&vtx->sendq));
+	err |= re_hprintf(pf, "     skipc=%u sendq=%u/%u"
+			  " (hwm %u, full %llu, grown %llu)\n",
+			  vtx->skipc, sendq_count(vtx), vtx->sendq_slots,
+			  vtx->stats.sendq_hwm, vtx->stats.sendq_full,
+			  vtx->stats.sendq_grow);
+	err |= re_hprintf(pf, "     pacer: x%.2f, budget %ums, frames %llu,"
+			  " delay avg %.2fms max %.2fms, late %llu\n",
+			  vtx->video->cfg.pacing,
+			  vtx->video->cfg.pacing_budget,
+			  vtx->stats.pace_frames,
+			  vtx->stats.pace_frames ?
+			  vtx->stats.pace_delay_sum /
+			  (1000.0 * vtx->stats.pace_frames) : 0.0,
+			  vtx->stats.pace_delay_max / 1000.0,
+			  vtx->stats.pace_late);
 
 	if (vtx->ts_base) {
 		err |= re_hprintf(pf, "     time = %.3f sec\n",
@@ -1374,6 +1942,29 @@ static int vrx_debug(struct re_printf *pf, const struct vrx *vrx)
 			  vrx->stats.disp_frames,vrx->frames);
 	err |= re_hprintf(pf, "     n_intra=%u, n_picup=%u\n",
 			  vrx->n_intra, vrx->n_picup);
+	err |= re_hprintf(pf, "     decode: frames %llu, avg %.2fms"
+			  " max %.2fms, skipped %llu\n",
+			  vrx->stats.dec_frames,
+			  vrx->stats.dec_frames ?
+			  vrx->stats.dec_usec_sum /
+			  (1000.0 * vrx->stats.dec_frames) : 0.0,
+			  vrx->stats.dec_usec_max / 1000.0,
+			  vrx->stats.skip_frames);
+#ifdef HAVE_PTHREAD
+	if (vrx->thr.run) {
+		err |= re_hprintf(pf, "     thread: queue=%u/%u (max %u),"
+				  " delay avg %.2fms max %.2fms,"
+				  " dropped %llu pkts (%llu times)\n",
+				  vrx->thr.head - vrx->thr.tail, RXQ_SLOTS,
+				  vrx->stats.rxq_hwm,
+				  vrx->stats.rxq_pkts ?
+				  vrx->stats.rxq_delay_sum /
+				  (1000.0 * vrx->stats.rxq_pkts) : 0.0,
+				  vrx->stats.rxq_delay_max / 1000.0,
+				  vrx->stats.rxq_drops,
+				  vrx->stats.rxq_flush);
+	}
+#endif
 	err |= re_hprintf(pf, "     time = %.3f sec\n",
 			  video_calc_seconds(vrx->ts_max - vrx->ts_min));
 
@@ -0,0 +1,372 @@
+/**
+ * @file vidpool.c  Video frame pool
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+
+
+/**
+ * \page VidPool Video frame pool
+ *
+ * Video frames are reference counted with mem_ref() and mem_deref() as
+ * usual. The pool owns the pixel buffers, and gives out a small frame
+ * header for each request. When the last reference to the header is
+ * released, its destructor marks the buffer free with the pool lock
+ * held, so the next user of the buffer only gets it after the last
+ * user is done with it, whichever thread released it. The next request
+ * for the same format and size gets the buffer back without allocating
+ * a new one.
+ *
+ * Free frames that were not asked for during the last MAX_AGE requests
+ * are released, so that frames of an old resolution do not stay around
+ * after the resolution has changed. At most MAX_FREE frames are kept
+ * free.
+ *
+ * The pixel buffer is aligned and padded as libavcodec requires for
+ * direct rendering, so that decoders can decode into pooled frames.
+ */
+
+
+enum {
+	ALIGN    = 64,
+	PAD      = 64,    /**< Zeroed bytes after the pixel buffer  */
+	MAX_FREE = 8,     /**< Max number of free frames kept       */
+	MAX_AGE  = 300,   /**< Requests before a free frame expires */
+};
+
+struct vidpool {
+	struct list framel;     /**< Pooled frames, recently used first */
+	struct lock *lock;
+	uint64_t seq;           /**< Number of requests                 */
+
+	struct {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t released;
+		size_t bytes;
+	} stats;
+};
+
+/** A pooled pixel buffer, with the pixels after it */
+struct pframe {
+	struct le le;
+	enum vidfmt fmt;
+	struct vidsz size;
+	size_t bufsz;
+	uint64_t seq;           /**< Last request that got this frame   */
+	bool inuse;             /**< Given out, protected by pool lock  */
+	uint8_t *buf;
+};
+
+/** A frame given out by the pool */
+struct vpframe {
+	struct vidframe frame;  /**< Must be first                      */
+	struct vidpool *pool;
+	struct pframe *pf;
+};
+
+
+static inline bool pframe_isfree(const struct pframe *pf)
+{
+	return !pf->inuse;
+}
+
+
+static void vpframe_destructor(void *arg)
+{
+	struct vpframe *vf = arg;
+	struct vidpool *pool = vf->pool;
+
+	if (!pool)
+		return;
+
+	lock_write_get(pool->lock);
+	vf->pf->inuse = false;
+	lock_rel(pool->lock);
+
+	mem_deref(pool);
+}
+
+
+static void release(struct vidpool *pool, struct pframe *pf)
+{
+	list_unlink(&pf->le);
+
+	pool->stats.bytes -= pf->bufsz;
+	++pool->stats.released;
+
+	mem_deref(pf);
+}
+
+
+/* release the least recently used free frames above MAX_FREE */
+static void trim(struct vidpool *pool)
+{
+	struct le *le;
+	unsigned n = 0;
+
+	for (le = list_head(&pool->framel); le; le = le->next) {
+		if (pframe_isfree(le->data))
+			++n;
+	}
+
+	le = list_tail(&pool->framel);
+	while (le && n > MAX_FREE) {
+
+		struct pframe *pf = le->data;
+
+		le = le->prev;
+
+		if (pframe_isfree(pf)) {
+			release(pool, pf);
+			--n;
+		}
+	}
+}
+
+
+static int pframe_alloc(struct pframe **pfp, enum vidfmt fmt,
+			const struct vidsz *size)
+{
+	const size_t bufsz = vidframe_size(fmt, size);
+	struct pframe *pf;
+
+	if (!bufsz)
+		return EINVAL;
+
+	/* the pixels are not zeroed, like a fresh decoder buffer */
+	pf = mem_alloc(sizeof(*pf) + ALIGN + bufsz + PAD, NULL);
+	if (!pf)
+		return ENOMEM;
+
+	memset(pf, 0, sizeof(*pf));
+
+	pf->fmt   = fmt;
+	pf->size  = *size;
+	pf->bufsz = bufsz;
+	pf->buf   = (uint8_t *)(((uintptr_t)(pf + 1) + ALIGN - 1) &
+				~(uintptr_t)(ALIGN - 1));
+
+	memset(pf->buf + bufsz, 0, PAD);
+
+	*pfp = pf;
+
+	return 0;
+}
+
+
+static void destructor(void *arg)
+{
+	struct vidpool *pool = arg;
+
+	/* frames in use keep a reference to the pool */
+	list_flush(&pool->framel);
+	mem_deref(pool->lock);
+}
+
+
+/**
+ * Allocate a video frame pool
+ *
+ * @param poolp Pointer to allocated video frame pool
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidpool_alloc(struct vidpool **poolp)
+{
+	struct vidpool *pool;
+	int err;
+
+	if (!poolp)
+		return EINVAL;
+
+	pool = mem_zalloc(sizeof(*pool), destructor);
+	if (!pool)
+		return ENOMEM;
+
+	err = lock_alloc(&pool->lock);
+	if (err)
+		mem_deref(pool);
+	else
+		*poolp = pool;
+
+	return err;
+}
+
+
+/**
+ * Get a video frame from the pool. The frame is released with
+ * mem_deref(), which returns it to the pool.
+ *
+ * @param pool   Video frame pool, a plain frame is allocated if NULL
+ * @param framep Pointer to the video frame
+ * @param fmt    Pixel format (enum vidfmt)
+ * @param size   Frame size
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note This function may be called from any thread
+ */
+int vidpool_get(struct vidpool *pool, struct vidframe **framep, int fmt,
+		const struct vidsz *size)
+{
+	struct vpframe *vf;
+	struct pframe *pf = NULL;
+	struct le *le;
+	int err = 0;
+
+	if (!framep || !size || !size->w || !size->h)
+		return EINVAL;
+
+	if (!pool)
+		return vidframe_alloc(framep, fmt, size);
+
+	vf = mem_zalloc(sizeof(*vf), vpframe_destructor);
+	if (!vf)
+		return ENOMEM;
+
+	lock_write_get(pool->lock);
+
+	++pool->seq;
+
+	le = list_head(&pool->framel);
+	while (le) {
+
+		struct pframe *f = le->data;
+
+		le = le->next;
+
+		if (!pframe_isfree(f))
+			continue;
+
+		if (!pf && f->fmt == (enum vidfmt)fmt &&
+		    vidsz_cmp(&f->size, size)) {
+			pf = f;
+		}
+		else if (pool->seq - f->seq > MAX_AGE) {
+			release(pool, f);
+		}
+	}
+
+	if (pf) {
+		++pool->stats.hits;
+		list_unlink(&pf->le);
+	}
+	else {
+		++pool->stats.misses;
+
+		err = pframe_alloc(&pf, fmt, size);
+		if (err)
+			goto out;
+
+		pool->stats.bytes += pf->bufsz;
+	}
+
+	pf->seq   = pool->seq;
+	pf->inuse = true;
+	list_prepend(&pool->framel, &pf->le, pf);
+
+	trim(pool);
+
+ out:
+	lock_rel(pool->lock);
+
+	if (err) {
+		mem_deref(vf);
+		return err;
+	}
+
+	vf->pool = mem_ref(pool);
+	vf->pf   = pf;
+
+	vidframe_init_buf(&vf->frame, fmt, size, pf->buf);
+
+	*framep = &vf->frame;
+
+	return 0;
+}
+
+
+/**
+ * Release all free frames of a video frame pool
+ *
+ * @param pool Video frame pool
+ */
+void vidpool_flush(struct vidpool *pool)
+{
+	struct le *le;
+
+	if (!pool)
+		return;
+
+	lock_write_get(pool->lock);
+
+	le = list_head(&pool->framel);
+	while (le) {
+
+		struct pframe *pf = le->data;
+
+		le = le->next;
+
+		if (pframe_isfree(pf))
+			release(pool, pf);
+	}
+
+	lock_rel(pool->lock);
+}
+
+
+/**
+ * Print the frames and hit/miss statistics of a video frame pool
+ *
+ * @param pf   Print handler
+ * @param pool Video frame pool
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidpool_debug(struct re_printf *pf, const struct vidpool *pool)
+{
+	uint64_t total;
+	unsigned n = 0, n_free = 0;
+	struct le *le;
+	int err;
+
+	if (!pool)
+		return 0;
+
+	lock_read_get(pool->lock);
+
+	for (le = list_head(&pool->framel); le; le = le->next) {
+
+		++n;
+		if (pframe_isfree(le->data))
+			++n_free;
+	}
+
+	total = pool->stats.hits + pool->stats.misses;
+
+	err = re_hprintf(pf, "video frame pool: %u frames (%u in use),"
+			 " %zu bytes\n", n, n - n_free, pool->stats.bytes);
+	err |= re_hprintf(pf, " requests %llu, hits %llu (%.1f%%),"
+			  " misses %llu, released %llu\n",
+			  total, pool->stats.hits,
+			  total ? 100.0 * pool->stats.hits / total : 0.0,
+			  pool->stats.misses, pool->stats.released);
+
+	for (le = list_head(&pool->framel); le && !err; le = le->next) {
+
+		const struct pframe *f = le->data;
+
+		err = re_hprintf(pf, "  %-8s %4u x %-4u  %s\n",
+				 vidfmt_name(f->fmt), f->size.w, f->size.h,
+				 pframe_isfree(f) ? "free" : "in use");
+	}
+
+	lock_rel(pool->lock);
+
+	return err;
+}
@@ -59,3 +59,108 @@ int test_aulevel(void)
  out:
 	return err;
 }
+
+
+static const enum aulevel_impl implv[] = {
+	AULEVEL_IMPL_SCALAR,
+	AULEVEL_IMPL_SSE2,
+	AULEVEL_IMPL_AVX2,
+	AULEVEL_IMPL_NEON,
+};
+
+
+int test_aulevel_simd(void)
+{
+	enum aulevel_impl saved = aulevel_impl_get();
+	static int16_t sampv[2048];
+	size_t i, j, n;
+	int err = 0;
+
+	for (i=0; i<64; i++) {
+
+		double ref;
+
+		/* odd lengths to exercise the scalar tail */
+		n = 1 + rand_u16() % ARRAY_SIZE(sampv);
+
+		for (j=0; j<n; j++) {
+			if (i % 4 == 0)
+				sampv[j] = -32768;
+			else
+				sampv[j] = (int16_t)rand_u16();
+		}
+
+		err = aulevel_impl_set(AULEVEL_IMPL_SCALAR);
+		TEST_ERR(err);
+
+		ref = aulevel_calc_dbov(sampv, n);
+
+		for (j=0; j<ARRAY_SIZE(implv); j++) {
+
+			if (aulevel_impl_set(implv[j]))
+				continue;
+
+			/* the sum of squares is exact, so must be the level */
+			ASSERT_TRUE(ref == aulevel_calc_dbov(sampv, n));
+		}
+	}
+
+ out:
+	(void)aulevel_impl_set(saved);
+
+	return err;
+}
+
+
+int bench_aulevel(void)
+{
+	static const uint32_t sratev[] = {8000, 16000, 32000, 48000};
+	static const uint32_t ptimev[] = {10, 20, 60};
+	enum aulevel_impl saved = aulevel_impl_get();
+	static int16_t sampv[48000 * 60 / 1000];
+	volatile double level = 0;
+	size_t i, j, k, n;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(sampv); i++)
+		sampv[i] = (int16_t)rand_u16();
+
+	for (i=0; i<ARRAY_SIZE(sratev); i++) {
+		for (j=0; j<ARRAY_SIZE(ptimev); j++) {
+
+			const size_t sampc = sratev[i] * ptimev[j] / 1000;
+			const size_t iter = 2000;
+
+			for (k=0; k<ARRAY_SIZE(implv); k++) {
+
+				char name[64];
+				uint64_t t0, t1;
+
+				if (aulevel_impl_set(implv[k]))
+					continue;
+
+				t0 = bench_nsec();
+				for (n=0; n<iter; n++)
+					level += aulevel_calc_dbov(sampv, sampc);
+				t1 = bench_nsec();
+
+				re_snprintf(name, sizeof(name),
+					    "aulevel_%s_%u_%u",
+					    aulevel_impl_name(implv[k]),
+					    sratev[i], ptimev[j]);
+
+				err = bench_report(name, "calc_dbov",
+						   (double)(t1 - t0) / iter,
+						   "ns/frame");
+				if (err)
+					goto out;
+			}
+		}
+	}
+
+ out:
+	(void)level;
+	(void)aulevel_impl_set(saved);
+
+	return err;
+}
@@ -0,0 +1,191 @@
+/**
+ * @file test/austretch.c  Baresip selftest -- audio time-scale modification
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "austretch"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+/* a periodic signal with a period of p sample frames */
+static void gen_tone(int16_t *sampv, size_t n, uint8_t ch, size_t p)
+{
+	size_t i, j;
+
+	for (i=0; i<n; i++) {
+
+		double x = 2 * M_PI * (double)(i % p) / (double)p;
+		int16_t v = (int16_t)(8000 * sin(x) + 4000 * sin(2 * x));
+
+		for (j=0; j<ch; j++)
+			sampv[i * ch + j] = v;
+	}
+}
+
+
+/* a periodic signal must stay the same when whole periods are changed */
+static int check_tone(const int16_t *sampv, size_t sampc, uint8_t ch,
+		      size_t p)
+{
+	int16_t *ref;
+	size_t i;
+	int err = 0;
+
+	ref = mem_alloc(sampc * sizeof(*ref), NULL);
+	if (!ref)
+		return ENOMEM;
+
+	gen_tone(ref, sampc / ch, ch, p);
+
+	for (i=0; i<sampc; i++) {
+		if (abs(ref[i] - sampv[i]) > 1) {
+			DEBUG_WARNING("sample %zu: %d != %d\n",
+				      i, sampv[i], ref[i]);
+			err = EINVAL;
+			break;
+		}
+	}
+
+	mem_deref(ref);
+
+	return err;
+}
+
+
+static int test_tone(uint32_t srate, uint8_t ch, size_t p)
+{
+	const size_t n = srate / 50;
+	int16_t *sampv;
+	size_t sampc;
+	int err;
+
+	sampv = mem_alloc(3 * n * ch * sizeof(*sampv), NULL);
+	if (!sampv)
+		return ENOMEM;
+
+	/* shorten */
+	gen_tone(sampv, n, ch, p);
+	sampc = n * ch;
+
+	err = austretch_accel(sampv, &sampc, srate, ch);
+	TEST_ERR(err);
+
+	ASSERT_TRUE(sampc < n * ch);
+	ASSERT_EQ(0, (n * ch - sampc) % (p * ch));
+
+	err = check_tone(sampv, sampc, ch, p);
+	TEST_ERR(err);
+
+	/* lengthen */
+	gen_tone(sampv, n, ch, p);
+	sampc = n * ch;
+
+	err = austretch_expand(sampv, &sampc, 3 * n * ch, srate, ch);
+	TEST_ERR(err);
+
+	ASSERT_TRUE(sampc > n * ch);
+	ASSERT_EQ(0, (sampc - n * ch) % (p * ch));
+
+	err = check_tone(sampv, sampc, ch, p);
+	TEST_ERR(err);
+
+	/* no room to lengthen */
+	gen_tone(sampv, n, ch, p);
+	sampc = n * ch;
+
+	err = austretch_expand(sampv, &sampc, n * ch, srate, ch);
+	ASSERT_EQ(ENOENT, err);
+	ASSERT_EQ(n * ch, sampc);
+	err = 0;
+
+ out:
+	mem_deref(sampv);
+
+	return err;
+}
+
+
+int test_austretch(void)
+{
+	int16_t sampv[320];
+	size_t sampc, i;
+	int err = 0;
+
+	err = test_tone(8000, 1, 40);
+	TEST_ERR(err);
+
+	err = test_tone(16000, 1, 123);
+	TEST_ERR(err);
+
+	err = test_tone(48000, 2, 240);
+	TEST_ERR(err);
+
+	/* loud noise is not periodic and is left alone */
+	for (i=0; i<ARRAY_SIZE(sampv); i++)
+		sampv[i] = (int16_t)rand_u16();
+
+	sampc = 160;
+	ASSERT_EQ(ENOENT, austretch_accel(sampv, &sampc, 8000, 1));
+	ASSERT_EQ(ENOENT, austretch_expand(sampv, &sampc, 320, 8000, 1));
+	ASSERT_EQ(160, sampc);
+
+	/* silence can always be changed */
+	memset(sampv, 0, sizeof(sampv));
+
+	sampc = 160;
+	err = austretch_accel(sampv, &sampc, 8000, 1);
+	TEST_ERR(err);
+	ASSERT_TRUE(sampc < 160);
+
+	/* too short for the shortest period */
+	sampc = 30;
+	ASSERT_EQ(ENOENT, austretch_accel(sampv, &sampc, 8000, 1));
+
+	ASSERT_EQ(EINVAL, austretch_accel(NULL, &sampc, 8000, 1));
+	ASSERT_EQ(EINVAL, austretch_expand(sampv, &sampc, 10, 8000, 1));
+	err = 0;
+
+ out:
+	return err;
+}
+
+
+int bench_austretch(void)
+{
+	const unsigned n = 2000;
+	static int16_t tone[960 * 2];
+	static int16_t sampv[960 * 2];
+	uint64_t t0, t1;
+	size_t sampc;
+	unsigned i;
+	int err = 0;
+
+	/* 20 ms at 48000 Hz stereo */
+	gen_tone(tone, 960, 2, 240);
+
+	t0 = bench_nsec();
+	for (i=0; i<n; i++) {
+		memcpy(sampv, tone, sizeof(sampv));
+		sampc = ARRAY_SIZE(sampv);
+		err |= austretch_accel(sampv, &sampc, 48000, 2);
+	}
+	t1 = bench_nsec();
+
+	if (err)
+		goto out;
+
+	err = bench_report("austretch_accel", "48kHz stereo 20ms",
+			   (double)(t1 - t0) / n / 1000.0, "us");
+
+ out:
+	return err;
+}
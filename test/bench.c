@@ -0,0 +1,233 @@
+/**
+ * @file test/bench.c  Baresip selftest -- benchmark helpers
+ *
+ * Copyright (C) 2010 - 2017 Creytiv.com
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+struct bench_stat {
+	uint64_t *v;
+	size_t n;
+	size_t max;
+	bool sorted;
+};
+
+
+static struct {
+	struct odict *resl;       /* results, NULL for text output */
+	unsigned n;
+} bench;
+
+
+uint64_t bench_nsec(void)
+{
+#ifdef WIN32
+	return tmr_jiffies_usec() * 1000;
+#else
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+
+static void stat_destructor(void *arg)
+{
+	struct bench_stat *st = arg;
+
+	mem_deref(st->v);
+}
+
+
+int bench_stat_alloc(struct bench_stat **stp, size_t max)
+{
+	struct bench_stat *st;
+
+	if (!stp || !max)
+		return EINVAL;
+
+	st = mem_zalloc(sizeof(*st), stat_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->v = mem_alloc(max * sizeof(*st->v), NULL);
+	if (!st->v) {
+		mem_deref(st);
+		return ENOMEM;
+	}
+
+	st->max = max;
+
+	*stp = st;
+
+	return 0;
+}
+
+
+/* Samples beyond the capacity are dropped */
+void bench_stat_add(struct bench_stat *st, uint64_t val)
+{
+	if (!st || st->n >= st->max)
+		return;
+
+	st->v[st->n++] = val;
+	st->sorted = false;
+}
+
+
+size_t bench_stat_count(const struct bench_stat *st)
+{
+	return st ? st->n : 0;
+}
+
+
+static int cmp_u64(const void *p1, const void *p2)
+{
+	const uint64_t a = *(const uint64_t *)p1;
+	const uint64_t b = *(const uint64_t *)p2;
+
+	return a < b ? -1 : a > b ? 1 : 0;
+}
+
+
+/**
+ * Get a percentile of the collected samples (nearest rank)
+ *
+ * @param st  Sample collector
+ * @param pct Percentile, 0-100
+ *
+ * @return Sample value at the given percentile, or 0 if empty
+ */
+uint64_t bench_stat_pct(struct bench_stat *st, unsigned pct)
+{
+	size_t i;
+
+	if (!st || !st->n)
+		return 0;
+
+	if (!st->sorted) {
+		qsort(st->v, st->n, sizeof(*st->v), cmp_u64);
+		st->sorted = true;
+	}
+
+	i = (st->n * min(pct, 100) + 99) / 100;
+
+	return st->v[i ? i - 1 : 0];
+}
+
+
+int bench_open(bool json)
+{
+	bench.n = 0;
+
+	if (!json)
+		return 0;
+
+	return odict_alloc(&bench.resl, 64);
+}
+
+
+/**
+ * Report one benchmark result
+ *
+ * @param name   Name of the benchmark
+ * @param metric Name of the metric
+ * @param value  Measured value
+ * @param unit   Unit of the value
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int bench_report(const char *name, const char *metric, double value,
+		 const char *unit)
+{
+	struct odict *o;
+	char idx[16];
+	int err;
+
+	if (!name || !metric || !unit)
+		return EINVAL;
+
+	if (!bench.resl) {
+		re_printf("  %-28s %-20s %14.3f %s\n",
+			  name, metric, value, unit);
+		return 0;
+	}
+
+	err = odict_alloc(&o, 8);
+	if (err)
+		return err;
+
+	err  = odict_entry_add(o, "name", ODICT_STRING, name);
+	err |= odict_entry_add(o, "metric", ODICT_STRING, metric);
+	err |= odict_entry_add(o, "value", ODICT_DOUBLE, value);
+	err |= odict_entry_add(o, "unit", ODICT_STRING, unit);
+	if (err)
+		goto out;
+
+	re_snprintf(idx, sizeof(idx), "%u", bench.n);
+
+	err = odict_entry_add(bench.resl, idx, ODICT_OBJECT, o);
+	if (err)
+		goto out;
+
+	++bench.n;
+
+ out:
+	mem_deref(o);
+
+	return err;
+}
+
+
+/**
+ * Write the collected results as a JSON document
+ *
+ * @param path Output file, or NULL to discard the results
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int bench_close(const char *path)
+{
+	struct odict *od = NULL;
+	FILE *f = NULL;
+	int err = 0;
+
+	if (!bench.resl || !path)
+		goto out;
+
+	err = odict_alloc(&od, 8);
+	if (err)
+		goto out;
+
+	err  = odict_entry_add(od, "version", ODICT_STRING, BARESIP_VERSION);
+	err |= odict_entry_add(od, "results", ODICT_ARRAY, bench.resl);
+	if (err)
+		goto out;
+
+	f = fopen(path, "w");
+	if (!f) {
+		err = errno;
+		warning("bench: %s: could not open (%m)\n", path, err);
+		goto out;
+	}
+
+	if (0 > re_fprintf(f, "%H\n", json_encode_odict, od))
+		err = EIO;
+
+ out:
+	if (f)
+		(void)fclose(f);
+	mem_deref(od);
+	bench.resl = mem_deref(bench.resl);
+
+	return err;
+}
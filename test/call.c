@@ -636,7 +636,7 @@ int test_call_dtmf(void)
 	fixture_init_prm(f, ";ptime=1");
 
 	/* audio-source is needed for dtmf/telev to work */
-	err = mock_ausrc_register(&ausrc);
+	err = mock_ausrc_register(&ausrc, NULL, NULL);
 	TEST_ERR(err);
 
 	f->behaviour = BEHAVIOUR_ANSWER;
@@ -691,7 +691,7 @@ int test_call_video(void)
 	mock_vidcodec_register();
 	err = mock_vidsrc_register(&vidsrc);
 	TEST_ERR(err);
-	err = mock_vidisp_register(&vidisp);
+	err = mock_vidisp_register(&vidisp, NULL, NULL);
 	TEST_ERR(err);
 
 	f->behaviour = BEHAVIOUR_ANSWER;
@@ -753,7 +753,7 @@ int test_call_aulevel(void)
 
 	conf_config()->audio.level = true;
 
-	err = mock_ausrc_register(&ausrc);
+	err = mock_ausrc_register(&ausrc, NULL, NULL);
 	TEST_ERR(err);
 	err = mock_auplay_register(&auplay, mock_sample_handler, f);
 	TEST_ERR(err);
@@ -856,7 +856,7 @@ static int test_media_base(enum audio_mode txmode)
 	conf_config()->audio.src_fmt = AUFMT_FLOAT;
 	conf_config()->audio.play_fmt = AUFMT_FLOAT;
 
-	err = mock_ausrc_register(&ausrc);
+	err = mock_ausrc_register(&ausrc, NULL, NULL);
 	TEST_ERR(err);
 	err = mock_auplay_register(&auplay, float_sample_handler, f);
 	TEST_ERR(err);
@@ -910,9 +910,31 @@ int test_call_format_float(void)
 	ASSERT_EQ(0, err);
 #endif
 
-	conf_config()->audio.txmode = AUDIO_MODE_POLL;
+#if defined (HAVE_PTHREAD) && defined (LINUX)
+	err = test_media_base(AUDIO_MODE_TIMER);
+	ASSERT_EQ(0, err);
+#endif
+
+#ifdef HAVE_PTHREAD
+	err = test_media_base(AUDIO_MODE_POOL);
+	ASSERT_EQ(0, err);
+#endif
+
+	/* same again with the lock-free device buffers */
+	conf_config()->audio.ring = true;
+
+	err = test_media_base(AUDIO_MODE_POLL);
+	ASSERT_EQ(0, err);
+
+#ifdef HAVE_PTHREAD
+	err = test_media_base(AUDIO_MODE_THREAD);
+	ASSERT_EQ(0, err);
+#endif
 
  out:
+	conf_config()->audio.txmode = AUDIO_MODE_POLL;
+	conf_config()->audio.ring = false;
+
 	return err;
 }
 
@@ -931,7 +953,7 @@ int test_call_mediaenc(void)
 
 	ASSERT_STREQ("xrtp", account_mediaenc(ua_account(f->a.ua)));
 
-	err = mock_ausrc_register(&ausrc);
+	err = mock_ausrc_register(&ausrc, NULL, NULL);
 	TEST_ERR(err);
 	err = mock_auplay_register(&auplay, float_sample_handler, f);
 	TEST_ERR(err);
@@ -969,3 +991,406 @@ int test_call_mediaenc(void)
 
 	return err;
 }
+
+
+/*
+ * Benchmarks -- drive the real media pipelines over loopback
+ */
+
+
+enum {
+	BENCH_DURATION = 5000,     /* measurement period in [ms]  */
+	BENCH_SAMPLES  = 65536,    /* max samples per statistic   */
+	BENCH_MAGIC    = 0x5a5a,   /* marks a timestamped frame   */
+};
+
+struct bench_media {
+	struct fixture *fix;
+	struct tmr tmr;
+	struct bench_stat *tx;     /* encode->RTP per frame [ns]         */
+	struct bench_stat *lat;    /* source->playout per frame [ns]     */
+	struct bench_stat *jit;    /* latency/interval variation [ns]    */
+	const void *keyv[2];       /* identifies the two directions      */
+	uint64_t lastv[2];
+	struct memstat mem;
+	bool mem_ok;
+	bool running;
+	bool done;
+	uint64_t start;
+	uint64_t stop;
+	uint64_t period;           /* nominal frame interval [ns]        */
+	unsigned n_tx;
+	unsigned n_rx;
+};
+
+
+static void bench_media_destructor(void *arg)
+{
+	struct bench_media *bm = arg;
+
+	tmr_cancel(&bm->tmr);
+	mem_deref(bm->jit);
+	mem_deref(bm->lat);
+	mem_deref(bm->tx);
+}
+
+
+static int bench_media_alloc(struct bench_media **bmp, struct fixture *fix)
+{
+	struct bench_media *bm;
+	int err;
+
+	bm = mem_zalloc(sizeof(*bm), bench_media_destructor);
+	if (!bm)
+		return ENOMEM;
+
+	bm->fix = fix;
+
+	err  = bench_stat_alloc(&bm->tx, BENCH_SAMPLES);
+	err |= bench_stat_alloc(&bm->lat, BENCH_SAMPLES);
+	err |= bench_stat_alloc(&bm->jit, BENCH_SAMPLES);
+	if (err) {
+		mem_deref(bm);
+		return ENOMEM;
+	}
+
+	*bmp = bm;
+
+	return 0;
+}
+
+
+static int bench_key(struct bench_media *bm, const void *key)
+{
+	size_t i;
+
+	for (i=0; i<ARRAY_SIZE(bm->keyv); i++) {
+
+		if (!bm->keyv[i])
+			bm->keyv[i] = key;
+
+		if (bm->keyv[i] == key)
+			return (int)i;
+	}
+
+	return -1;
+}
+
+
+static void bench_stop_handler(void *arg)
+{
+	struct bench_media *bm = arg;
+
+	bm->stop = bench_nsec();
+	bm->running = false;
+	bm->done = true;
+
+	re_cancel();
+}
+
+
+static void bench_start(struct bench_media *bm)
+{
+	if (bm->running || bm->done)
+		return;
+
+	bm->mem_ok = 0 == mem_get_stat(&bm->mem);
+	bm->start = bench_nsec();
+	bm->running = true;
+
+	tmr_start(&bm->tmr, BENCH_DURATION, bench_stop_handler, bm);
+}
+
+
+static int bench_media_report(struct bench_media *bm, const char *name,
+			      unsigned frames)
+{
+	double secs = (double)(bm->stop - bm->start) / 1e9;
+	struct memstat mem;
+	int err = 0;
+
+	if (!bm->done || secs <= 0)
+		return ETIMEDOUT;
+
+	if (bm->n_tx) {
+		err |= bench_report(name, "tx_packets", bm->n_tx / secs,
+				    "pkt/s");
+	}
+	err |= bench_report(name, "rx_frames", bm->n_rx / secs, "frame/s");
+
+	if (bench_stat_count(bm->tx)) {
+		err |= bench_report(name, "encode_rtp_p50",
+				    bench_stat_pct(bm->tx, 50), "ns/frame");
+		err |= bench_report(name, "encode_rtp_p99",
+				    bench_stat_pct(bm->tx, 99), "ns/frame");
+	}
+	if (bench_stat_count(bm->lat)) {
+		err |= bench_report(name, "e2e_latency_p50",
+				    bench_stat_pct(bm->lat, 50) / 1000.0,
+				    "us");
+		err |= bench_report(name, "e2e_latency_p99",
+				    bench_stat_pct(bm->lat, 99) / 1000.0,
+				    "us");
+	}
+	err |= bench_report(name, "jitter_p50",
+			    bench_stat_pct(bm->jit, 50) / 1000.0, "us");
+	err |= bench_report(name, "jitter_p99",
+			    bench_stat_pct(bm->jit, 99) / 1000.0, "us");
+
+	/* libre only tracks live blocks, so this is the net growth */
+	if (bm->mem_ok && frames && 0 == mem_get_stat(&mem)) {
+		err |= bench_report(name, "live_blocks_growth",
+				    ((double)mem.blocks_cur -
+				     (double)bm->mem.blocks_cur) / frames,
+				    "blocks/frame");
+		err |= bench_report(name, "mem_peak",
+				    mem.bytes_peak / 1024.0, "KiB");
+	}
+
+	return err;
+}
+
+
+/* the encode and decode latency of one side, from its stream */
+static int bench_stage_report(const char *name, const struct stream *strm)
+{
+	static const enum lat_stage stagev[] = {LAT_ENCODE, LAT_DECODE};
+	const struct latency *lat = stream_latency(strm);
+	char metric[32];
+	size_t i;
+	int err = 0;
+
+	if (!lat)
+		return ENOENT;
+
+	for (i=0; i<ARRAY_SIZE(stagev); i++) {
+
+		const struct lathist *h = &lat->histv[stagev[i]];
+		const char *stage = latency_stage_name(stagev[i]);
+
+		if (!h->count)
+			continue;
+
+		re_snprintf(metric, sizeof(metric), "%s_p50", stage);
+		err |= bench_report(name, metric,
+				    lathist_percentile(h, 50), "us");
+		re_snprintf(metric, sizeof(metric), "%s_p99", stage);
+		err |= bench_report(name, metric,
+				    lathist_percentile(h, 99), "us");
+	}
+
+	return err;
+}
+
+
+static void bench_read_handler(void *sampv, size_t sampc,
+			       ausrc_read_h *rh, void *rh_arg, void *arg)
+{
+	struct bench_media *bm = arg;
+	int16_t *v = sampv;
+	uint64_t t0, t1;
+	int key;
+
+	key = bench_key(bm, rh_arg);
+
+	/* stamp the frame, so the player can find it again */
+	t0 = bench_nsec();
+	if (sampc >= 6 && key >= 0) {
+		v[0] = BENCH_MAGIC;
+		v[1] = key;
+		v[2] = (int16_t)(t0 >> 48);
+		v[3] = (int16_t)(t0 >> 32);
+		v[4] = (int16_t)(t0 >> 16);
+		v[5] = (int16_t)t0;
+	}
+
+	if (rh)
+		rh(sampv, sampc, rh_arg);
+
+	t1 = bench_nsec();
+
+	if (bm->running) {
+		bench_stat_add(bm->tx, t1 - t0);
+		++bm->n_tx;
+	}
+}
+
+
+static void bench_sample_handler(const void *sampv, size_t sampc, void *arg)
+{
+	struct bench_media *bm = arg;
+	struct fixture *fix = bm->fix;
+	const uint16_t *v = sampv;
+	uint64_t now = bench_nsec();
+	uint64_t stamp, lat;
+	unsigned key;
+
+	if (!bm->running) {
+		if (sampc && fix->a.n_established && fix->b.n_established &&
+		    audio_rxaubuf_started(call_audio(ua_call(fix->a.ua))) &&
+		    audio_rxaubuf_started(call_audio(ua_call(fix->b.ua))))
+			bench_start(bm);
+		return;
+	}
+
+	if (sampc < 6 || v[0] != BENCH_MAGIC || v[1] > 1)
+		return;
+
+	key = v[1];
+	stamp = (uint64_t)v[2] << 48 | (uint64_t)v[3] << 32 |
+		(uint64_t)v[4] << 16 | v[5];
+
+	if (stamp > now)
+		return;
+
+	lat = now - stamp;
+
+	bench_stat_add(bm->lat, lat);
+	if (bm->lastv[key]) {
+		bench_stat_add(bm->jit, lat > bm->lastv[key] ?
+			       lat - bm->lastv[key] : bm->lastv[key] - lat);
+	}
+	bm->lastv[key] = lat;
+
+	++bm->n_rx;
+}
+
+
+/*
+ * Audio: mock source -> FOO16 -> RTP -> loopback -> RTP -> FOO16 -> mock
+ * player, in both directions. The source stamps each frame, which gives
+ * the end-to-end latency on the player side.
+ */
+int bench_call_audio(void)
+{
+	struct fixture fix, *f = &fix;
+	struct bench_media *bm = NULL;
+	struct ausrc *ausrc = NULL;
+	struct auplay *auplay = NULL;
+	int err = 0;
+
+	fixture_init_prm(f, ";ptime=10");
+
+	conf_config()->audio.txmode = AUDIO_MODE_POLL;
+
+	err = bench_media_alloc(&bm, f);
+	TEST_ERR(err);
+
+	err = mock_ausrc_register(&ausrc, bench_read_handler, bm);
+	TEST_ERR(err);
+	err = mock_auplay_register(&auplay, bench_sample_handler, bm);
+	TEST_ERR(err);
+
+	f->estab_action = ACTION_NOTHING;
+	f->behaviour = BEHAVIOUR_ANSWER;
+
+	err = ua_connect(f->a.ua, 0, NULL, f->buri, NULL, VIDMODE_OFF);
+	TEST_ERR(err);
+
+	err = re_main_timeout(BENCH_DURATION + 10000);
+	TEST_ERR(err);
+	TEST_ERR(fix.err);
+
+	err = bench_media_report(bm, "call_audio", bm->n_tx + bm->n_rx);
+	TEST_ERR(err);
+
+ out:
+	fixture_close(f);
+	mem_deref(auplay);
+	mem_deref(ausrc);
+	mem_deref(bm);
+
+	return err;
+}
+
+
+#ifdef USE_VIDEO
+static void bench_frame_handler(const struct vidframe *frame, void *arg)
+{
+	struct bench_media *bm = arg;
+	uint64_t now = bench_nsec();
+	uint64_t ival;
+	int key;
+
+	key = bench_key(bm, frame->data[0]);
+	if (key < 0)
+		return;
+
+	if (!bm->running) {
+		bm->lastv[key] = now;
+		bench_start(bm);
+		return;
+	}
+
+	if (bm->lastv[key]) {
+		ival = now - bm->lastv[key];
+
+		bench_stat_add(bm->jit, ival > bm->period ?
+			       ival - bm->period : bm->period - ival);
+	}
+	bm->lastv[key] = now;
+
+	++bm->n_rx;
+}
+
+
+/*
+ * Video: mock source -> mock codec -> packetizer/pacer -> RTP ->
+ * loopback -> RTP -> mock decoder -> mock display, in both directions.
+ * The jitter is the deviation of the display interval from the
+ * nominal frame interval. The encode and decode latency are taken from
+ * the stage histograms of the video stream of A, for the whole call.
+ */
+int bench_call_video(void)
+{
+	struct fixture fix, *f = &fix;
+	struct bench_media *bm = NULL;
+	struct vidsrc *vidsrc = NULL;
+	struct vidisp *vidisp = NULL;
+	const double fps = conf_config()->video.fps;
+	int err = 0;
+
+	conf_config()->video.fps = 30;
+
+	fixture_init(f);
+
+	err = bench_media_alloc(&bm, f);
+	TEST_ERR(err);
+
+	bm->period = 1000000000ULL / 30;
+
+	mock_vidcodec_register();
+	err = mock_vidsrc_register(&vidsrc);
+	TEST_ERR(err);
+	err = mock_vidisp_register(&vidisp, bench_frame_handler, bm);
+	TEST_ERR(err);
+
+	f->estab_action = ACTION_NOTHING;
+	f->behaviour = BEHAVIOUR_ANSWER;
+
+	err = ua_connect(f->a.ua, 0, NULL, f->buri, NULL, VIDMODE_ON);
+	TEST_ERR(err);
+
+	err = re_main_timeout(BENCH_DURATION + 10000);
+	TEST_ERR(err);
+	TEST_ERR(fix.err);
+
+	err = bench_media_report(bm, "call_video", bm->n_rx);
+	TEST_ERR(err);
+
+	err = bench_stage_report("call_video",
+				 video_strm(call_video(ua_call(f->a.ua))));
+	TEST_ERR(err);
+
+ out:
+	conf_config()->video.fps = fps;
+
+	fixture_close(f);
+	mem_deref(vidisp);
+	mem_deref(vidsrc);
+	mock_vidcodec_unregister();
+	mem_deref(bm);
+
+	return err;
+}
+#endif
@@ -0,0 +1,293 @@
+/**
+ * @file test/h264.c  Baresip selftest -- H.264 packetization
+ *
+ * Copyright (C) 2010 - 2017 Creytiv.com
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "h264"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+/* The previous start code search, as the reference */
+static const uint8_t *ref_find_startcode(const uint8_t *p,
+					 const uint8_t *end)
+{
+	const uint8_t *a = p + 4 - ((long)p & 3);
+
+	for (end -= 3; p < a && p < end; p++ ) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
+	}
+
+	for (end -= 3; p < end; p += 4) {
+		uint32_t x = *(const uint32_t*)(void *)p;
+		if ( (x - 0x01010101) & (~x) & 0x80808080 ) {
+			if (p[1] == 0 ) {
+				if ( p[0] == 0 && p[2] == 1 )
+					return p;
+				if ( p[2] == 0 && p[3] == 1 )
+					return p+1;
+			}
+			if ( p[3] == 0 ) {
+				if ( p[2] == 0 && p[4] == 1 )
+					return p+2;
+				if ( p[4] == 0 && p[5] == 1 )
+					return p+3;
+			}
+		}
+	}
+
+	for (end += 3; p < end; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
+	}
+
+	return end + 3;
+}
+
+
+/* The previous packetizer, as the reference */
+static int ref_packetize(uint64_t rtp_ts, const uint8_t *buf, size_t len,
+			 size_t pktsize, videnc_packet_h *pkth, void *arg)
+{
+	const uint8_t *start = buf;
+	const uint8_t *end   = buf + len;
+	const uint8_t *r;
+	int err = 0;
+
+	r = ref_find_startcode(start, end);
+
+	while (r < end) {
+		const uint8_t *r1;
+
+		/* skip zeros */
+		while (!*(r++))
+			;
+
+		r1 = ref_find_startcode(r, end);
+
+		err |= h264_nal_send(true, true, (r1 >= end), r[0],
+				     rtp_ts, r+1, r1-r-1, pktsize,
+				     pkth, arg);
+		r = r1;
+	}
+
+	return err;
+}
+
+
+/* Serialize packets as: marker, hdr_len, hdr, pld_len, pld */
+static int packet_handler(bool marker, uint64_t rtp_ts,
+			  const uint8_t *hdr, size_t hdr_len,
+			  const uint8_t *pld, size_t pld_len,
+			  void *arg)
+{
+	struct mbuf *mb = arg;
+	int err = 0;
+	(void)rtp_ts;
+
+	err |= mbuf_write_u8(mb, marker);
+	err |= mbuf_write_u8(mb, (uint8_t)hdr_len);
+	err |= mbuf_write_mem(mb, hdr, hdr_len);
+	err |= mbuf_write_u32(mb, (uint32_t)pld_len);
+	err |= mbuf_write_mem(mb, pld, pld_len);
+
+	return err;
+}
+
+
+/*
+ * Random byte stream with many zeros, start codes of 3 and 4 bytes and
+ * NAL units both smaller and larger than the packet size. The payload
+ * has emulation prevention bytes as in a real stream, and the stream
+ * never ends with a start code, which the reference cannot handle.
+ */
+static size_t gen_stream(uint8_t *buf, size_t size)
+{
+	size_t n = 0;
+	unsigned zeros;
+
+	if (rand_u16() & 1)
+		buf[n++] = 0;
+
+	while (n + 8 < size) {
+
+		size_t len = rand_u16() % (rand_u16() & 1 ? 64 : 4096);
+		size_t i;
+
+		if (rand_u16() & 1)
+			buf[n++] = 0;
+		buf[n++] = 0;
+		buf[n++] = 0;
+		buf[n++] = 1;
+		buf[n++] = (uint8_t)(rand_u16() & 0x7f) | 1;
+
+		len = min(len, size - n - 1);
+		zeros = 0;
+
+		for (i = 0; i < len; i++) {
+			uint16_t x = rand_u16();
+			uint8_t b = (x & 0x300) ? (uint8_t)x : (x & 1);
+
+			if (zeros >= 2 && b <= 3) {
+				if (++i == len)
+					break;
+				buf[n++] = 3;
+				zeros = 0;
+			}
+
+			buf[n++] = b;
+			zeros = b ? 0 : zeros + 1;
+		}
+	}
+
+	buf[n++] = 0x80;
+
+	return n;
+}
+
+
+int test_h264_startcode(void)
+{
+	static uint8_t buf[512];
+	size_t i, j, off, len;
+	int err = 0;
+
+	for (i = 0; i < 2000; i++) {
+
+		for (j = 0; j < sizeof(buf); j++) {
+			uint16_t x = rand_u16();
+
+			buf[j] = (x & 0x700) ? (uint8_t)x : (x & 1);
+		}
+
+		/* all alignments and lengths, also around 16 bytes */
+		off = rand_u16() % 32;
+		len = rand_u16() % (sizeof(buf) - off);
+
+		ASSERT_TRUE(ref_find_startcode(buf + off, buf + off + len) ==
+			    h264_find_startcode(buf + off, buf + off + len));
+	}
+
+ out:
+	return err;
+}
+
+
+int test_h264_packetize(void)
+{
+	static const size_t pktsizev[] = {3, 100, 1024, 1200};
+	struct mbuf *mb_ref = NULL, *mb = NULL, *mb_pz = NULL;
+	uint8_t *buf = NULL;
+	size_t i, j, len;
+	int err = 0;
+
+	buf    = mem_alloc(65536, NULL);
+	mb_ref = mbuf_alloc(65536);
+	mb     = mbuf_alloc(65536);
+	mb_pz  = mbuf_alloc(65536);
+	if (!buf || !mb_ref || !mb || !mb_pz) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < 200; i++) {
+
+		len = gen_stream(buf, 1 + rand_u16() % 65535);
+
+		for (j = 0; j < ARRAY_SIZE(pktsizev); j++) {
+
+			struct h264_packetizer pz;
+			struct h264_pkt pkt;
+
+			mbuf_rewind(mb_ref);
+			mbuf_rewind(mb);
+			mbuf_rewind(mb_pz);
+
+			err = ref_packetize(0, buf, len, pktsizev[j],
+					    packet_handler, mb_ref);
+			TEST_ERR(err);
+
+			err = h264_packetize(0, buf, len, pktsizev[j],
+					     packet_handler, mb);
+			TEST_ERR(err);
+
+			TEST_MEMCMP(mb_ref->buf, mb_ref->end,
+				    mb->buf, mb->end);
+
+			/* the slices must point into the input */
+			err = h264_packetizer_init(&pz, buf, len, pktsizev[j]);
+			TEST_ERR(err);
+
+			while (0 == h264_packetizer_next(&pz, &pkt)) {
+
+				ASSERT_TRUE(pkt.pld >= buf);
+				ASSERT_TRUE(pkt.pld + pkt.pld_len <=
+					    buf + len);
+				ASSERT_TRUE(pkt.pld_len <= pktsizev[j]);
+
+				err = packet_handler(pkt.marker, 0,
+						     pkt.hdr, pkt.hdr_len,
+						     pkt.pld, pkt.pld_len,
+						     mb_pz);
+				TEST_ERR(err);
+			}
+
+			TEST_MEMCMP(mb_ref->buf, mb_ref->end,
+				    mb_pz->buf, mb_pz->end);
+		}
+	}
+
+ out:
+	mem_deref(mb_pz);
+	mem_deref(mb);
+	mem_deref(mb_ref);
+	mem_deref(buf);
+
+	return err;
+}
+
+
+int bench_h264_startcode(void)
+{
+	const size_t size = 1024 * 1024;
+	const unsigned iter = 50;
+	const uint8_t *volatile r;
+	uint64_t t0, t1, t2;
+	uint8_t *buf;
+	unsigned i;
+	int err = 0;
+
+	buf = mem_alloc(size, NULL);
+	if (!buf)
+		return ENOMEM;
+
+	/* no start codes, the whole buffer is scanned */
+	for (i = 0; i < size; i++)
+		buf[i] = (uint8_t)(rand_u16() | 2);
+
+	t0 = bench_nsec();
+	for (i = 0; i < iter; i++)
+		r = ref_find_startcode(buf, buf + size);
+	t1 = bench_nsec();
+	for (i = 0; i < iter; i++)
+		r = h264_find_startcode(buf, buf + size);
+	t2 = bench_nsec();
+
+	(void)r;
+
+	err |= bench_report("h264_startcode_scalar", "scan",
+			    size * (double)iter * 1000.0 / (t1 - t0), "MB/s");
+	err |= bench_report("h264_startcode", "scan",
+			    size * (double)iter * 1000.0 / (t2 - t1), "MB/s");
+
+	mem_deref(buf);
+
+	return err;
+}
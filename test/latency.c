@@ -0,0 +1,122 @@
+/**
+ * @file test/latency.c  Baresip selftest -- latency histograms
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "latency"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+/* a percentile is exact or at most 1/16 above the exact value */
+static bool pct_near(uint64_t exact, uint64_t actual)
+{
+	return actual >= exact && actual <= exact + exact / 16;
+}
+
+
+int test_latency(void)
+{
+	struct latency *lat;
+	struct lathist *h;
+	struct odict *od = NULL;
+	const struct odict_entry *e;
+	uint64_t v;
+	int err = 0;
+
+	lat = mem_zalloc(sizeof(*lat), NULL);
+	if (!lat)
+		return ENOMEM;
+
+	h = &lat->histv[LAT_ENCODE];
+
+	ASSERT_EQ(0, lathist_percentile(h, 50));
+	ASSERT_EQ(0, lathist_mean(h));
+
+	/* small values are exact */
+	for (v=0; v<32; v++)
+		lathist_add(h, v);
+
+	ASSERT_EQ(32, h->count);
+	ASSERT_EQ(31, h->max);
+	ASSERT_EQ(15, lathist_percentile(h, 50));
+	ASSERT_EQ(31, lathist_percentile(h, 100));
+
+	lathist_reset(h);
+	ASSERT_EQ(0, h->count);
+
+	for (v=1; v<=100000; v++)
+		lathist_add(h, v);
+
+	ASSERT_EQ(50000, lathist_mean(h));
+	ASSERT_TRUE(pct_near(50000, lathist_percentile(h, 50)));
+	ASSERT_TRUE(pct_near(90000, lathist_percentile(h, 90)));
+	ASSERT_TRUE(pct_near(99000, lathist_percentile(h, 99)));
+	ASSERT_TRUE(lathist_percentile(h, 100) == 100000);
+	ASSERT_TRUE(lathist_percentile(h, 0) == 1);
+
+	/* values beyond the last bucket are counted there */
+	lathist_add(h, 1ULL << 40);
+	ASSERT_TRUE(lathist_percentile(h, 100) == 1ULL << 40);
+
+	ASSERT_STREQ("encode", latency_stage_name(LAT_ENCODE));
+	ASSERT_STREQ("playout", latency_stage_name(LAT_PLAYOUT));
+
+	/* only stages with values are encoded */
+	lathist_add(&lat->histv[LAT_JBUF], 20000);
+
+	err = odict_alloc(&od, 8);
+	TEST_ERR(err);
+
+	err = latency_encode_odict(od, lat);
+	TEST_ERR(err);
+
+	ASSERT_EQ(2, odict_count(od, false));
+	ASSERT_TRUE(odict_lookup(od, "capture") == NULL);
+
+	e = odict_lookup(od, "jbuf");
+	ASSERT_TRUE(e != NULL);
+	ASSERT_EQ(ODICT_OBJECT, e->type);
+
+	e = odict_lookup(e->u.odict, "p50");
+	ASSERT_TRUE(e != NULL);
+	ASSERT_EQ(ODICT_INT, e->type);
+	ASSERT_TRUE(e->u.integer == 20000);
+
+ out:
+	mem_deref(od);
+	mem_deref(lat);
+
+	return err;
+}
+
+
+int bench_latency(void)
+{
+	const unsigned n = 10000000;
+	struct lathist *h;
+	uint64_t t0, t1;
+	unsigned i;
+	int err;
+
+	h = mem_zalloc(sizeof(*h), NULL);
+	if (!h)
+		return ENOMEM;
+
+	t0 = bench_nsec();
+	for (i=0; i<n; i++)
+		lathist_add(h, (i * 2654435761u) >> 12);
+	t1 = bench_nsec();
+
+	err = bench_report("lathist_add", "record",
+			   (double)(t1 - t0) / n, "ns");
+
+	mem_deref(h);
+
+	return err;
+}
@@ -24,6 +24,8 @@ struct test {
 static const struct test tests[] = {
 	TEST(test_account),
 	TEST(test_aulevel),
+	TEST(test_aulevel_simd),
+	TEST(test_austretch),
 	TEST(test_call_af_mismatch),
 	TEST(test_call_answer),
 	TEST(test_call_answer_hangup_a),
@@ -46,10 +48,16 @@ static const struct test tests[] = {
 	TEST(test_contact),
 	TEST(test_cplusplus),
 	TEST(test_event),
+#ifdef USE_VIDEO
+	TEST(test_h264_packetize),
+	TEST(test_h264_startcode),
+#endif
+	TEST(test_latency),
 	TEST(test_message),
 	TEST(test_mos),
 	TEST(test_network),
 	TEST(test_play),
+	TEST(test_play_file),
 	TEST(test_ua_alloc),
 	TEST(test_ua_options),
 	TEST(test_ua_register),
@@ -57,6 +65,20 @@ static const struct test tests[] = {
 	TEST(test_ua_register_auth),
 	TEST(test_ua_register_auth_dns),
 	TEST(test_uag_find_param),
+#ifdef USE_VIDEO
+	TEST(test_vidpool),
+#endif
+};
+
+static const struct test benches[] = {
+	TEST(bench_aulevel),
+	TEST(bench_austretch),
+	TEST(bench_call_audio),
+	TEST(bench_latency),
+#ifdef USE_VIDEO
+	TEST(bench_call_video),
+	TEST(bench_h264_startcode),
+#endif
 };
 
 
@@ -79,19 +101,19 @@ static int run_one_test(const struct test *test)
 }
 
 
-static int run_tests(void)
+static int run_tests(const struct test *testv, size_t testc)
 {
 	size_t i;
 	int err;
 
-	for (i=0; i<ARRAY_SIZE(tests); i++) {
+	for (i=0; i<testc; i++) {
 
-		re_printf("[ RUN      ] %s\n", tests[i].name);
+		re_printf("[ RUN      ] %s\n", testv[i].name);
 
-		err = tests[i].exec();
+		err = testv[i].exec();
 		if (err) {
 			warning("%s: test failed (%m)\n",
-				tests[i].name, err);
+				testv[i].name, err);
 			return err;
 		}
 
@@ -102,33 +124,32 @@ static int run_tests(void)
 }
 
 
-static void test_listcases(void)
+static void test_listcases(const struct test *testv, size_t n)
 {
-	size_t i, n;
-
-	n = ARRAY_SIZE(tests);
+	size_t i;
 
 	(void)re_printf("\n%zu test cases:\n", n);
 
 	for (i=0; i<(n+1)/2; i++) {
 
 		(void)re_printf("    %-32s    %s\n",
-				tests[i].name,
-				(i+(n+1)/2) < n ? tests[i+(n+1)/2].name : "");
+				testv[i].name,
+				(i+(n+1)/2) < n ? testv[i+(n+1)/2].name : "");
 	}
 
 	(void)re_printf("\n");
 }
 
 
-static const struct test *find_test(const char *name)
+static const struct test *find_test(const struct test *testv, size_t testc,
+				    const char *name)
 {
 	size_t i;
 
-	for (i=0; i<ARRAY_SIZE(tests); i++) {
+	for (i=0; i<testc; i++) {
 
-		if (0 == str_casecmp(name, tests[i].name))
-			return &tests[i];
+		if (0 == str_casecmp(name, testv[i].name))
+			return &testv[i];
 	}
 
 	return NULL;
@@ -149,6 +170,9 @@ static void usage(void)
 	(void)re_fprintf(stderr,
 			 "Usage: selftest [options] <testcases..>\n"
 			 "options:\n"
+			 "\t-b               Run benchmarks instead of tests\n"
+			 "\t-j <file>        Write benchmark results as JSON"
+			 " (implies -b)\n"
 			 "\t-l               List all testcases and exit\n"
 			 "\t-v               Verbose output (INFO level)\n"
 			 );
@@ -157,6 +181,9 @@ static void usage(void)
 
 int main(int argc, char *argv[])
 {
+	const struct test *testv = tests;
+	size_t testc = ARRAY_SIZE(tests);
+	const char *json = NULL;
 	struct config *config;
 	size_t i, ntests;
 	bool verbose = false;
@@ -169,7 +196,7 @@ int main(int argc, char *argv[])
 	log_enable_info(false);
 
 	for (;;) {
-		const int c = getopt(argc, argv, "hlv");
+		const int c = getopt(argc, argv, "bhj:lv");
 		if (0 > c)
 			break;
 
@@ -180,8 +207,17 @@ int main(int argc, char *argv[])
 			usage();
 			return -2;
 
+		case 'j':
+			json = optarg;
+			/*@fallthrough@*/
+
+		case 'b':
+			testv = benches;
+			testc = ARRAY_SIZE(benches);
+			break;
+
 		case 'l':
-			test_listcases();
+			test_listcases(testv, testc);
 			return 0;
 
 		case 'v':
@@ -200,10 +236,15 @@ int main(int argc, char *argv[])
 	if (argc >= (optind + 1))
 		ntests = argc - optind;
 	else
-		ntests = ARRAY_SIZE(tests);
+		ntests = testc;
 
-	re_printf("running baresip selftest version %s with %zu tests\n",
-		  BARESIP_VERSION, ntests);
+	re_printf("running baresip selftest version %s with %zu %s\n",
+		  BARESIP_VERSION, ntests,
+		  testv == benches ? "benchmarks" : "tests");
+
+	err = bench_open(json != NULL);
+	if (err)
+		goto out;
 
 	/* note: run SIP-traffic on localhost */
 	config = conf_config();
@@ -226,7 +267,7 @@ int main(int argc, char *argv[])
 			const char *name = argv[optind + i];
 			const struct test *test;
 
-			test = find_test(name);
+			test = find_test(testv, testc, name);
 			if (test) {
 				err = run_one_test(test);
 				if (err)
@@ -242,17 +283,21 @@ int main(int argc, char *argv[])
 		}
 	}
 	else {
-		err = run_tests();
+		err = run_tests(testv, testc);
 		if (err)
 			goto out;
 	}
 
+	err = bench_close(json);
+	if (err)
+		goto out;
+
 #if 1
 	ua_stop_all(true);
 #endif
 
-	re_printf("\x1b[32mOK. %zu tests passed successfully\x1b[;m\n",
-		  ntests);
+	re_printf("\x1b[32mOK. %zu %s passed successfully\x1b[;m\n",
+		  ntests, testv == benches ? "benchmarks" : "tests");
 
  out:
 	if (err) {
@@ -262,6 +307,8 @@ int main(int argc, char *argv[])
 	ua_stop_all(true);
 	ua_close();
 
+	(void)bench_close(NULL);
+
 	baresip_close();
 
 	libre_close();
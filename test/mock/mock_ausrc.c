@@ -21,13 +21,22 @@ struct ausrc_st {
 };
 
 
+static struct {
+	mock_read_h *readh;
+	void *arg;
+} mock;
+
+
 static void tmr_handler(void *arg)
 {
 	struct ausrc_st *st = arg;
 
 	tmr_start(&st->tmr, st->prm.ptime, tmr_handler, st);
 
-	if (st->rh)
+	/* let the test fill the frame and call the read handler */
+	if (mock.readh)
+		mock.readh(st->sampv, st->sampc, st->rh, st->arg, mock.arg);
+	else if (st->rh)
 		st->rh(st->sampv, st->sampc, st->arg);
 }
 
@@ -84,8 +93,12 @@ static int mock_ausrc_alloc(struct ausrc_st **stp, const struct ausrc *as,
 }
 
 
-int mock_ausrc_register(struct ausrc **ausrcp)
+int mock_ausrc_register(struct ausrc **ausrcp,
+			mock_read_h *readh, void *arg)
 {
+	mock.readh = readh;
+	mock.arg = arg;
+
 	return ausrc_register(ausrcp, baresip_ausrcl(),
 			      "mock-ausrc", mock_ausrc_alloc);
 }
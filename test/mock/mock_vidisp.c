@@ -19,6 +19,12 @@ struct vidisp_st {
 };
 
 
+static struct {
+	mock_frame_h *frameh;
+	void *arg;
+} mock;
+
+
 static void disp_destructor(void *arg)
 {
 	struct vidisp_st *st = arg;
@@ -80,18 +86,25 @@ static int mock_display(struct vidisp_st *st, const char *title,
 
 	++st->n_frame;
 
-	if (st->n_frame >= 10) {
+	if (mock.frameh) {
+		mock.frameh(frame, mock.arg);
+	}
+	else if (st->n_frame >= 10) {
 		info("mock_vidisp: got %u frames -- stopping re_main\n",
 		     st->n_frame);
-		re_cancel();   /* XXX use a callback handler instead */
+		re_cancel();
 	}
 
 	return 0;
 }
 
 
-int mock_vidisp_register(struct vidisp **vidispp)
+int mock_vidisp_register(struct vidisp **vidispp,
+			 mock_frame_h *frameh, void *arg)
 {
+	mock.frameh = frameh;
+	mock.arg = arg;
+
 	return vidisp_register(vidispp, baresip_vidispl(), "mock-vidisp",
 			       mock_disp_alloc, NULL, mock_display, NULL);
 }
@@ -3,8 +3,10 @@
  *
  * Copyright (C) 2010 Creytiv.com
  */
+#include <stdio.h>
 #include <string.h>
 #include <re.h>
+#include <rem.h>
 #include <baresip.h>
 #include "test.h"
 
@@ -97,3 +99,81 @@ int test_play(void)
 	mem_deref(auplay);
 	return err;
 }
+
+
+static int write_wav(const char *path, const struct mbuf *mb)
+{
+	struct aufile_prm prm = {8000, 1, AUFMT_S16LE};
+	struct aufile *af;
+	int16_t sampv[NUM_SAMPLES];
+	const int16_t *p = (void *)mb->buf;
+	size_t i;
+	int err;
+
+	err = aufile_open(&af, &prm, path, AUFILE_WRITE);
+	if (err)
+		return err;
+
+	for (i=0; i<NUM_SAMPLES; i++)
+		sampv[i] = sys_htols(p[i]);
+
+	err = aufile_write(af, (void *)sampv, sizeof(sampv));
+
+	mem_deref(af);
+
+	return err;
+}
+
+
+int test_play_file(void)
+{
+	static const char *filename = "selftest_play.wav";
+	struct auplay *auplay = NULL;
+	struct player *player = NULL;
+	struct play *play = NULL;
+	struct mbuf *mb_tone = NULL;
+	struct test test = {0};
+	unsigned i;
+	int err;
+
+	err = mock_auplay_register(&auplay, sample_handler, &test);
+	ASSERT_EQ(0, err);
+
+	err = play_init(&player);
+	ASSERT_EQ(0, err);
+
+	play_set_path(player, ".");
+
+	mb_tone = generate_tone();
+	ASSERT_TRUE(mb_tone != NULL);
+
+	err = write_wav(filename, mb_tone);
+	TEST_ERR(err);
+
+	/* the second play is served from the prompt cache */
+	for (i=0; i<2; i++) {
+
+		test.mb_samp = mem_deref(test.mb_samp);
+
+		err = play_file(&play, player, filename, 0);
+		TEST_ERR(err);
+
+		err = re_main_timeout(10000);
+		TEST_ERR(err);
+
+		TEST_MEMCMP(mb_tone->buf, NUM_SAMPLES*2,
+			    test.mb_samp->buf, test.mb_samp->end);
+
+		play = mem_deref(play);
+	}
+
+ out:
+	(void)remove(filename);
+
+	mem_deref(test.mb_samp);
+	mem_deref(mb_tone);
+	mem_deref(play);
+	mem_deref(player);
+	mem_deref(auplay);
+	return err;
+}
@@ -10,11 +10,17 @@
 #
 TEST_SRCS	+= account.c
 TEST_SRCS	+= aulevel.c
+TEST_SRCS	+= austretch.c
+TEST_SRCS	+= bench.c
 TEST_SRCS	+= call.c
 TEST_SRCS	+= cmd.c
 TEST_SRCS	+= contact.c
 TEST_SRCS	+= cplusplus.c
 TEST_SRCS	+= event.c
+ifneq ($(USE_VIDEO),)
+TEST_SRCS	+= h264.c
+endif
+TEST_SRCS	+= latency.c
 TEST_SRCS	+= message.c
 TEST_SRCS	+= mos.c
 TEST_SRCS	+= net.c
@@ -22,6 +28,7 @@ TEST_SRCS	+= play.c
 TEST_SRCS	+= ua.c
 ifneq ($(USE_VIDEO),)
 TEST_SRCS	+= video.c
+TEST_SRCS	+= vidpool.c
 endif
 
 
@@ -93,6 +93,7 @@
 
 int re_main_timeout(uint32_t timeout_ms);
 bool test_cmp_double(double a, double b, double precision);
+
 void test_hexdump_dual(FILE *f,
 		       const void *ep, size_t elen,
 		       const void *ap, size_t alen);
@@ -103,6 +104,23 @@ extern const char test_certificate[];
 #endif
 
 
+/*
+ * Benchmarks
+ */
+
+struct bench_stat;
+
+uint64_t bench_nsec(void);
+int      bench_stat_alloc(struct bench_stat **stp, size_t max);
+void     bench_stat_add(struct bench_stat *st, uint64_t val);
+size_t   bench_stat_count(const struct bench_stat *st);
+uint64_t bench_stat_pct(struct bench_stat *st, unsigned pct);
+int      bench_open(bool json);
+int      bench_report(const char *name, const char *metric, double value,
+		      const char *unit);
+int      bench_close(const char *path);
+
+
 /*
  * Mock DNS-Server
  */
@@ -134,7 +152,11 @@ void mock_aucodec_unregister(void);
 
 struct ausrc;
 
-int mock_ausrc_register(struct ausrc **ausrcp);
+typedef void (mock_read_h)(void *sampv, size_t sampc,
+			   ausrc_read_h *rh, void *rh_arg, void *arg);
+
+int mock_ausrc_register(struct ausrc **ausrcp,
+			mock_read_h *readh, void *arg);
 
 
 /*
@@ -180,13 +202,18 @@ void mock_vidcodec_unregister(void);
 
 struct vidisp;
 
-int mock_vidisp_register(struct vidisp **vidispp);
+typedef void (mock_frame_h)(const struct vidframe *frame, void *arg);
+
+int mock_vidisp_register(struct vidisp **vidispp,
+			 mock_frame_h *frameh, void *arg);
 
 
 /* test cases */
 
 int test_account(void);
 int test_aulevel(void);
+int test_aulevel_simd(void);
+int test_austretch(void);
 int test_cmd(void);
 int test_cmd_long(void);
 int test_event(void);
@@ -198,10 +225,12 @@ int test_ua_register_dns(void);
 int test_ua_register_auth(void);
 int test_ua_register_auth_dns(void);
 int test_ua_options(void);
+int test_latency(void);
 int test_message(void);
 int test_mos(void);
 int test_network(void);
 int test_play(void);
+int test_play_file(void);
 
 int test_call_answer(void);
 int test_call_reject(void);
@@ -219,7 +248,22 @@ int test_call_format_float(void);
 int test_call_mediaenc(void);
 
 #ifdef USE_VIDEO
+int test_h264_packetize(void);
+int test_h264_startcode(void);
 int test_video(void);
+int test_vidpool(void);
+#endif
+
+
+/* benchmarks */
+
+int bench_aulevel(void);
+int bench_austretch(void);
+int bench_call_audio(void);
+int bench_latency(void);
+#ifdef USE_VIDEO
+int bench_call_video(void);
+int bench_h264_startcode(void);
 #endif
 
 
@@ -0,0 +1,92 @@
+/**
+ * @file test/vidpool.c  Baresip selftest -- video frame pool
+ *
+ * Copyright (C) 2010 Creytiv.com
+ */
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+#define DEBUG_MODULE "vidpool"
+#define DEBUG_LEVEL 5
+#include <re_dbg.h>
+
+
+int test_vidpool(void)
+{
+	const struct vidsz sz_vga = {640, 480}, sz_qvga = {320, 240};
+	struct vidpool *pool = NULL;
+	struct vidframe *a = NULL, *b = NULL, *c = NULL;
+	uint8_t *prev;
+	int err;
+
+	err = vidpool_alloc(&pool);
+	TEST_ERR(err);
+
+	err = vidpool_get(pool, &a, VID_FMT_YUV420P, &sz_vga);
+	TEST_ERR(err);
+
+	ASSERT_EQ(VID_FMT_YUV420P, a->fmt);
+	ASSERT_TRUE(vidsz_cmp(&sz_vga, &a->size));
+	ASSERT_EQ(0, (uintptr_t)a->data[0] % 64);
+
+	/* a frame in use is not given out twice */
+	err = vidpool_get(pool, &b, VID_FMT_YUV420P, &sz_vga);
+	TEST_ERR(err);
+	ASSERT_TRUE(a != b);
+
+	/* a released buffer is given out again, with a fresh header */
+	prev = a->data[0];
+	a->data[0] = NULL;
+	a->size = sz_qvga;
+	a = mem_deref(a);
+
+	err = vidpool_get(pool, &a, VID_FMT_YUV420P, &sz_vga);
+	TEST_ERR(err);
+	ASSERT_TRUE(a->data[0] == prev);
+	ASSERT_TRUE(vidsz_cmp(&sz_vga, &a->size));
+
+	/* other size and format */
+	a = mem_deref(a);
+
+	err = vidpool_get(pool, &c, VID_FMT_YUV420P, &sz_qvga);
+	TEST_ERR(err);
+	ASSERT_TRUE(c->data[0] != prev);
+	c = mem_deref(c);
+
+	err = vidpool_get(pool, &c, VID_FMT_NV12, &sz_vga);
+	TEST_ERR(err);
+	ASSERT_TRUE(c->data[0] != prev);
+	ASSERT_EQ(VID_FMT_NV12, c->fmt);
+
+	/* only free frames are released */
+	vidpool_flush(pool);
+
+	err = vidpool_get(pool, &a, VID_FMT_YUV420P, &sz_vga);
+	TEST_ERR(err);
+
+	/* frames in use outlive the pool */
+	pool = mem_deref(pool);
+
+	ASSERT_TRUE(vidsz_cmp(&sz_vga, &b->size));
+	ASSERT_EQ(VID_FMT_NV12, c->fmt);
+
+	/* without a pool a plain frame is allocated */
+	c = mem_deref(c);
+	err = vidpool_get(NULL, &c, VID_FMT_YUV420P, &sz_qvga);
+	TEST_ERR(err);
+	ASSERT_TRUE(vidsz_cmp(&sz_qvga, &c->size));
+
+	ASSERT_EQ(EINVAL, vidpool_get(NULL, NULL, VID_FMT_YUV420P, &sz_qvga));
+	err = 0;
+
+ out:
+	mem_deref(c);
+	mem_deref(b);
+	mem_deref(a);
+	mem_deref(pool);
+
+	return err;
+}